@@ -17,10 +17,14 @@ const int MAX_BONE_INFLUENCE = 4;
 uniform mat4 finalBonesMatrices[MAX_BONES];
 
 out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+out float ViewDepth;
 
 void main()
 {
     vec4 totalPosition = vec4(0.0f);
+    vec3 totalNormal = vec3(0.0f);
     for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
     {
         if(boneIds[i] == -1) 
@@ -28,14 +32,20 @@ void main()
         if(boneIds[i] >=MAX_BONES) 
         {
             totalPosition = vec4(pos,1.0f);
+            totalNormal = norm;
             break;
         }
         vec4 localPosition = finalBonesMatrices[boneIds[i]] * vec4(pos,1.0f);
         totalPosition += localPosition * weights[i];
         vec3 localNormal = mat3(finalBonesMatrices[boneIds[i]]) * norm;
+        totalNormal += localNormal * weights[i];
    }
 	
     mat4 viewModel = view * model;
-    gl_Position =  projection * viewModel * totalPosition;
+    vec4 viewPos = viewModel * totalPosition;
+    gl_Position =  projection * viewPos;
 	TexCoords = tex;
+    FragPos = vec3(model * totalPosition);
+    Normal = mat3(model) * totalNormal;
+    ViewDepth = -viewPos.z;
 }
@@ -0,0 +1,132 @@
+#ifndef ANIMATION_CLIP_H
+#define ANIMATION_CLIP_H
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <learnopengl/bone.h>
+
+#include "blend_tree.h"
+#include "resource_cache.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// a clip file as the blend tree samples it: the node hierarchy, a Bone per animated node and the
+// timing. LearnOpenGL's Animation reads the same, but registers its bones in a Model and so can't
+// be built before one is uploaded; this needs only the file, so the streamer reads it on its own
+// thread. the hierarchy comes from the resource cache, one copy per rig however many clips it
+// has; palette slots come from the model when the rig is built (see buildSkeleton)
+class AnimationData
+{
+public:
+	bool Load(const std::string& path)
+	{
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate);
+		if (!scene || !scene->mRootNode || scene->mNumAnimations == 0)
+		{
+			std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+			return false;
+		}
+		const aiAnimation* animation = scene->mAnimations[0];
+		m_Duration = (float)animation->mDuration;
+		m_TicksPerSecond = (int)animation->mTicksPerSecond;   // whole ticks, as Animation keeps them
+		m_Hierarchy = ResourceCache::Get().AcquireSkeleton(scene->mRootNode);
+		m_Bones.clear();
+		m_Bones.reserve(animation->mNumChannels);
+		for (unsigned int i = 0; i < animation->mNumChannels; i++)
+		{
+			const aiNodeAnim* channel = animation->mChannels[i];
+			m_Bones.push_back(Bone(channel->mNodeName.data, -1, channel));
+		}
+		return true;
+	}
+
+	Bone* FindBone(const std::string& name)
+	{
+		for (size_t i = 0; i < m_Bones.size(); i++)
+			if (m_Bones[i].GetBoneName() == name)
+				return &m_Bones[i];
+		return nullptr;
+	}
+
+	const SkeletonHierarchy& GetHierarchy() const
+	{
+		return *m_Hierarchy;
+	}
+
+	float GetDuration() const
+	{
+		return m_Duration;
+	}
+
+	float GetTicksPerSecond() const
+	{
+		return (float)m_TicksPerSecond;
+	}
+
+private:
+	float m_Duration = 0.0f;
+	int m_TicksPerSecond = 0;
+	std::vector<Bone> m_Bones;
+	std::shared_ptr<const SkeletonHierarchy> m_Hierarchy;
+};
+
+// a streamed clip bound to a skeleton for the blend tree. the bones are looked up by name
+// once here rather than on every sample, which is what the Animator does
+class AnimationClip : public PoseClip
+{
+public:
+	AnimationClip(AnimationData* animation, const Skeleton& skeleton)
+		: m_Animation(animation)
+	{
+		m_Bones.resize(skeleton.Count(), nullptr);
+		for (unsigned int j = 0; j < skeleton.Count(); j++)
+			m_Bones[j] = animation->FindBone(skeleton.names[j]);
+	}
+
+	bool Sample(unsigned int joint, float time, JointPose& pose) override
+	{
+		Bone* bone = m_Bones[joint];
+		if (!bone)
+			return false;
+		bone->Update(time);
+		pose = decomposeJoint(bone->GetLocalTransform());
+		return true;
+	}
+
+	float GetDuration() override
+	{
+		return m_Animation->GetDuration();
+	}
+
+	AnimationData* GetAnimation() const
+	{
+		return m_Animation;
+	}
+
+private:
+	AnimationData* m_Animation;
+	std::vector<Bone*> m_Bones;
+};
+
+// the clip's node hierarchy, already flattened parent first, with the palette slots of the
+// model's bones; nodes that skin nothing have no slot and only pass their transform down
+inline void buildSkeleton(const AnimationData& animation, const std::map<std::string, BoneInfo>& boneInfo, Skeleton& skeleton)
+{
+	const SkeletonHierarchy& hierarchy = animation.GetHierarchy();
+	skeleton = Skeleton();
+	for (size_t i = 0; i < hierarchy.names.size(); i++)
+	{
+		auto bone = boneInfo.find(hierarchy.names[i]);
+		int id = bone != boneInfo.end() ? bone->second.id : -1;
+		glm::mat4 offset = bone != boneInfo.end() ? bone->second.offset : glm::mat4(1.0f);
+		skeleton.AddJoint(hierarchy.names[i], hierarchy.parents[i], hierarchy.transforms[i], id, offset);
+	}
+}
+
+#endif
@@ -0,0 +1,45 @@
+#include <glm/glm.hpp>
+
+#include "arena.h"
+
+void resetArena(ArenaSimulation& arena, unsigned int monsters)
+{
+	arena.world = World();
+	arena.monsters = monsters;
+	arena.world.Reserve(1 + monsters);
+	arena.player = spawnCharacter(arena.world, KNIGHT, PLAYER_START, 0.0f);
+	for (unsigned int i = 0; i < monsters; i++)
+	{
+		float offset = (i - (monsters - 1) * 0.5f) * MONSTER_SPACING;
+		spawnCharacter(arena.world, MONSTER, ENEMY_START + glm::vec3(offset, 0.0f, 0.0f), 0.0f);
+	}
+	arena.aiCursor = 0;
+	arena.decidedTicks = 0;
+}
+
+uint32_t botIntent(uint32_t tick)
+{
+	uint32_t phase = tick % 240;
+	if (phase < 150)
+		return INTENT_FORWARD;
+	if (phase < 170)
+		return INTENT_TURN_LEFT | INTENT_FORWARD;
+	return INTENT_ATTACK;
+}
+
+void stepArena(ArenaSimulation& arena, uint32_t intent, float dt)
+{
+	World& world = arena.world;
+	world.anim[world.Slot(arena.player)].intent = intent;
+	arena.events.clear();
+	stepSimulation(world, arena.flowField, arena.aiCursor, arena.player, dt, arena.events);
+	arena.tick++;
+
+	bool monstersLeft = false;
+	for (unsigned int i = 0; i < world.Count(); i++)
+		if (world.kind[i] == MONSTER && world.health[i].alive)
+			monstersLeft = true;
+	if (!world.health[world.Slot(arena.player)].alive || !monstersLeft)
+		if (++arena.decidedTicks > ARENA_RESET_TICKS)
+			resetArena(arena, arena.monsters);
+}
@@ -0,0 +1,40 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "ecs.h"
+#include "flow_field.h"
+#include "simulation.h"
+
+#include <cstdint>
+#include <vector>
+
+// one player-vs-monster fight as the server runs it, without the network: the server's arenas
+// and the headless arena of the tests and benchmarks are both built on this
+
+const unsigned int ARENA_RESET_TICKS = 180;  // after the fight is decided
+const float MONSTER_SPACING = 2.0f;
+
+struct ArenaSimulation
+{
+	World world;
+	FlowField flowField;   // Init it with the level's nav grid before the first reset
+	unsigned int aiCursor = 0;
+	Entity player;
+	unsigned int monsters = 0;
+	uint32_t tick = 0;
+	unsigned int decidedTicks = 0;
+	std::vector<CombatEvent> events;   // this tick's hits
+};
+
+// the player at its start and the monsters side by side at theirs. the tick keeps counting, so
+// clients holding older states can tell the new ones apart
+void resetArena(ArenaSimulation& arena, unsigned int monsters);
+
+// a scripted player for load tests and benchmarks: walks in, turns now and then, swings
+uint32_t botIntent(uint32_t tick);
+
+// one tick of the rules with the player's intent; once the player or every monster is down,
+// starts over after a while
+void stepArena(ArenaSimulation& arena, uint32_t intent, float dt);
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef ARENA_CLIENT_H
+#define ARENA_CLIENT_H
+
+#include <glm/glm.hpp>
+
+#include "ecs.h"
+#include "net.h"
+#include "snapshot.h"
+
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// connection to an arena server. sends the local player's intent every frame and turns the
+// server's delta snapshots back into a World to draw. the world shown trails the newest
+// snapshot by INTERP_TICKS and is interpolated between the two snapshots around it, so it
+// moves smoothly through late or lost packets
+class ArenaClient
+{
+public:
+	static const unsigned int INTERP_TICKS = 6;
+	static const unsigned int RECEIVED_HISTORY = 64;
+
+	struct Stats
+	{
+		size_t bytesIn = 0;
+		size_t bytesOut = 0;
+		unsigned int snapshots = 0;
+		unsigned int dropped = 0;  // arrived without the base they were encoded against
+	};
+
+	~ArenaClient()
+	{
+		Disconnect();
+	}
+
+	// blocks until the server has placed us in an arena and sent the first snapshot
+	bool Connect(const std::string& server, float timeoutSeconds)
+	{
+		if (!NetAddress::Parse(server, m_Server))
+		{
+			std::cout << "Bad server address: " << server << std::endl;
+			return false;
+		}
+		if (!m_Socket.Open(0))
+			return false;
+
+		auto start = std::chrono::steady_clock::now();
+		while (m_Received.empty())
+		{
+			if (!m_Welcomed)
+				SendPacket(PACKET_HELLO);
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			Receive();
+			if (std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count() > timeoutSeconds)
+			{
+				std::cout << "No answer from arena server " << m_Server.ToString() << std::endl;
+				return false;
+			}
+		}
+		m_RenderTick = (float)m_Received.back().tick;
+		m_Connected = true;
+		std::cout << "Joined arena " << m_Arena << " on " << m_Server.ToString() << std::endl;
+		return true;
+	}
+
+	void Disconnect()
+	{
+		if (m_Connected)
+			SendPacket(PACKET_BYE);
+		m_Connected = false;
+		m_Socket.Close();
+	}
+
+	bool Connected() const
+	{
+		return m_Connected;
+	}
+
+	void SendInput(uint32_t intent)
+	{
+		SnapshotWriter writer(m_Packet);
+		WriteHeader(writer, PACKET_INPUT);
+		writer.Write(++m_Sequence);
+		writer.Write(m_Received.empty() ? ARENA_NO_BASE : m_Received.back().tick);
+		writer.Write(intent);
+		m_Socket.Send(m_Server, m_Packet.data(), m_Packet.size());
+		m_Stats.bytesOut += m_Packet.size();
+	}
+
+	// drains the socket
+	void Receive()
+	{
+		uint8_t buffer[ARENA_MAX_PACKET];
+		NetAddress from;
+		int size;
+		while ((size = m_Socket.Receive(buffer, sizeof(buffer), from)) >= 0)
+		{
+			if (!(from == m_Server))
+				continue;
+			m_Stats.bytesIn += size;
+
+			SnapshotReader reader(buffer, size);
+			uint32_t protocol = 0;
+			uint8_t type = 0;
+			if (!reader.Read(protocol) || !reader.Read(type) || protocol != ARENA_PROTOCOL_ID)
+				continue;
+			if (type == PACKET_WELCOME)
+			{
+				m_Welcomed = reader.Read(m_Arena) && reader.Read(m_TickRate);
+			}
+			else if (type == PACKET_SNAPSHOT)
+			{
+				ReadSnapshot(reader);
+			}
+			else if (type == PACKET_BYE)
+			{
+				std::cout << "Arena server closed the connection" << std::endl;
+				m_Connected = false;
+			}
+		}
+	}
+
+	// writes the world to draw this frame; dt advances the render clock
+	void Interpolate(float dt, World& world, Entity& player)
+	{
+		if (m_Received.empty())
+			return;
+
+		// the render clock runs at the server's tick rate and is steered towards
+		// INTERP_TICKS behind the newest snapshot, or jumps there if far off
+		float target = (float)m_Received.back().tick - INTERP_TICKS;
+		m_RenderTick += dt * m_TickRate;
+		if (std::fabs(target - m_RenderTick) > RESYNC_TICKS)
+			m_RenderTick = target;
+		else
+			m_RenderTick += (target - m_RenderTick) * CLOCK_CORRECTION;
+		m_RenderTick = std::min(m_RenderTick, (float)m_Received.back().tick);
+
+		size_t from = 0;
+		while (from + 1 < m_Received.size() && (float)m_Received[from + 1].tick <= m_RenderTick)
+			from++;
+		const Received& a = m_Received[from];
+		SnapshotReader reader(a.state.data(), a.state.size());
+		WorldSnapshot::Read(reader, world);
+		player = a.player;
+		if (from + 1 == m_Received.size())
+			return;
+
+		const Received& b = m_Received[from + 1];
+		SnapshotReader nextReader(b.state.data(), b.state.size());
+		if (!WorldSnapshot::Read(nextReader, m_Next))
+			return;
+		float t = glm::clamp((m_RenderTick - a.tick) / (float)(b.tick - a.tick), 0.0f, 1.0f);
+		for (unsigned int i = 0; i < world.Count() && i < m_Next.Count(); i++)
+		{
+			Entity e = world.EntityAt(i);
+			Entity next = m_Next.EntityAt(i);
+			if (e.index != next.index || e.generation != next.generation)
+				continue;
+
+			TransformComponent& ta = world.transform[i];
+			const TransformComponent& tb = m_Next.transform[i];
+			ta.position = glm::mix(ta.position, tb.position, t);
+			float turn = std::fmod(tb.yaw - ta.yaw + 540.0f, 360.0f) - 180.0f;
+			ta.yaw += turn * t;
+			ta.speed += (tb.speed - ta.speed) * t;
+
+			// clip times only blend while the same clip keeps running forwards
+			AnimStateComponent& aa = world.anim[i];
+			const AnimStateComponent& ab = m_Next.anim[i];
+			if (aa.clip0 == ab.clip0 && ab.time0 >= aa.time0)
+				aa.time0 += (ab.time0 - aa.time0) * t;
+			if (aa.clip1 == ab.clip1 && ab.time1 >= aa.time1)
+				aa.time1 += (ab.time1 - aa.time1) * t;
+			if (aa.clip1 == ab.clip1 && ab.blend >= aa.blend)
+				aa.blend += (ab.blend - aa.blend) * t;
+			if (aa.layerClip == ab.layerClip && ab.layerTime >= aa.layerTime)
+				aa.layerTime += (ab.layerTime - aa.layerTime) * t;
+			if (aa.layerClip == ab.layerClip)
+				aa.layerWeight += (ab.layerWeight - aa.layerWeight) * t;
+		}
+	}
+
+	const Stats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+private:
+	const float RESYNC_TICKS = 30.0f;
+	const float CLOCK_CORRECTION = 0.05f;
+
+	struct Received
+	{
+		uint32_t tick;
+		Entity player;
+		std::vector<uint8_t> state;
+	};
+
+	void WriteHeader(SnapshotWriter& writer, ArenaPacket type)
+	{
+		writer.Write(ARENA_PROTOCOL_ID);
+		writer.Write((uint8_t)type);
+	}
+
+	void SendPacket(ArenaPacket type)
+	{
+		SnapshotWriter writer(m_Packet);
+		WriteHeader(writer, type);
+		m_Socket.Send(m_Server, m_Packet.data(), m_Packet.size());
+		m_Stats.bytesOut += m_Packet.size();
+	}
+
+	void ReadSnapshot(SnapshotReader& reader)
+	{
+		Received snapshot;
+		uint32_t base = 0;
+		if (!reader.Read(snapshot.tick) || !reader.Read(base) ||
+			!reader.Read(snapshot.player.index) || !reader.Read(snapshot.player.generation))
+			return;
+		if (!m_Received.empty() && snapshot.tick <= m_Received.back().tick)
+			return;
+
+		if (base != ARENA_NO_BASE)
+		{
+			const Received* found = NULL;
+			for (size_t i = 0; i < m_Received.size() && !found; i++)
+				if (m_Received[i].tick == base)
+					found = &m_Received[i];
+			if (!found)
+			{
+				m_Stats.dropped++;
+				return;
+			}
+			snapshot.state = found->state;
+		}
+		size_t size = 0;
+		const uint8_t* delta = reader.Remaining(size);
+		if (!SnapshotDelta::Apply(snapshot.state, delta, size))
+			return;
+		// only states that read back whole are kept, so Interpolate never draws a broken one
+		SnapshotReader check(snapshot.state.data(), snapshot.state.size());
+		if (!WorldSnapshot::Read(check, m_Next))
+			return;
+
+		m_Received.push_back(std::move(snapshot));
+		if (m_Received.size() > RECEIVED_HISTORY)
+			m_Received.pop_front();
+		m_Stats.snapshots++;
+	}
+
+	UdpSocket m_Socket;
+	NetAddress m_Server;
+	bool m_Welcomed = false;
+	bool m_Connected = false;
+	uint32_t m_Arena = 0;
+	float m_TickRate = 60.0f;
+	uint32_t m_Sequence = 0;
+	float m_RenderTick = 0.0f;
+	std::deque<Received> m_Received;
+	std::vector<uint8_t> m_Packet;
+	World m_Next;
+	Stats m_Stats;
+};
+
+#endif
@@ -0,0 +1,444 @@
+#include <glm/glm.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <learnopengl/filesystem.h>
+
+#include "arena.h"
+#include "net.h"
+#include "simulation.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// headless arena server: runs many independent player-vs-monster arenas with the same rules
+// as the client, sharded across worker threads. clients join over UDP, send their intents and
+// get delta snapshots back; see net.h for the protocol.
+//
+//   arena_server [--port 27015] [--arenas 64] [--workers <cores>] [--monsters 3] [--bots]
+//
+// --bots fills every arena without a client with a scripted player, for load testing
+
+struct Arena;
+bool loadClipTimings();
+bool loadNavGrid(NavGrid& grid);
+void tickArena(Arena& arena, UdpSocket& socket, std::vector<uint8_t>& state, std::vector<uint8_t>& packet);
+void workerThread(unsigned int worker, unsigned int workerCount, UdpSocket* socket);
+void handlePacket(UdpSocket& socket, const NetAddress& from, const uint8_t* data, int size);
+void printArenaStats(float seconds);
+void stopSignal(int signal);
+
+// settings
+const float TICK_RATE = 60.0f;
+const float CLIENT_TIMEOUT = 5.0f;           // seconds without input before a client is dropped
+const unsigned int SNAPSHOT_BACKLOG = 32;    // sent states kept per arena to delta against
+const float STATS_INTERVAL = 5.0f;
+const unsigned int MAX_MONSTERS = 8;         // keeps a full snapshot within one datagram
+
+// a client's view of an arena, written by the network thread and read by the arena's worker
+struct ArenaInbox
+{
+	bool connected = false;
+	bool joined = false;     // new client, the arena starts over for it
+	NetAddress client;
+	uint32_t intent = 0;
+	uint32_t ackTick = ARENA_NO_BASE;
+	std::chrono::steady_clock::time_point lastHeard;
+	size_t bytesIn = 0;
+};
+
+struct ArenaStats
+{
+	unsigned int ticks = 0;
+	float tickUs = 0.0f;
+	float maxTickUs = 0.0f;
+	size_t bytesOut = 0;
+	size_t bytesIn = 0;
+};
+
+// the fight's events are not sent, clients have no feed for them
+struct Arena : ArenaSimulation
+{
+	unsigned int id = 0;
+
+	// states sent to the client, oldest first, to delta the next one against what it acknowledged
+	std::deque<std::pair<uint32_t, std::vector<uint8_t> > > sent;
+
+	std::mutex mutex;   // guards inbox and stats
+	ArenaInbox inbox;
+	ArenaStats stats;
+};
+
+NavGrid navGrid;
+std::vector<std::unique_ptr<Arena> > arenas;
+std::map<NetAddress, unsigned int> clientArenas;   // network thread only
+unsigned int monstersPerArena = 3;
+bool bots = false;
+std::atomic<bool> running(true);
+
+int main(int argc, char** argv)
+{
+	uint16_t port = ARENA_DEFAULT_PORT;
+	unsigned int arenaCount = 64;
+	unsigned int workerCount = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+			port = (uint16_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--arenas") == 0 && i + 1 < argc)
+			arenaCount = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+			workerCount = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--monsters") == 0 && i + 1 < argc)
+			monstersPerArena = std::min((unsigned int)std::max(0, atoi(argv[++i])), MAX_MONSTERS);
+		else if (strcmp(argv[i], "--bots") == 0)
+			bots = true;
+	}
+	workerCount = std::min(workerCount, arenaCount);
+
+	// the server needs the clips' timings and the map's floor, not the meshes
+	initCharacterDefs();
+	if (!loadClipTimings() || !loadNavGrid(navGrid))
+		return -1;
+
+	UdpSocket socket;
+	if (!socket.Open(port))
+		return -1;
+
+	for (unsigned int i = 0; i < arenaCount; i++)
+	{
+		arenas.push_back(std::unique_ptr<Arena>(new Arena()));
+		arenas[i]->id = i;
+		arenas[i]->flowField.Init(&navGrid);
+		resetArena(*arenas[i], monstersPerArena);
+	}
+	std::cout << "Arena server on port " << port << ": " << arenaCount << " arenas, " << workerCount << " workers"
+		<< (bots ? ", bots" : "") << std::endl;
+
+	std::signal(SIGINT, stopSignal);
+	std::signal(SIGTERM, stopSignal);
+
+	// arena i runs on worker i % workerCount
+	std::vector<std::thread> workers;
+	for (unsigned int w = 0; w < workerCount; w++)
+		workers.push_back(std::thread(workerThread, w, workerCount, &socket));
+
+	// network thread: joins, inputs, timeouts and the periodic report
+	auto lastStats = std::chrono::steady_clock::now();
+	uint8_t buffer[ARENA_MAX_PACKET];
+	while (running)
+	{
+		if (socket.Wait(100))
+		{
+			NetAddress from;
+			int size;
+			while ((size = socket.Receive(buffer, sizeof(buffer), from)) >= 0)
+				handlePacket(socket, from, buffer, size);
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		for (auto it = clientArenas.begin(); it != clientArenas.end();)
+		{
+			Arena& arena = *arenas[it->second];
+			std::lock_guard<std::mutex> lock(arena.mutex);
+			if (std::chrono::duration<float>(now - arena.inbox.lastHeard).count() > CLIENT_TIMEOUT)
+			{
+				std::cout << "Client " << it->first.ToString() << " timed out of arena " << arena.id << std::endl;
+				arena.inbox.connected = false;
+				it = clientArenas.erase(it);
+			}
+			else
+				++it;
+		}
+
+		float sinceStats = std::chrono::duration<float>(now - lastStats).count();
+		if (sinceStats >= STATS_INTERVAL)
+		{
+			printArenaStats(sinceStats);
+			lastStats = now;
+		}
+	}
+
+	for (size_t w = 0; w < workers.size(); w++)
+		workers[w].join();
+	return 0;
+}
+
+void stopSignal(int signal)
+{
+	running = false;
+}
+
+// clip durations straight from the files; the server never samples clips, so there are no poses
+// either and attack boxes stay at their fixed offset
+bool loadClipTimings()
+{
+	for (unsigned int i = 0; i < CLIP_ASSET_COUNT; i++)
+	{
+		const ClipAsset& asset = CLIP_ASSETS[i];
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(FileSystem::getPath(asset.path), aiProcess_Triangulate);
+		if (!scene || scene->mNumAnimations == 0)
+		{
+			std::cout << "Failed to load clip: " << asset.path << std::endl;
+			return false;
+		}
+		ClipInfo& clip = characterDefs[asset.kind].clips[asset.clip];
+		clip.duration = (float)scene->mAnimations[0]->mDuration;
+		clip.ticksPerSecond = (float)scene->mAnimations[0]->mTicksPerSecond;
+		clip.loaded = true;
+		loadClipEvents(asset.kind, asset.clip, clip);
+	}
+	for (int k = 0; k < CHARACTER_KIND_COUNT; k++)
+		characterDefs[k].active = true;
+	return true;
+}
+
+bool loadNavGrid(NavGrid& grid)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(FileSystem::getPath(MAP_PATH), aiProcess_Triangulate);
+	if (!scene)
+	{
+		std::cout << "Failed to load map: " << MAP_PATH << std::endl;
+		return false;
+	}
+	std::vector<glm::vec3> triangles;
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+	{
+		const aiMesh* mesh = scene->mMeshes[m];
+		for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+		{
+			const aiFace& face = mesh->mFaces[f];
+			if (face.mNumIndices != 3)
+				continue;
+			for (unsigned int j = 0; j < 3; j++)
+			{
+				const aiVector3D& v = mesh->mVertices[face.mIndices[j]];
+				triangles.push_back(glm::vec3(v.x, v.y, v.z) * MAP_SCALE);
+			}
+		}
+	}
+	buildNavGrid(grid, triangles);
+	return true;
+}
+
+void tickArena(Arena& arena, UdpSocket& socket, std::vector<uint8_t>& state, std::vector<uint8_t>& packet)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ArenaInbox inbox;
+	{
+		std::lock_guard<std::mutex> lock(arena.mutex);
+		inbox = arena.inbox;
+		arena.inbox.bytesIn = 0;
+		arena.inbox.joined = false;
+	}
+	bool connected = inbox.connected;
+	if (!connected && !bots)
+		return;
+	if (inbox.joined)
+	{
+		resetArena(arena, monstersPerArena);
+		arena.sent.clear();
+	}
+
+	// bots are spread over the script so the arenas don't all swing on the same tick
+	stepArena(arena, connected ? inbox.intent : botIntent(arena.tick + arena.id * 37), 1.0f / TICK_RATE);
+
+	// snapshot, delta encoded against the newest state the client has acknowledged; bots
+	// acknowledge everything so they cost the same as a client on a perfect link
+	SnapshotWriter stateWriter(state);
+	WorldSnapshot::Write(stateWriter, arena.world);
+
+	uint32_t ackTick = connected ? inbox.ackTick : (arena.sent.empty() ? ARENA_NO_BASE : arena.sent.back().first);
+	const std::vector<uint8_t>* base = NULL;
+	for (size_t i = 0; i < arena.sent.size() && ackTick != ARENA_NO_BASE; i++)
+		if (arena.sent[i].first == ackTick)
+			base = &arena.sent[i].second;
+
+	static thread_local std::vector<uint8_t> delta;
+	static const std::vector<uint8_t> none;
+	SnapshotDelta::Encode(base ? *base : none, state, delta);
+
+	SnapshotWriter writer(packet);
+	writer.Write(ARENA_PROTOCOL_ID);
+	writer.Write((uint8_t)PACKET_SNAPSHOT);
+	writer.Write(arena.tick);
+	writer.Write(base ? ackTick : ARENA_NO_BASE);
+	writer.Write(arena.player.index);
+	writer.Write(arena.player.generation);
+	writer.WriteBytes(delta.data(), delta.size());
+	if (packet.size() > ARENA_MAX_PACKET)
+		std::cout << "Arena " << arena.id << ": snapshot of " << packet.size() << " bytes exceeds the packet size" << std::endl;
+	else if (connected)
+		socket.Send(inbox.client, packet.data(), packet.size());
+
+	// recycle the oldest buffer for the state just sent
+	if (arena.sent.size() >= SNAPSHOT_BACKLOG)
+	{
+		arena.sent.push_back(std::move(arena.sent.front()));
+		arena.sent.pop_front();
+		arena.sent.back().first = arena.tick;
+		arena.sent.back().second = state;
+	}
+	else
+		arena.sent.push_back(std::make_pair(arena.tick, state));
+
+	auto end = std::chrono::high_resolution_clock::now();
+	float us = std::chrono::duration<float, std::micro>(end - start).count();
+	std::lock_guard<std::mutex> lock(arena.mutex);
+	arena.stats.ticks++;
+	arena.stats.tickUs += us;
+	arena.stats.maxTickUs = std::max(arena.stats.maxTickUs, us);
+	arena.stats.bytesOut += packet.size();
+	arena.stats.bytesIn += inbox.bytesIn;
+}
+
+// fixed rate loop over this worker's arenas; a worker that falls behind skips ticks rather than bursting
+void workerThread(unsigned int worker, unsigned int workerCount, UdpSocket* socket)
+{
+	std::vector<uint8_t> state;
+	std::vector<uint8_t> packet;
+	auto tickLength = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(1.0f / TICK_RATE));
+	auto next = std::chrono::steady_clock::now();
+	while (running)
+	{
+		for (size_t i = worker; i < arenas.size(); i += workerCount)
+			tickArena(*arenas[i], *socket, state, packet);
+
+		next += tickLength;
+		auto now = std::chrono::steady_clock::now();
+		if (next < now)
+			next = now;
+		std::this_thread::sleep_until(next);
+	}
+}
+
+void handlePacket(UdpSocket& socket, const NetAddress& from, const uint8_t* data, int size)
+{
+	SnapshotReader reader(data, size);
+	uint32_t protocol = 0;
+	uint8_t type = 0;
+	if (!reader.Read(protocol) || !reader.Read(type) || protocol != ARENA_PROTOCOL_ID)
+		return;
+
+	auto known = clientArenas.find(from);
+	if (type == PACKET_HELLO)
+	{
+		unsigned int id = 0;
+		if (known != clientArenas.end())
+			id = known->second;
+		else
+		{
+			// first arena without a client
+			bool found = false;
+			for (; id < arenas.size() && !found; id++)
+			{
+				std::lock_guard<std::mutex> lock(arenas[id]->mutex);
+				found = !arenas[id]->inbox.connected;
+				if (found)
+				{
+					arenas[id]->inbox = ArenaInbox();
+					arenas[id]->inbox.connected = true;
+					arenas[id]->inbox.joined = true;
+					arenas[id]->inbox.client = from;
+					arenas[id]->inbox.lastHeard = std::chrono::steady_clock::now();
+				}
+			}
+			if (!found)
+			{
+				std::cout << "All arenas are full, turning away " << from.ToString() << std::endl;
+				return;
+			}
+			id--;
+			clientArenas[from] = id;
+			std::cout << "Client " << from.ToString() << " joined arena " << id << std::endl;
+		}
+
+		std::vector<uint8_t> packet;
+		SnapshotWriter writer(packet);
+		writer.Write(ARENA_PROTOCOL_ID);
+		writer.Write((uint8_t)PACKET_WELCOME);
+		writer.Write((uint32_t)id);
+		writer.Write(TICK_RATE);
+		socket.Send(from, packet.data(), packet.size());
+		return;
+	}
+
+	if (known == clientArenas.end())
+		return;
+	Arena& arena = *arenas[known->second];
+	std::lock_guard<std::mutex> lock(arena.mutex);
+	arena.inbox.bytesIn += size;
+	arena.inbox.lastHeard = std::chrono::steady_clock::now();
+	if (type == PACKET_INPUT)
+	{
+		uint32_t sequence = 0, ackTick = 0, intent = 0;
+		if (reader.Read(sequence) && reader.Read(ackTick) && reader.Read(intent))
+		{
+			arena.inbox.intent = intent;
+			if (ackTick != ARENA_NO_BASE && (arena.inbox.ackTick == ARENA_NO_BASE || ackTick > arena.inbox.ackTick))
+				arena.inbox.ackTick = ackTick;
+		}
+	}
+	else if (type == PACKET_BYE)
+	{
+		std::cout << "Client " << from.ToString() << " left arena " << arena.id << std::endl;
+		arena.inbox.connected = false;
+		clientArenas.erase(known);
+	}
+}
+
+// per-arena tick cost and bandwidth since the last report; the slowest arenas are listed
+void printArenaStats(float seconds)
+{
+	struct Row
+	{
+		unsigned int id;
+		ArenaStats stats;
+	};
+	std::vector<Row> rows;
+	for (size_t i = 0; i < arenas.size(); i++)
+	{
+		std::lock_guard<std::mutex> lock(arenas[i]->mutex);
+		if (arenas[i]->stats.ticks > 0)
+			rows.push_back(Row{ arenas[i]->id, arenas[i]->stats });
+		arenas[i]->stats = ArenaStats();
+	}
+	if (rows.empty())
+		return;
+
+	std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+		return a.stats.tickUs / a.stats.ticks > b.stats.tickUs / b.stats.ticks;
+	});
+	float totalUs = 0.0f;
+	size_t totalOut = 0, totalIn = 0;
+	for (size_t i = 0; i < rows.size(); i++)
+	{
+		totalUs += rows[i].stats.tickUs / rows[i].stats.ticks;
+		totalOut += rows[i].stats.bytesOut;
+		totalIn += rows[i].stats.bytesIn;
+	}
+	std::cout << rows.size() << " active arenas: avg tick " << totalUs / rows.size() << " us, out "
+		<< totalOut / seconds / 1024.0f << " KB/s, in " << totalIn / seconds / 1024.0f << " KB/s" << std::endl;
+	for (size_t i = 0; i < rows.size() && i < 8; i++)
+	{
+		const ArenaStats& s = rows[i].stats;
+		std::cout << "  arena " << rows[i].id << ": tick avg " << s.tickUs / s.ticks << " us max " << s.maxTickUs
+			<< " us, out " << s.bytesOut / seconds / 1024.0f << " KB/s, in " << s.bytesIn / seconds / 1024.0f << " KB/s" << std::endl;
+	}
+}
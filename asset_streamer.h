@@ -0,0 +1,469 @@
+#ifndef ASSET_STREAMER_H
+#define ASSET_STREAMER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "animation_clip.h"
+#include "resource_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// loads and evicts models and animation clips on demand.
+// a background thread does the file I/O, the assimp imports and the texture decoding (no GL
+// involved); only the upload of a model's buffers and textures is left for the main thread in
+// Update(), at most one model per frame. resident assets are evicted least-recently-used first
+// once the memory budget is exceeded.
+class AssetStreamer
+{
+public:
+	typedef int Handle;
+	static const Handle InvalidHandle = -1;
+
+	struct Stats
+	{
+		size_t residentBytes = 0;
+		size_t budgetBytes = 0;
+		unsigned int loads = 0;
+		unsigned int evictions = 0;
+		unsigned int pending = 0;
+		float lastLoadMs = 0.0f;
+	};
+
+	AssetStreamer(size_t budgetBytes)
+	{
+		m_Stats.budgetBytes = budgetBytes;
+		m_Thread = std::thread(&AssetStreamer::IoThread, this);
+	}
+
+	~AssetStreamer()
+	{
+		StopThread();
+	}
+
+	// drops every asset; call before the GL context goes away since models free GL objects
+	void ReleaseAll()
+	{
+		StopThread();
+		m_Ready.clear();
+		m_Completed.clear();
+		for (size_t i = 0; i < m_Assets.size(); i++)
+		{
+			m_Assets[i].model.reset();
+			m_Assets[i].animation.reset();
+			m_Assets[i].state = UNLOADED;
+			m_Assets[i].bytes = 0;
+		}
+		m_ClipBytes = 0;
+		m_Stats.residentBytes = 0;
+	}
+
+	// models are requested while the viewer is within radius of their anchor
+	Handle RegisterModel(const std::string& path, const glm::vec3& anchor, float radius)
+	{
+		Asset asset;
+		asset.kind = MODEL;
+		asset.path = path;
+		asset.anchor = anchor;
+		asset.radius = radius;
+		m_Assets.push_back(std::move(asset));
+		return (Handle)m_Assets.size() - 1;
+	}
+
+	// clips follow their model in; on-demand clips wait for an explicit Request()
+	Handle RegisterAnimation(const std::string& path, Handle model, bool onDemand = false)
+	{
+		Asset asset;
+		asset.kind = ANIMATION;
+		asset.path = path;
+		asset.owner = model;
+		asset.onDemand = onDemand;
+		m_Assets.push_back(std::move(asset));
+		return (Handle)m_Assets.size() - 1;
+	}
+
+	void SetAnchor(Handle handle, const glm::vec3& anchor)
+	{
+		m_Assets[handle].anchor = anchor;
+	}
+
+	// sticky request, e.g. a clip that the state machine may need soon
+	void Request(Handle handle)
+	{
+		m_Assets[handle].requested = true;
+	}
+
+	// pinned assets are never evicted
+	void Pin(Handle handle, bool pinned = true)
+	{
+		m_Assets[handle].pinned = pinned;
+	}
+
+	// while held, nothing is evicted, so pointers handed out stay valid even with the lock let go
+	// in between; loads carry on. evictions over budget happen at the first Update after
+	void HoldEvictions(bool held)
+	{
+		m_EvictionsHeld = held;
+	}
+
+	// marks an asset as used now, keeping it out of the eviction candidates for a while
+	void Touch(Handle handle)
+	{
+		m_Assets[handle].lastUsed = m_Clock;
+	}
+
+	// whether the asset is currently in range or requested
+	bool IsWanted(Handle handle) const
+	{
+		return m_Assets[handle].wanted;
+	}
+
+	bool IsResident(Handle handle) const
+	{
+		return m_Assets[handle].state == RESIDENT;
+	}
+
+	// nullptr while the asset is still pending
+	CachedModel* GetModel(Handle handle)
+	{
+		Asset& asset = m_Assets[handle];
+		return asset.state == RESIDENT ? asset.model.get() : nullptr;
+	}
+
+	// also nullptr if the clip couldn't be read
+	AnimationData* GetAnimation(Handle handle)
+	{
+		Asset& asset = m_Assets[handle];
+		return asset.state == RESIDENT ? asset.animation.get() : nullptr;
+	}
+
+	// changes whenever the asset is loaded again, so data derived from it knows to rebuild
+	// even if the new copy landed at the old address
+	unsigned int GetLoadCount(Handle handle) const
+	{
+		return m_Assets[handle].loads;
+	}
+
+	// blocks until the asset (and for clips, its model) is resident; used for the minimal startup set.
+	// a clip is only wanted along with its model, so the model is requested as well
+	void WaitUntilResident(Handle handle)
+	{
+		Request(handle);
+		if (m_Assets[handle].kind == ANIMATION)
+			Request(m_Assets[handle].owner);
+		while (!IsResident(handle))
+		{
+			Update(m_LastViewer, 0.0f);
+			if (!IsResident(handle))
+			{
+				std::unique_lock<std::mutex> lock(m_QueueMutex);
+				m_DoneCondition.wait_for(lock, std::chrono::milliseconds(5));
+			}
+		}
+	}
+
+	// call once per frame on the GL thread with the seconds since the last call; recorded and
+	// replayed runs pass their tick length, so eviction follows the same clock on every run
+	void Update(const glm::vec3& viewer, float dt)
+	{
+		m_Clock += dt;
+		m_LastViewer = viewer;
+		Pump();
+	}
+
+	// blocks until everything currently wanted is resident. recorded and replayed runs call it
+	// after Update so that load times never change what the simulation sees
+	void Settle()
+	{
+		for (;;)
+		{
+			bool pending = false;
+			for (size_t i = 0; i < m_Assets.size(); i++)
+				if (m_Assets[i].wanted && m_Assets[i].state != RESIDENT)
+					pending = true;
+			if (!pending)
+				return;
+
+			std::unique_lock<std::mutex> lock(m_QueueMutex);
+			if (m_Completed.empty())
+				m_DoneCondition.wait_for(lock, std::chrono::milliseconds(5));
+			lock.unlock();
+			Pump();
+		}
+	}
+
+	const Stats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+private:
+	void Pump()
+	{
+		const glm::vec3& viewer = m_LastViewer;
+
+		// work out what is wanted: models by proximity, clips along with their model.
+		// clips are registered after their model, so the owner's flag is already up to date
+		for (Handle i = 0; i < (Handle)m_Assets.size(); i++)
+		{
+			Asset& asset = m_Assets[i];
+			if (asset.kind == MODEL)
+			{
+				asset.priority = glm::length(viewer - asset.anchor);
+				asset.wanted = asset.requested || asset.priority < asset.radius;
+				if (asset.wanted && asset.state == UNLOADED)
+					Enqueue(i);
+			}
+			else
+			{
+				const Asset& owner = m_Assets[asset.owner];
+				asset.priority = owner.priority;
+				asset.wanted = (!asset.onDemand || asset.requested) && owner.wanted;
+				if (asset.wanted && asset.state == UNLOADED && owner.state == RESIDENT)
+					Enqueue(i);
+			}
+		}
+
+		// collect finished I/O
+		{
+			std::lock_guard<std::mutex> lock(m_QueueMutex);
+			while (!m_Completed.empty())
+			{
+				m_Ready.push_back(std::move(m_Completed.front()));
+				m_Completed.pop_front();
+			}
+		}
+
+		// finish loads on this thread; model uploads are capped to one per frame to avoid hitches
+		bool uploadedModel = false;
+		for (auto it = m_Ready.begin(); it != m_Ready.end();)
+		{
+			Asset& asset = m_Assets[it->handle];
+			if (asset.kind == MODEL)
+			{
+				if (uploadedModel)
+				{
+					++it;
+					continue;
+				}
+				auto start = std::chrono::high_resolution_clock::now();
+				asset.model = ResourceCache::Get().AcquireModel(*it->model);
+				auto end = std::chrono::high_resolution_clock::now();
+				m_Stats.lastLoadMs = std::chrono::duration<float, std::milli>(end - start).count();
+				uploadedModel = true;
+			}
+			else
+			{
+				asset.animation = std::move(it->animation);
+				asset.bytes = it->bytes;
+				m_ClipBytes += asset.bytes;
+			}
+			asset.state = RESIDENT;
+			asset.lastUsed = m_Clock;
+			asset.loads++;
+			m_Stats.loads++;
+			it = m_Ready.erase(it);
+		}
+
+		UpdateResidentBytes();
+		Evict();
+
+		m_Stats.pending = 0;
+		for (size_t i = 0; i < m_Assets.size(); i++)
+			if (m_Assets[i].state == QUEUED)
+				m_Stats.pending++;
+	}
+
+	enum AssetKind { MODEL, ANIMATION };
+	enum AssetState { UNLOADED, QUEUED, RESIDENT };
+
+	struct Asset
+	{
+		AssetKind kind = MODEL;
+		AssetState state = UNLOADED;
+		std::string path;
+		Handle owner = InvalidHandle;
+		glm::vec3 anchor = glm::vec3(0.0f);
+		float radius = 0.0f;
+		bool onDemand = false;
+		bool requested = false;
+		bool pinned = false;
+		bool wanted = false;
+		float priority = 0.0f;
+		double lastUsed = 0.0;            // streamer clock, seconds
+		unsigned int loads = 0;
+		size_t bytes = 0;                 // clips; models are counted by the cache
+		std::shared_ptr<CachedModel> model;
+		std::unique_ptr<AnimationData> animation;
+	};
+
+	struct Job
+	{
+		Handle handle;
+		AssetKind kind;
+		std::string path;
+		float priority;
+	};
+
+	struct Result
+	{
+		Handle handle;
+		std::unique_ptr<ModelData> model;
+		std::unique_ptr<AnimationData> animation;
+		size_t bytes;
+	};
+
+	// assets untouched for this long may be evicted
+	static constexpr double EVICT_GRACE_SECONDS = 2.0;
+
+	void Enqueue(Handle handle)
+	{
+		Asset& asset = m_Assets[handle];
+		asset.state = QUEUED;
+
+		Job job;
+		job.handle = handle;
+		job.kind = asset.kind;
+		job.path = asset.path;
+		job.priority = asset.priority;
+		{
+			std::lock_guard<std::mutex> lock(m_QueueMutex);
+			m_Jobs.push_back(job);
+		}
+		m_QueueCondition.notify_one();
+	}
+
+	void StopThread()
+	{
+		if (!m_Thread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(m_QueueMutex);
+			m_Quit = true;
+		}
+		m_QueueCondition.notify_all();
+		m_Thread.join();
+	}
+
+	void IoThread()
+	{
+		for (;;)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(m_QueueMutex);
+				m_QueueCondition.wait(lock, [this] { return m_Quit || !m_Jobs.empty(); });
+				if (m_Quit)
+					return;
+				// nearest first
+				auto next = std::min_element(m_Jobs.begin(), m_Jobs.end(),
+					[](const Job& a, const Job& b) { return a.priority < b.priority; });
+				job = *next;
+				m_Jobs.erase(next);
+			}
+
+			Result result;
+			result.handle = job.handle;
+			result.bytes = 0;
+			if (job.kind == MODEL)
+			{
+				// everything but the upload: the assimp import and the texture decoding.
+				// a file assimp can't read leaves the data empty and uploads as an empty model
+				result.model.reset(new ModelData());
+				ResourceCache::Get().LoadModelData(job.path, *result.model);
+			}
+			else
+			{
+				// a clip that can't be read stays resident as nullptr, so it isn't retried every frame
+				result.animation.reset(new AnimationData());
+				if (!result.animation->Load(job.path))
+					result.animation.reset();
+				std::ifstream file(job.path, std::ios::binary | std::ios::ate);
+				result.bytes = file ? (size_t)file.tellg() : 0;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_QueueMutex);
+				m_Completed.push_back(std::move(result));
+			}
+			m_DoneCondition.notify_all();
+		}
+	}
+
+	// models through the cache, where a texture or mesh shared by several models is counted once
+	void UpdateResidentBytes()
+	{
+		m_Stats.residentBytes = ResourceCache::Get().GetResidentBytes() + m_ClipBytes;
+	}
+
+	bool Evictable(Handle handle) const
+	{
+		const Asset& asset = m_Assets[handle];
+		if (asset.state != RESIDENT || asset.pinned || asset.wanted || asset.lastUsed + EVICT_GRACE_SECONDS > m_Clock)
+			return false;
+		// a model stays while any of its clips is loaded or on its way, since they are bound to its bones
+		if (asset.kind == MODEL)
+		{
+			for (size_t i = 0; i < m_Assets.size(); i++)
+				if (m_Assets[i].owner == handle && m_Assets[i].state != UNLOADED)
+					return false;
+			for (size_t i = 0; i < m_Ready.size(); i++)
+				if (m_Assets[m_Ready[i].handle].owner == handle)
+					return false;
+		}
+		return true;
+	}
+
+	void Evict()
+	{
+		if (m_EvictionsHeld)
+			return;
+		while (m_Stats.residentBytes > m_Stats.budgetBytes)
+		{
+			Handle victim = InvalidHandle;
+			for (Handle i = 0; i < (Handle)m_Assets.size(); i++)
+				if (Evictable(i) && (victim == InvalidHandle || m_Assets[i].lastUsed < m_Assets[victim].lastUsed))
+					victim = i;
+			if (victim == InvalidHandle)
+				return;
+
+			Asset& asset = m_Assets[victim];
+			asset.model.reset();
+			asset.animation.reset();
+			asset.state = UNLOADED;
+			asset.requested = false;
+			m_ClipBytes -= asset.bytes;
+			m_Stats.evictions++;
+			asset.bytes = 0;
+			UpdateResidentBytes();
+		}
+	}
+
+	std::vector<Asset> m_Assets;
+	std::deque<Result> m_Ready;
+	double m_Clock = 0.0;
+	bool m_EvictionsHeld = false;
+	size_t m_ClipBytes = 0;
+	glm::vec3 m_LastViewer = glm::vec3(0.0f);
+	Stats m_Stats;
+
+	std::thread m_Thread;
+	std::mutex m_QueueMutex;
+	std::condition_variable m_QueueCondition;
+	std::condition_variable m_DoneCondition;
+	std::deque<Job> m_Jobs;
+	std::deque<Result> m_Completed;
+	bool m_Quit = false;
+};
+
+#endif
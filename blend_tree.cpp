@@ -0,0 +1,190 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "blend_tree.h"
+
+#include <algorithm>
+
+unsigned int Skeleton::AddJoint(const std::string& name, int parent, const glm::mat4& transform, int bone, const glm::mat4& offset)
+{
+	names.push_back(name);
+	parents.push_back(parent);
+	rest.push_back(decomposeJoint(transform));
+	bones.push_back(bone);
+	offsets.push_back(offset);
+	if (bone >= 0)
+		paletteSize = std::max(paletteSize, (unsigned int)bone + 1);
+	return (unsigned int)names.size() - 1;
+}
+
+int Skeleton::Find(const std::string& name) const
+{
+	for (size_t i = 0; i < names.size(); i++)
+		if (names[i] == name)
+			return (int)i;
+	return -1;
+}
+
+BoneMask BoneMask::Branch(const Skeleton& skeleton, const std::string& root)
+{
+	BoneMask mask;
+	mask.weights.assign(skeleton.Count(), 0.0f);
+	int first = skeleton.Find(root);
+	if (first < 0)
+		return mask;
+	mask.weights[first] = 1.0f;
+	// parents come first, so one pass reaches the whole branch
+	for (unsigned int j = first + 1; j < skeleton.Count(); j++)
+		if (skeleton.parents[j] >= 0 && mask.weights[skeleton.parents[j]] > 0.0f)
+			mask.weights[j] = 1.0f;
+	return mask;
+}
+
+unsigned int PoseCache::Acquire(PoseClip* clip, float time, unsigned int jointCount)
+{
+	Key key = { clip, time };
+	auto found = m_Lookup.find(key);
+	if (found != m_Lookup.end())
+		return found->second;
+
+	if (m_Used == m_Entries.size())
+		m_Entries.emplace_back();
+	Entry& entry = m_Entries[m_Used];
+	entry.clip = clip;
+	entry.time = time;
+	entry.poses.resize(jointCount);
+	entry.state.assign(jointCount, UNSAMPLED);
+	m_Lookup.emplace(key, m_Used);
+	return m_Used++;
+}
+
+unsigned int BlendTree::AddLayer(const BoneMask* mask, float weight)
+{
+	if (m_LayerCount == MAX_LAYERS)
+		return m_LayerCount - 1;
+	Layer& layer = m_Layers[m_LayerCount];
+	layer = Layer();
+	layer.mask = mask;
+	layer.weight = glm::clamp(weight, 0.0f, 1.0f);
+	return m_LayerCount++;
+}
+
+void BlendTree::AddClip(unsigned int layer, PoseClip* clip, float time, float weight)
+{
+	if (!clip || weight <= 0.0f || layer >= m_LayerCount || m_ClipCount == MAX_CLIPS)
+		return;
+	Clip& c = m_Clips[m_ClipCount++];
+	c.clip = clip;
+	c.time = time;
+	c.weight = weight;
+	c.layer = layer;
+	m_Layers[layer].clipWeight += weight;
+}
+
+void BlendTree::AddBlendSpace(unsigned int layer, const BlendSpacePoint* points, unsigned int count, float parameter, float phase, float weight)
+{
+	if (count == 0)
+		return;
+	unsigned int upper = 0;
+	while (upper < count && points[upper].position < parameter)
+		upper++;
+	if (upper == 0 || upper == count)
+	{
+		const BlendSpacePoint& end = points[upper == 0 ? 0 : count - 1];
+		AddClip(layer, end.clip, phase * end.clip->GetDuration(), weight);
+		return;
+	}
+	const BlendSpacePoint& a = points[upper - 1];
+	const BlendSpacePoint& b = points[upper];
+	float t = (parameter - a.position) / std::max(b.position - a.position, 1e-6f);
+	AddClip(layer, a.clip, phase * a.clip->GetDuration(), weight * (1.0f - t));
+	AddClip(layer, b.clip, phase * b.clip->GetDuration(), weight * t);
+}
+
+void BlendTree::Evaluate(const Skeleton& skeleton, PoseCache& cache, std::vector<glm::mat4>& palette)
+{
+	unsigned int jointCount = skeleton.Count();
+	palette.assign(skeleton.paletteSize, glm::mat4(1.0f));
+	m_Globals.resize(jointCount);
+	for (unsigned int c = 0; c < m_ClipCount; c++)
+		if (m_Layers[m_Clips[c].layer].weight > 0.0f)
+			m_Clips[c].entry = cache.Acquire(m_Clips[c].clip, m_Clips[c].time, jointCount);
+
+	for (unsigned int j = 0; j < jointCount; j++)
+	{
+		// what each layer gets here, from the top down: a layer takes its share of
+		// whatever the layers above left over
+		float share[MAX_LAYERS];
+		float left = 1.0f;
+		for (unsigned int l = m_LayerCount; l-- > 0;)
+		{
+			const Layer& layer = m_Layers[l];
+			float owned = l == 0 ? 1.0f : layer.weight * (layer.mask ? layer.mask->weights[j] : 1.0f);
+			share[l] = layer.clipWeight > 0.0f ? left * owned / layer.clipWeight : 0.0f;
+			if (layer.clipWeight > 0.0f)
+				left *= 1.0f - owned;
+		}
+
+		const JointPose& rest = skeleton.rest[j];
+		glm::vec3 translation(0.0f), scale(0.0f);
+		glm::quat rotation(0.0f, 0.0f, 0.0f, 0.0f);
+		float total = 0.0f;
+		for (unsigned int c = 0; c < m_ClipCount; c++)
+		{
+			const Clip& clip = m_Clips[c];
+			float w = share[clip.layer] * clip.weight;
+			if (w <= 0.0f)
+				continue;
+			const JointPose* sampled = cache.Sample(clip.entry, j);
+			const JointPose& pose = sampled ? *sampled : rest;
+			// nlerp: keep every rotation in the first one's hemisphere
+			float sign = total > 0.0f && glm::dot(rotation, pose.rotation) < 0.0f ? -1.0f : 1.0f;
+			translation += pose.translation * w;
+			scale += pose.scale * w;
+			rotation += pose.rotation * (w * sign);
+			total += w;
+		}
+
+		JointPose local = rest;
+		if (total > 0.0f)
+		{
+			local.translation = translation / total;
+			local.scale = scale / total;
+			local.rotation = glm::normalize(rotation);
+		}
+		int parent = skeleton.parents[j];
+		m_Globals[j] = parent >= 0 ? m_Globals[parent] * composeJoint(local) : composeJoint(local);
+		if (skeleton.bones[j] >= 0)
+			palette[skeleton.bones[j]] = m_Globals[j] * skeleton.offsets[j];
+	}
+}
+
+void evaluateChainedBlend(const Skeleton& skeleton, PoseClip* const* clips, const float* times, const float* factors,
+	const BoneMask* const* masks, unsigned int count, std::vector<JointPose>& pose, std::vector<glm::mat4>& globals, std::vector<glm::mat4>& palette)
+{
+	unsigned int jointCount = skeleton.Count();
+	pose.assign(skeleton.rest.begin(), skeleton.rest.end());
+	for (unsigned int c = 0; c < count; c++)
+	{
+		for (unsigned int j = 0; j < jointCount; j++)
+		{
+			JointPose sampled = skeleton.rest[j];
+			clips[c]->Sample(j, times[c], sampled);
+			float t = c == 0 ? 1.0f : factors[c] * (masks[c] ? masks[c]->weights[j] : 1.0f);
+			JointPose& p = pose[j];
+			p.translation = glm::mix(p.translation, sampled.translation, t);
+			p.scale = glm::mix(p.scale, sampled.scale, t);
+			p.rotation = glm::slerp(p.rotation, sampled.rotation, t);
+		}
+	}
+
+	palette.assign(skeleton.paletteSize, glm::mat4(1.0f));
+	globals.resize(jointCount);
+	for (unsigned int j = 0; j < jointCount; j++)
+	{
+		int parent = skeleton.parents[j];
+		globals[j] = parent >= 0 ? globals[parent] * composeJoint(pose[j]) : composeJoint(pose[j]);
+		if (skeleton.bones[j] >= 0)
+			palette[skeleton.bones[j]] = globals[j] * skeleton.offsets[j];
+	}
+}
@@ -0,0 +1,249 @@
+#ifndef BLEND_TREE_H
+#define BLEND_TREE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// pose evaluation for any number of clips at once, without GL.
+//
+// a BlendTree is a base layer over the whole skeleton plus override layers on top (an upper
+// body swing while the legs walk), each holding weighted clips (a walk/run blend space).
+// the tree is flattened per joint into the weight every clip gets there, so the skeleton is
+// walked once whatever the number of clips, and clips, layers and masked-off joints that end
+// up with no weight are never sampled. clip samples go through a PoseCache that lives for a
+// tick, so characters on the same clip at the same time share them
+
+struct JointPose
+{
+	glm::vec3 translation = glm::vec3(0.0f);
+	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// translation * rotation * scale, as clips store them; no shear
+inline JointPose decomposeJoint(const glm::mat4& transform)
+{
+	JointPose pose;
+	pose.translation = glm::vec3(transform[3]);
+	pose.scale = glm::vec3(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])));
+	glm::mat3 rotation(glm::vec3(transform[0]) / pose.scale.x, glm::vec3(transform[1]) / pose.scale.y, glm::vec3(transform[2]) / pose.scale.z);
+	pose.rotation = glm::normalize(glm::quat_cast(rotation));
+	return pose;
+}
+
+inline glm::mat4 composeJoint(const JointPose& pose)
+{
+	glm::mat3 rotation = glm::mat3_cast(pose.rotation);
+	glm::mat4 transform(1.0f);
+	transform[0] = glm::vec4(rotation[0] * pose.scale.x, 0.0f);
+	transform[1] = glm::vec4(rotation[1] * pose.scale.y, 0.0f);
+	transform[2] = glm::vec4(rotation[2] * pose.scale.z, 0.0f);
+	transform[3] = glm::vec4(pose.translation, 1.0f);
+	return transform;
+}
+
+// joints parent first, each with its rest pose and, if it deforms the mesh, its palette slot
+struct Skeleton
+{
+	std::vector<std::string> names;
+	std::vector<int> parents;           // -1 for the root
+	std::vector<JointPose> rest;        // node transforms, for joints a clip doesn't animate
+	std::vector<int> bones;             // palette index, -1 for plain nodes
+	std::vector<glm::mat4> offsets;     // mesh space to bone space, for joints with a bone
+	unsigned int paletteSize = 0;
+
+	unsigned int AddJoint(const std::string& name, int parent, const glm::mat4& transform, int bone, const glm::mat4& offset);
+
+	int Find(const std::string& name) const;
+
+	unsigned int Count() const
+	{
+		return (unsigned int)names.size();
+	}
+};
+
+// how much a layer owns each joint; what it doesn't own is left to the layers below
+struct BoneMask
+{
+	std::vector<float> weights;
+
+	// the named joint and everything below it, e.g. the spine for an upper body layer
+	static BoneMask Branch(const Skeleton& skeleton, const std::string& root);
+};
+
+// a clip as the evaluator sees it, bound to one skeleton
+class PoseClip
+{
+public:
+	virtual ~PoseClip() {}
+
+	// local pose of a joint at time, in clip ticks; false if the clip doesn't animate the joint
+	virtual bool Sample(unsigned int joint, float time, JointPose& pose) = 0;
+	virtual float GetDuration() = 0;
+};
+
+// clip samples for one tick, shared by everything evaluated on the same clip at the same time.
+// entries fill in joint by joint as evaluations ask, so a masked layer samples only its joints
+class PoseCache
+{
+public:
+	struct Stats
+	{
+		unsigned long long requests = 0;   // joint samples asked for
+		unsigned long long samples = 0;    // taken from a clip; the rest were reused
+	};
+
+	// forgets the last tick's samples but keeps their memory
+	void Begin()
+	{
+		m_Lookup.clear();
+		m_Used = 0;
+	}
+
+	unsigned int Acquire(PoseClip* clip, float time, unsigned int jointCount);
+
+	// NULL where the clip doesn't animate the joint
+	const JointPose* Sample(unsigned int entry, unsigned int joint)
+	{
+		Entry& e = m_Entries[entry];
+		m_Stats.requests++;
+		if (e.state[joint] == UNSAMPLED)
+		{
+			e.state[joint] = e.clip->Sample(joint, e.time, e.poses[joint]) ? ANIMATED : STATIC;
+			m_Stats.samples++;
+		}
+		return e.state[joint] == ANIMATED ? &e.poses[joint] : nullptr;
+	}
+
+	const Stats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+	void ResetStats()
+	{
+		m_Stats = Stats();
+	}
+
+private:
+	enum JointState : uint8_t { UNSAMPLED, ANIMATED, STATIC };
+
+	struct Key
+	{
+		PoseClip* clip;
+		float time;
+
+		bool operator==(const Key& other) const
+		{
+			return clip == other.clip && memcmp(&time, &other.time, sizeof(time)) == 0;
+		}
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			uint32_t bits;
+			memcpy(&bits, &key.time, sizeof(bits));
+			return std::hash<const void*>()(key.clip) ^ ((size_t)bits * 0x9e3779b97f4a7c15ull);
+		}
+	};
+
+	struct Entry
+	{
+		PoseClip* clip = nullptr;
+		float time = 0.0f;
+		std::vector<JointPose> poses;
+		std::vector<uint8_t> state;
+	};
+
+	std::unordered_map<Key, unsigned int, KeyHash> m_Lookup;
+	std::vector<Entry> m_Entries;
+	unsigned int m_Used = 0;
+	Stats m_Stats;
+};
+
+// one point of a 1D blend space
+struct BlendSpacePoint
+{
+	PoseClip* clip;
+	float position;
+};
+
+class BlendTree
+{
+public:
+	static const unsigned int MAX_LAYERS = 4;
+	static const unsigned int MAX_CLIPS = 8;    // over all layers
+
+	BlendTree()
+	{
+		Clear();
+	}
+
+	// back to an empty base layer
+	void Clear()
+	{
+		m_LayerCount = 1;
+		m_Layers[0] = Layer();
+		m_ClipCount = 0;
+	}
+
+	// layers stack in the order they are added, over the base layer 0; a NULL mask covers
+	// the whole skeleton. returns the layer to add clips to
+	unsigned int AddLayer(const BoneMask* mask, float weight);
+
+	// weights within a layer are relative to each other
+	void AddClip(unsigned int layer, PoseClip* clip, float time, float weight);
+
+	// points sorted by position; the two around the parameter share the weight. they all play
+	// at the same phase (0..1 of their duration), so cycles of different lengths stay in step
+	void AddBlendSpace(unsigned int layer, const BlendSpacePoint* points, unsigned int count, float parameter, float phase, float weight = 1.0f);
+
+	// writes the skinning matrices, palette slots without a joint stay identity
+	void Evaluate(const Skeleton& skeleton, PoseCache& cache, std::vector<glm::mat4>& palette);
+
+	// the evaluated joints in model space, from the last Evaluate
+	const std::vector<glm::mat4>& GetGlobals() const
+	{
+		return m_Globals;
+	}
+
+private:
+	struct Layer
+	{
+		const BoneMask* mask = nullptr;
+		float weight = 1.0f;
+		float clipWeight = 0.0f;
+	};
+
+	struct Clip
+	{
+		PoseClip* clip;
+		float time;
+		float weight;
+		unsigned int layer;
+		unsigned int entry;
+	};
+
+	Layer m_Layers[MAX_LAYERS];
+	unsigned int m_LayerCount = 1;
+	Clip m_Clips[MAX_CLIPS];
+	unsigned int m_ClipCount = 0;
+	std::vector<glm::mat4> m_Globals;
+};
+
+// what the Animator's two-way blend does, chained: the first clip is sampled in full, then each
+// stage samples the next clip in full and blends it over the result so far by its factor (times
+// its mask, if any). nothing is skipped or shared; kept as the baseline for benchmarks
+void evaluateChainedBlend(const Skeleton& skeleton, PoseClip* const* clips, const float* times, const float* factors,
+	const BoneMask* const* masks, unsigned int count, std::vector<JointPose>& pose, std::vector<glm::mat4>& globals, std::vector<glm::mat4>& palette);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef CHARACTER_H
+#define CHARACTER_H
+
+#include <cstdint>
+#include <vector>
+
+class AnimationData;
+
+enum AnimState {
+	IDLE = 1,
+	IDLE_ATTACK,
+	ATTACK_IDLE,
+	IDLE_KICK,
+	KICK_IDLE,
+	IDLE_WALK,
+	WALK_IDLE,
+	WALK,
+	IDLE_WALKBACK,
+	WALKBACK_IDLE,
+	WALKBACK,
+	IDLE_TURN,
+	TURN_IDLE,
+	IDLE_DYING,
+	IDLE_TALK,
+	TALK,
+	TALK_IDLE
+};
+
+enum CharacterKind {
+	KNIGHT = 0,
+	MONSTER,
+	MERCHANT,
+	CHARACTER_KIND_COUNT
+};
+
+// every character kind maps its clips onto the same slots; unused slots stay empty
+enum ClipId {
+	CLIP_IDLE = 0,
+	CLIP_WALK,
+	CLIP_WALKBACK,
+	CLIP_RUN,
+	CLIP_ATTACK,
+	CLIP_KICK,
+	CLIP_TURN,
+	CLIP_DYING,
+	CLIP_TALK,
+	CLIP_COUNT,
+	CLIP_NONE = 0xff
+};
+
+// what a controller (keyboard, AI, network) asks a character to do this tick
+enum Intent {
+	INTENT_FORWARD = 1 << 0,
+	INTENT_BACK = 1 << 1,
+	INTENT_TURN_LEFT = 1 << 2,
+	INTENT_TURN_RIGHT = 1 << 3,
+	INTENT_ATTACK = 1 << 4,
+	INTENT_KICK = 1 << 5,
+	INTENT_TURN_AROUND = 1 << 6,
+	INTENT_DIE = 1 << 7,
+	INTENT_TALK = 1 << 8,
+	INTENT_RUN = 1 << 9
+};
+
+enum Team {
+	TEAM_NONE = 0,
+	TEAM_PLAYER,
+	TEAM_MONSTER,
+	TEAM_COUNT
+};
+
+const float BLEND_DONE = 0.9f;
+
+// points of a clip the rules react to, instead of polling its time
+enum AnimEventType {
+	EVENT_HITBOX_ON = 0,   // the swing's hit window opens
+	EVENT_HITBOX_OFF,
+	EVENT_FOOTSTEP,
+	EVENT_BLEND_OUT        // a one-shot clip may hand over to idle
+};
+
+struct AnimEvent
+{
+	float time;            // in clip time
+	AnimEventType type;
+};
+
+struct ClipInfo
+{
+	AnimationData* animation = nullptr; // NULL while streaming, and always on the server
+	float duration = 0.0f;
+	float ticksPerSecond = 0.0f;
+	bool loaded = false;            // timings are valid and the state machine may use the clip
+	std::vector<AnimEvent> events;  // sorted by time
+};
+
+// per-kind constants shared by every entity of that kind
+struct CharacterDef
+{
+	float blendRate = 0.0f;        // of a blend between clips, per second
+	float dyingBlendRate = 0.0f;
+	float modelYaw = 0.0f;     // extra rotation so the model faces along its forward vector
+	float attackDamage = 0.0f;
+	float kickDamage = 0.0f;
+	Team team = TEAM_NONE;
+	const char* hitboxBone = nullptr; // the attack hitbox follows this bone wherever poses are evaluated
+	const char* upperBodyJoint = nullptr; // root of the upper body layer; swings while walking need one
+	ClipInfo clips[CLIP_COUNT];
+	bool active = false;       // assets resident and in range; inactive kinds are frozen
+
+	bool HasClip(uint8_t clip) const
+	{
+		return clip != CLIP_NONE && clips[clip].loaded;
+	}
+};
+
+#endif
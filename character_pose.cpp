@@ -0,0 +1,62 @@
+#include <glm/glm.hpp>
+
+#include "character_pose.h"
+
+#include <algorithm>
+
+void CharacterRig::Bind(const CharacterDef& def)
+{
+	upperBody = def.upperBodyJoint ? BoneMask::Branch(skeleton, def.upperBodyJoint) : BoneMask();
+	hitJoint = def.hitboxBone ? skeleton.Find(def.hitboxBone) : -1;
+}
+
+void addStateClip(BlendTree& tree, const CharacterRig& rig, uint8_t clip, float time, float weight, float runWeight)
+{
+	PoseClip* pose = rig.clips[clip];
+	PoseClip* run = rig.clips[CLIP_RUN];
+	if (!pose)
+		return;
+	if (clip == CLIP_WALK && run && runWeight > 0.0f)
+	{
+		const BlendSpacePoint points[2] = { { pose, 0.0f }, { run, 1.0f } };
+		float phase = time / std::max(pose->GetDuration(), 1e-6f);
+		tree.AddBlendSpace(0, points, 2, runWeight, phase, weight);
+	}
+	else
+		tree.AddClip(0, pose, time, weight);
+}
+
+void updatePoses(World& world, const CharacterRig* rigs, BlendTree& tree, PoseCache& cache, std::vector<std::vector<glm::mat4> >& poses)
+{
+	cache.Begin();
+	for (unsigned int i = 0; i < world.Count(); i++)
+	{
+		int k = world.kind[i];
+		const CharacterDef& def = characterDefs[k];
+		const CharacterRig& rig = rigs[k];
+		const AnimStateComponent& a = world.anim[i];
+		if (!world.Has(i, COMPONENT_ANIMATOR) || !world.health[i].alive || !def.active || !def.HasClip(a.clip0) || !rig.clips[a.clip0])
+			continue;
+
+		float runWeight = runBlendWeight(world.transform[i]);
+		tree.Clear();
+		addStateClip(tree, rig, a.clip0, a.time0, 1.0f - a.blend, runWeight);
+		if (def.HasClip(a.clip1))
+			addStateClip(tree, rig, a.clip1, a.time1, a.blend, runWeight);
+		if (def.HasClip(a.layerClip) && rig.clips[a.layerClip])
+		{
+			unsigned int layer = tree.AddLayer(&rig.upperBody, a.layerWeight);
+			tree.AddClip(layer, rig.clips[a.layerClip], a.layerTime, 1.0f);
+		}
+
+		uint32_t index = world.EntityAt(i).index;
+		if (index >= poses.size())
+			poses.resize(index + 1);
+		tree.Evaluate(rig.skeleton, cache, poses[index]);
+
+		HitboxComponent& b = world.hitbox[i];
+		b.attached = world.Has(i, COMPONENT_HITBOX) && rig.hitJoint >= 0;
+		if (b.attached)
+			b.bone = glm::vec3(tree.GetGlobals()[rig.hitJoint][3]);
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef CHARACTER_POSE_H
+#define CHARACTER_POSE_H
+
+#include <glm/glm.hpp>
+
+#include "blend_tree.h"
+#include "character.h"
+#include "ecs.h"
+#include "simulation.h"
+
+#include <cstdint>
+#include <vector>
+
+// characters' poses from their anim state, through the blend tree. like the rules this needs no
+// GL; the client feeds it streamed Animations and the tests and benchmarks keyframe clips
+
+// a kind's skeleton and clips as the blend tree sees them; clips are owned by whoever loads them
+struct CharacterRig
+{
+	Skeleton skeleton;
+	BoneMask upperBody;                 // empty when the kind has no upper body joint
+	int hitJoint = -1;                  // the kind's hitbox bone, -1 without one
+	PoseClip* clips[CLIP_COUNT] = {};
+
+	// the joints the def names, once the skeleton is built
+	void Bind(const CharacterDef& def);
+};
+
+// a clip of the state machine into the base layer; the walk turns into the run as the
+// character speeds up, both at the walk's phase
+void addStateClip(BlendTree& tree, const CharacterRig& rig, uint8_t clip, float time, float weight, float runWeight);
+
+// pose evaluation only; the clip times are owned by updateAnimStates. each character is one
+// blend tree: the state's clips at the base and the upper body layer over them. palettes are
+// kept by entity index, and the hitbox of the next tick's hits goes on the hit bone as posed
+void updatePoses(World& world, const CharacterRig* rigs, BlendTree& tree, PoseCache& cache, std::vector<std::vector<glm::mat4> >& poses);
+
+#endif
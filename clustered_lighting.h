@@ -0,0 +1,387 @@
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLUSTER_CULL_SSE 1
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// a point light in world space; color already includes the intensity
+struct PointLight
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+};
+
+// clustered forward shading. the view volume is cut into TILES_X * TILES_Y screen tiles and
+// SLICES depth slices (froxels); every frame the CPU works out which lights touch which
+// froxel and uploads the lists as texture buffers, so a fragment only loops over the lights
+// of its own froxel. culling runs four lights at a time and narrows down in steps: all lights
+// against each depth slice, the slice's candidates against each row of tiles in it, and the
+// row's candidates against each froxel of the row.
+//
+// the game camera is orthographic, so froxels are boxes and the slices are spaced linearly
+// in view depth. the froxel bounds come from the inverse projection and are only rebuilt
+// when the projection changes.
+//
+// shader side, see lit.fs: clusterCells holds (first index, count) per froxel, clusterIndices
+// the light indices of all froxels back to back, clusterLights two texels per light,
+// (position, radius) and (color, 0)
+class ClusteredLighting
+{
+public:
+	static const int TILES_X = 16;
+	static const int TILES_Y = 9;
+	static const int SLICES = 24;
+	static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+	static const unsigned int MAX_LIGHTS = 4096;
+	static const unsigned int MAX_LIGHTS_PER_CLUSTER = 64;   // further lights are dropped
+
+	// texture units, clear of the few a Model's meshes bind from unit 0
+	static const int FIRST_TEXTURE_UNIT = 8;
+
+	struct Stats
+	{
+		unsigned int lights = 0;
+		unsigned int visibleLights = 0;      // touching at least one froxel
+		unsigned int indices = 0;
+		unsigned int maxPerCluster = 0;
+		unsigned int overflowingClusters = 0;
+		float assignUs = 0.0f;
+	};
+
+	~ClusteredLighting()
+	{
+		Release();
+	}
+
+	void Init()
+	{
+		glGenBuffers(BUFFER_COUNT, m_Buffers);
+		glGenTextures(BUFFER_COUNT, m_Textures);
+		const GLenum formats[BUFFER_COUNT] = { GL_RG32UI, GL_R16UI, GL_RGBA32F };
+		for (int i = 0; i < BUFFER_COUNT; i++)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, m_Buffers[i]);
+			glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+			glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_Buffers[i]);
+		}
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void Release()
+	{
+		if (!m_Buffers[0])
+			return;
+		glDeleteTextures(BUFFER_COUNT, m_Textures);
+		glDeleteBuffers(BUFFER_COUNT, m_Buffers);
+		for (int i = 0; i < BUFFER_COUNT; i++)
+			m_Buffers[i] = m_Textures[i] = 0;
+	}
+
+	// builds the light lists of every froxel; CPU only
+	void Assign(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		if (projection != m_Projection)
+			BuildFroxels(projection);
+
+		// lights to view space, struct of arrays for the 4-wide tests
+		unsigned int count = (unsigned int)std::min(lights.size(), (size_t)MAX_LIGHTS);
+		m_All.Clear();
+		for (unsigned int i = 0; i < count; i++)
+		{
+			glm::vec3 p = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+			m_All.Push(p, lights[i].radius * lights[i].radius, (uint16_t)i);
+		}
+		m_All.Pad();
+
+		m_Cells.resize(CLUSTER_COUNT * 2);
+		m_Indices.clear();
+		m_Stats = Stats();
+		m_Stats.lights = count;
+		m_Seen.assign(count, 0);
+		for (int z = 0; z < SLICES; z++)
+		{
+			// lights reaching into this slice anywhere on screen
+			m_Hits.clear();
+			Cull(m_All, m_SliceMin[z], m_SliceMax[z], m_Hits);
+			m_Slice.Clear();
+			for (size_t i = 0; i < m_Hits.size(); i++)
+				m_Slice.Push(m_All, m_Hits[i]);
+			m_Slice.Pad();
+
+			for (int y = 0; y < TILES_Y; y++)
+			{
+				int row = z * TILES_Y + y;
+				m_Hits.clear();
+				if (m_Slice.count > 0)
+					Cull(m_Slice, m_RowMin[row], m_RowMax[row], m_Hits);
+				m_Row.Clear();
+				for (size_t i = 0; i < m_Hits.size(); i++)
+					m_Row.Push(m_Slice, m_Hits[i]);
+				m_Row.Pad();
+
+				for (int c = row * TILES_X; c < (row + 1) * TILES_X; c++)
+				{
+					m_Hits.clear();
+					if (m_Row.count > 0)
+						Cull(m_Row, m_ClusterMin[c], m_ClusterMax[c], m_Hits);
+					unsigned int hits = (unsigned int)m_Hits.size();
+					if (hits > MAX_LIGHTS_PER_CLUSTER)
+					{
+						m_Stats.overflowingClusters++;
+						hits = MAX_LIGHTS_PER_CLUSTER;
+					}
+					m_Cells[c * 2] = (uint32_t)m_Indices.size();
+					m_Cells[c * 2 + 1] = hits;
+					for (unsigned int i = 0; i < hits; i++)
+					{
+						uint16_t light = m_Row.index[m_Hits[i]];
+						m_Indices.push_back(light);
+						m_Seen[light] = 1;
+					}
+					m_Stats.maxPerCluster = std::max(m_Stats.maxPerCluster, hits);
+				}
+			}
+		}
+		for (unsigned int i = 0; i < count; i++)
+			m_Stats.visibleLights += m_Seen[i];
+		m_Stats.indices = (unsigned int)m_Indices.size();
+
+		// light data for the shaders
+		m_LightData.resize(count * 8);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const PointLight& light = lights[i];
+			float* texels = &m_LightData[i * 8];
+			texels[0] = light.position.x;
+			texels[1] = light.position.y;
+			texels[2] = light.position.z;
+			texels[3] = light.radius;
+			texels[4] = light.color.x;
+			texels[5] = light.color.y;
+			texels[6] = light.color.z;
+			texels[7] = 0.0f;
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		m_Stats.assignUs = std::chrono::duration<float, std::micro>(end - start).count();
+	}
+
+	// streams the lists to the texture buffers, orphaning last frame's storage
+	void Upload()
+	{
+		if (m_Indices.empty())
+			m_Indices.push_back(0);
+		if (m_LightData.empty())
+			m_LightData.assign(8, 0.0f);
+		UploadBuffer(CELLS, m_Cells.data(), m_Cells.size() * sizeof(uint32_t));
+		UploadBuffer(INDICES, m_Indices.data(), m_Indices.size() * sizeof(uint16_t));
+		UploadBuffer(LIGHTS, m_LightData.data(), m_LightData.size() * sizeof(float));
+	}
+
+	// binds the buffers and sets the cluster uniforms; the shader must be in use
+	void Bind(const Shader& shader, const glm::vec2& viewportSize, const glm::vec3& ambient)
+	{
+		const char* samplers[BUFFER_COUNT] = { "clusterCells", "clusterIndices", "clusterLights" };
+		for (int i = 0; i < BUFFER_COUNT; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + i);
+			glBindTexture(GL_TEXTURE_BUFFER, m_Textures[i]);
+			shader.setInt(samplers[i], FIRST_TEXTURE_UNIT + i);
+		}
+		glActiveTexture(GL_TEXTURE0);
+		glUniform3ui(glGetUniformLocation(shader.ID, "clusterCount"), TILES_X, TILES_Y, SLICES);
+		shader.setVec2("clusterViewport", viewportSize);
+		shader.setVec2("clusterDepthRange", glm::vec2(m_Near, m_Far));
+		shader.setVec3("ambientLight", ambient);
+		shader.setInt("clusterLighting", 1);
+	}
+
+	const Stats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+private:
+	enum Buffer { CELLS, INDICES, LIGHTS, BUFFER_COUNT };
+
+	// view-space spheres as struct of arrays, padded to a multiple of 4 with spheres that hit nothing
+	struct Spheres
+	{
+		std::vector<float> x, y, z, radius2;
+		std::vector<uint16_t> index;
+		size_t count = 0;
+
+		void Clear()
+		{
+			x.clear();
+			y.clear();
+			z.clear();
+			radius2.clear();
+			index.clear();
+			count = 0;
+		}
+
+		void Push(const glm::vec3& position, float r2, uint16_t light)
+		{
+			x.push_back(position.x);
+			y.push_back(position.y);
+			z.push_back(position.z);
+			radius2.push_back(r2);
+			index.push_back(light);
+			count++;
+		}
+
+		void Push(const Spheres& from, uint32_t i)
+		{
+			Push(glm::vec3(from.x[i], from.y[i], from.z[i]), from.radius2[i], from.index[i]);
+		}
+
+		void Pad()
+		{
+			while (x.size() % 4 != 0)
+			{
+				Push(glm::vec3(0.0f), -1.0f, 0);
+				count--;
+			}
+		}
+	};
+
+	// positions in `spheres` of those touching the box: squared distance from the center to
+	// the box, clamped per axis, against the squared radius
+	static void Cull(const Spheres& spheres, const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<uint32_t>& hits)
+	{
+#ifdef CLUSTER_CULL_SSE
+		const __m128 minX = _mm_set1_ps(boxMin.x), minY = _mm_set1_ps(boxMin.y), minZ = _mm_set1_ps(boxMin.z);
+		const __m128 maxX = _mm_set1_ps(boxMax.x), maxY = _mm_set1_ps(boxMax.y), maxZ = _mm_set1_ps(boxMax.z);
+		for (size_t i = 0; i < spheres.x.size(); i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&spheres.x[i]);
+			__m128 y = _mm_loadu_ps(&spheres.y[i]);
+			__m128 z = _mm_loadu_ps(&spheres.z[i]);
+			__m128 dx = _mm_sub_ps(_mm_min_ps(_mm_max_ps(x, minX), maxX), x);
+			__m128 dy = _mm_sub_ps(_mm_min_ps(_mm_max_ps(y, minY), maxY), y);
+			__m128 dz = _mm_sub_ps(_mm_min_ps(_mm_max_ps(z, minZ), maxZ), z);
+			__m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_loadu_ps(&spheres.radius2[i])));
+			for (int lane = 0; mask != 0; lane++, mask >>= 1)
+				if (mask & 1)
+					hits.push_back((uint32_t)(i + lane));
+		}
+#else
+		for (size_t i = 0; i < spheres.x.size(); i++)
+		{
+			float dx = std::min(std::max(spheres.x[i], boxMin.x), boxMax.x) - spheres.x[i];
+			float dy = std::min(std::max(spheres.y[i], boxMin.y), boxMax.y) - spheres.y[i];
+			float dz = std::min(std::max(spheres.z[i], boxMin.z), boxMax.z) - spheres.z[i];
+			if (dx * dx + dy * dy + dz * dz <= spheres.radius2[i])
+				hits.push_back((uint32_t)i);
+		}
+#endif
+	}
+
+	// view-space bounds of every froxel. each froxel corner is found on the ray through its
+	// screen position, at the slice's view depth, which holds for perspective projections too
+	void BuildFroxels(const glm::mat4& projection)
+	{
+		m_Projection = projection;
+		glm::mat4 inverse = glm::inverse(projection);
+		auto unproject = [&](float x, float y, float z) {
+			glm::vec4 p = inverse * glm::vec4(x, y, z, 1.0f);
+			return glm::vec3(p) / p.w;
+		};
+		// view depth is -z in view space
+		m_Near = -unproject(0.0f, 0.0f, -1.0f).z;
+		m_Far = -unproject(0.0f, 0.0f, 1.0f).z;
+
+		m_ClusterMin.resize(CLUSTER_COUNT);
+		m_ClusterMax.resize(CLUSTER_COUNT);
+		for (int z = 0; z < SLICES; z++)
+		{
+			float depth0 = m_Near + (m_Far - m_Near) * z / SLICES;
+			float depth1 = m_Near + (m_Far - m_Near) * (z + 1) / SLICES;
+			m_SliceMin[z] = glm::vec3(1e30f);
+			m_SliceMax[z] = glm::vec3(-1e30f);
+			for (int y = 0; y < TILES_Y; y++)
+			{
+				int row = z * TILES_Y + y;
+				m_RowMin[row] = glm::vec3(1e30f);
+				m_RowMax[row] = glm::vec3(-1e30f);
+				for (int x = 0; x < TILES_X; x++)
+				{
+					glm::vec3 boxMin = glm::vec3(1e30f);
+					glm::vec3 boxMax = glm::vec3(-1e30f);
+					for (int corner = 0; corner < 4; corner++)
+					{
+						float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / TILES_X;
+						float ndcY = -1.0f + 2.0f * (y + (corner >> 1)) / TILES_Y;
+						glm::vec3 nearPoint = unproject(ndcX, ndcY, -1.0f);
+						glm::vec3 farPoint = unproject(ndcX, ndcY, 1.0f);
+						float span = -farPoint.z + nearPoint.z;
+						for (int end = 0; end < 2; end++)
+						{
+							float t = span != 0.0f ? ((end ? depth1 : depth0) + nearPoint.z) / span : 0.0f;
+							glm::vec3 p = glm::mix(nearPoint, farPoint, t);
+							boxMin = glm::min(boxMin, p);
+							boxMax = glm::max(boxMax, p);
+						}
+					}
+					int c = row * TILES_X + x;
+					m_ClusterMin[c] = boxMin;
+					m_ClusterMax[c] = boxMax;
+					m_RowMin[row] = glm::min(m_RowMin[row], boxMin);
+					m_RowMax[row] = glm::max(m_RowMax[row], boxMax);
+				}
+				m_SliceMin[z] = glm::min(m_SliceMin[z], m_RowMin[row]);
+				m_SliceMax[z] = glm::max(m_SliceMax[z], m_RowMax[row]);
+			}
+		}
+	}
+
+	void UploadBuffer(Buffer buffer, const void* data, size_t size)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, m_Buffers[buffer]);
+		glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	unsigned int m_Buffers[BUFFER_COUNT] = {};
+	unsigned int m_Textures[BUFFER_COUNT] = {};
+
+	glm::mat4 m_Projection = glm::mat4(0.0f);
+	float m_Near = 0.0f;
+	float m_Far = 1.0f;
+	std::vector<glm::vec3> m_ClusterMin;
+	std::vector<glm::vec3> m_ClusterMax;
+	glm::vec3 m_RowMin[SLICES * TILES_Y];
+	glm::vec3 m_RowMax[SLICES * TILES_Y];
+	glm::vec3 m_SliceMin[SLICES];
+	glm::vec3 m_SliceMax[SLICES];
+
+	Spheres m_All;
+	Spheres m_Slice;
+	Spheres m_Row;
+	std::vector<uint32_t> m_Hits;
+	std::vector<uint8_t> m_Seen;
+	std::vector<uint32_t> m_Cells;
+	std::vector<uint16_t> m_Indices;
+	std::vector<float> m_LightData;
+	Stats m_Stats;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include "blend_tree.h"
+#include "character_pose.h"
+#include "headless_arena.h"
+#include "keyframe_clip.h"
+#include "simulation.h"
+
+#include <vector>
+
+// benchmarks of the core library on the headless arena's made up assets. results go to JSON with
+//
+//   core_bench --benchmark_out=core_bench.json --benchmark_out_format=json
+//
+// so runs can be compared over time (e.g. with benchmark's tools/compare.py)
+
+const float BENCH_DT = 1.0f / 60.0f;
+
+// the kinds, timings and rigs every benchmark runs on, built once
+static HeadlessRigs& benchRigs()
+{
+	static HeadlessRigs* rigs = nullptr;
+	if (!rigs)
+	{
+		initCharacterDefs();
+		loadHeadlessClipTimings();
+		rigs = new HeadlessRigs();
+		rigs->Build();
+	}
+	return *rigs;
+}
+
+static NavGrid& benchGrid()
+{
+	static NavGrid* grid = nullptr;
+	if (!grid)
+	{
+		grid = new NavGrid();
+		buildHeadlessNavGrid(*grid);
+	}
+	return *grid;
+}
+
+// times spread over the clip, so the key scans don't always stop at the same place
+static float benchTime(PoseClip* clip, unsigned int i)
+{
+	return clip->GetDuration() * ((i * 37u) % 101u) / 101.0f;
+}
+
+// sampling every joint of a clip, the work of Bone::Update over a skeleton
+static void BM_BoneSampling(benchmark::State& state)
+{
+	CharacterRig& rig = benchRigs().rigs[KNIGHT];
+	PoseClip* clip = rig.clips[state.range(0)];
+	JointPose pose;
+	unsigned int i = 0;
+	for (auto _ : state)
+	{
+		float time = benchTime(clip, i++);
+		for (unsigned int j = 0; j < rig.skeleton.Count(); j++)
+		{
+			clip->Sample(j, time, pose);
+			benchmark::DoNotOptimize(pose);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * rig.skeleton.Count());
+}
+BENCHMARK(BM_BoneSampling)->Arg(CLIP_RUN)->Arg(CLIP_IDLE)->ArgName("clip");
+
+// one character's pose, what Animator::UpdateAnimation cost per character before the blend
+// tree replaced it: 0 is a single clip as the Animator played, 1 a walk/run blend and 2 the
+// blend with a swing on the upper body. a fresh cache each time, so nothing is shared
+static void BM_PoseUpdate(benchmark::State& state)
+{
+	CharacterRig& rig = benchRigs().rigs[KNIGHT];
+	BlendTree tree;
+	PoseCache cache;
+	std::vector<glm::mat4> palette;
+	const BlendSpacePoint points[2] = { { rig.clips[CLIP_WALK], 0.0f }, { rig.clips[CLIP_RUN], 1.0f } };
+	unsigned int i = 0;
+	for (auto _ : state)
+	{
+		float phase = benchTime(rig.clips[CLIP_WALK], i++) / rig.clips[CLIP_WALK]->GetDuration();
+		cache.Begin();
+		tree.Clear();
+		if (state.range(0) == 0)
+			tree.AddClip(0, rig.clips[CLIP_WALK], phase * rig.clips[CLIP_WALK]->GetDuration(), 1.0f);
+		else
+			tree.AddBlendSpace(0, points, 2, 0.4f, phase);
+		if (state.range(0) == 2)
+		{
+			unsigned int layer = tree.AddLayer(&rig.upperBody, 0.7f);
+			tree.AddClip(layer, rig.clips[CLIP_ATTACK], phase * rig.clips[CLIP_ATTACK]->GetDuration(), 1.0f);
+		}
+		tree.Evaluate(rig.skeleton, cache, palette);
+		benchmark::DoNotOptimize(palette.data());
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PoseUpdate)->DenseRange(0, 2)->ArgName("layers");
+
+// the same poses as chained two-way blends, the baseline the blend tree is held against
+static void BM_ChainedPoseUpdate(benchmark::State& state)
+{
+	CharacterRig& rig = benchRigs().rigs[KNIGHT];
+	std::vector<JointPose> pose;
+	std::vector<glm::mat4> globals, palette;
+	PoseClip* clips[3] = { rig.clips[CLIP_WALK], rig.clips[CLIP_RUN], rig.clips[CLIP_ATTACK] };
+	const float factors[3] = { 1.0f, 0.4f, 0.7f };
+	const BoneMask* masks[3] = { nullptr, nullptr, &rig.upperBody };
+	unsigned int count = (unsigned int)state.range(0) + 1;
+	unsigned int i = 0;
+	for (auto _ : state)
+	{
+		float phase = benchTime(clips[0], i++) / clips[0]->GetDuration();
+		const float times[3] = { phase * clips[0]->GetDuration(), phase * clips[1]->GetDuration(), phase * clips[2]->GetDuration() };
+		evaluateChainedBlend(rig.skeleton, clips, times, factors, masks, count, pose, globals, palette);
+		benchmark::DoNotOptimize(palette.data());
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ChainedPoseUpdate)->DenseRange(0, 2)->ArgName("layers");
+
+// a knight's hitbox against a grid of targets around it, some in reach and most not
+static void BM_CheckAABBCollision(benchmark::State& state)
+{
+	const unsigned int TARGETS = 256;
+	std::vector<glm::vec3> targets(TARGETS);
+	for (unsigned int i = 0; i < TARGETS; i++)
+		targets[i] = glm::vec3((float)(i % 16) * 0.5f - 4.0f, 1.1f, (float)(i / 16) * 0.5f - 4.0f);
+	glm::mat4 attacker = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.1f, 0.0f));
+	attacker = glm::rotate(attacker, glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::vec3 size(HITBOX_WIDTH, HITBOX_HEIGHT, HITBOX_DEPTH);
+	unsigned int hits = 0;
+	for (auto _ : state)
+		for (unsigned int i = 0; i < TARGETS; i++)
+			hits += checkAABBCollision(attacker, HITBOX_OFFSET, size, targets[i], 1.0f);
+	benchmark::DoNotOptimize(hits);
+	state.SetItemsProcessed(state.iterations() * TARGETS);
+}
+BENCHMARK(BM_CheckAABBCollision);
+
+// a whole tick of an arena with this many monsters and the server's scripted player: AI,
+// movement, anim states, hits, every pose and the snapshot. the fight starts over once decided
+static void BM_FullTick(benchmark::State& state)
+{
+	HeadlessRigs& rigs = benchRigs();
+	HeadlessArena arena;
+	arena.flowField.Init(&benchGrid());
+	resetArena(arena, (unsigned int)state.range(0));
+	BlendTree tree;
+	PoseCache cache;
+	for (auto _ : state)
+		tickHeadlessArena(arena, rigs.rigs, tree, cache, botIntent(arena.tick), BENCH_DT);
+	state.SetItemsProcessed(state.iterations());
+	state.counters["characters"] = (double)arena.world.Count();
+}
+BENCHMARK(BM_FullTick)->Arg(3)->Arg(8)->Arg(64)->ArgName("monsters");
+
+BENCHMARK_MAIN();
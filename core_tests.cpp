@@ -0,0 +1,705 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <gtest/gtest.h>
+
+#include "blend_tree.h"
+#include "character_pose.h"
+#include "headless_arena.h"
+#include "keyframe_clip.h"
+#include "simulation.h"
+#include "snapshot.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+// unit tests of the core library: keyframe sampling, the blend tree, hit detection, clip events,
+// the state machine, flow fields and snapshots, all on the headless arena's made up assets
+
+const float EPSILON = 1e-4f;
+
+// every test starts from the same character kinds, timings and rigs
+class CoreTest : public ::testing::Test
+{
+protected:
+	void SetUp() override
+	{
+		characterDefs[KNIGHT] = CharacterDef();
+		characterDefs[MONSTER] = CharacterDef();
+		characterDefs[MERCHANT] = CharacterDef();
+		initCharacterDefs();
+		loadHeadlessClipTimings();
+		rigs.Build();
+	}
+
+	// steps one character's state machine and clip times only
+	void StepAnim(World& world, unsigned int ticks, float dt = 1.0f / 60.0f)
+	{
+		for (unsigned int t = 0; t < ticks; t++)
+			updateAnimStates(world, dt);
+	}
+
+	HeadlessRigs rigs;
+};
+
+static KeyframeClip makeTwoKeyClip()
+{
+	KeyframeClip clip(2, 1.0f);
+	KeyframeTrack& track = clip.GetTrack(0);
+	track.positions.push_back({ 0.0f, glm::vec3(0.0f) });
+	track.positions.push_back({ 1.0f, glm::vec3(2.0f, 0.0f, 0.0f) });
+	track.rotations.push_back({ 0.0f, glm::quat(1.0f, 0.0f, 0.0f, 0.0f) });
+	track.rotations.push_back({ 1.0f, glm::angleAxis(glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)) });
+	track.scales.push_back({ 0.0f, glm::vec3(1.0f) });
+	return clip;
+}
+
+TEST(KeyframeClipTest, InterpolatesBetweenKeys)
+{
+	KeyframeClip clip = makeTwoKeyClip();
+	JointPose pose;
+	ASSERT_TRUE(clip.Sample(0, 0.5f, pose));
+	EXPECT_NEAR(pose.translation.x, 1.0f, EPSILON);
+	EXPECT_NEAR(pose.scale.y, 1.0f, EPSILON);
+	glm::quat half = glm::angleAxis(glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	EXPECT_NEAR(std::fabs(glm::dot(pose.rotation, half)), 1.0f, EPSILON);
+}
+
+TEST(KeyframeClipTest, HoldsLastKeyPastTheEnd)
+{
+	KeyframeClip clip = makeTwoKeyClip();
+	JointPose pose;
+	ASSERT_TRUE(clip.Sample(0, 5.0f, pose));
+	EXPECT_NEAR(pose.translation.x, 2.0f, EPSILON);
+}
+
+TEST(KeyframeClipTest, EmptyTrackIsNotAnimated)
+{
+	KeyframeClip clip = makeTwoKeyClip();
+	JointPose pose;
+	EXPECT_FALSE(clip.Sample(1, 0.5f, pose));
+}
+
+TEST(CollisionTest, HitsTargetInFront)
+{
+	glm::mat4 attacker = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.1f, 0.0f));
+	EXPECT_TRUE(checkAABBCollision(attacker, HITBOX_OFFSET, glm::vec3(1.0f, 1.5f, 1.0f), glm::vec3(0.0f, 1.1f, 1.5f), 1.0f));
+}
+
+TEST(CollisionTest, MissesTargetOutOfReach)
+{
+	glm::mat4 attacker = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.1f, 0.0f));
+	EXPECT_FALSE(checkAABBCollision(attacker, HITBOX_OFFSET, glm::vec3(1.0f, 1.5f, 1.0f), glm::vec3(0.0f, 1.1f, 5.0f), 1.0f));
+}
+
+TEST(CollisionTest, FollowsAttackerRotation)
+{
+	// turned around, the box is behind where it was
+	glm::mat4 attacker = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.1f, 0.0f));
+	attacker = glm::rotate(attacker, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::vec3 size(0.5f);
+	EXPECT_FALSE(checkAABBCollision(attacker, glm::vec3(0.0f, 0.0f, 2.0f), size, glm::vec3(0.0f, 1.1f, 2.0f), 0.5f));
+	EXPECT_TRUE(checkAABBCollision(attacker, glm::vec3(0.0f, 0.0f, 2.0f), size, glm::vec3(0.0f, 1.1f, -2.0f), 0.5f));
+}
+
+TEST_F(CoreTest, HeadlessSkeletonNamesTheDefsJoints)
+{
+	const CharacterRig& knight = rigs.rigs[KNIGHT];
+	EXPECT_EQ(knight.skeleton.Count(), 65u);
+	EXPECT_EQ(knight.skeleton.paletteSize, 65u);
+	EXPECT_GE(knight.hitJoint, 0);
+	ASSERT_EQ(knight.upperBody.weights.size(), 65u);
+	EXPECT_EQ(knight.upperBody.weights[knight.skeleton.Find("mixamorig:Hips")], 0.0f);
+	EXPECT_EQ(knight.upperBody.weights[knight.hitJoint], 1.0f);
+	for (unsigned int j = 0; j < knight.skeleton.Count(); j++)
+		EXPECT_LT(knight.skeleton.parents[j], (int)j);
+}
+
+TEST_F(CoreTest, SingleClipPoseMatchesItsSamples)
+{
+	const CharacterRig& rig = rigs.rigs[KNIGHT];
+	BlendTree tree;
+	PoseCache cache;
+	std::vector<glm::mat4> palette;
+	cache.Begin();
+	tree.AddClip(0, rig.clips[CLIP_WALK], 0.7f, 1.0f);
+	tree.Evaluate(rig.skeleton, cache, palette);
+	ASSERT_EQ(palette.size(), rig.skeleton.paletteSize);
+
+	// rebuild the globals from the clip alone
+	std::vector<glm::mat4> globals(rig.skeleton.Count());
+	for (unsigned int j = 0; j < rig.skeleton.Count(); j++)
+	{
+		JointPose pose = rig.skeleton.rest[j];
+		rig.clips[CLIP_WALK]->Sample(j, 0.7f, pose);
+		int parent = rig.skeleton.parents[j];
+		globals[j] = parent >= 0 ? globals[parent] * composeJoint(pose) : composeJoint(pose);
+		for (int c = 0; c < 4; c++)
+			for (int r = 0; r < 4; r++)
+				EXPECT_NEAR(tree.GetGlobals()[j][c][r], globals[j][c][r], EPSILON);
+	}
+}
+
+TEST_F(CoreTest, ZeroWeightLayerIsNotSampled)
+{
+	const CharacterRig& rig = rigs.rigs[KNIGHT];
+	BlendTree tree;
+	PoseCache cache;
+	std::vector<glm::mat4> palette;
+	cache.Begin();
+	tree.AddClip(0, rig.clips[CLIP_WALK], 0.3f, 1.0f);
+	unsigned int layer = tree.AddLayer(&rig.upperBody, 0.0f);
+	tree.AddClip(layer, rig.clips[CLIP_ATTACK], 0.3f, 1.0f);
+	tree.Evaluate(rig.skeleton, cache, palette);
+	EXPECT_EQ(cache.GetStats().samples, (unsigned long long)rig.skeleton.Count());
+}
+
+TEST_F(CoreTest, FullLayerOnlySamplesItsMask)
+{
+	const CharacterRig& rig = rigs.rigs[KNIGHT];
+	unsigned int upper = 0;
+	for (float w : rig.upperBody.weights)
+		upper += w > 0.0f;
+	BlendTree tree;
+	PoseCache cache;
+	std::vector<glm::mat4> palette;
+	cache.Begin();
+	tree.AddClip(0, rig.clips[CLIP_WALK], 0.3f, 1.0f);
+	unsigned int layer = tree.AddLayer(&rig.upperBody, 1.0f);
+	tree.AddClip(layer, rig.clips[CLIP_ATTACK], 0.3f, 1.0f);
+	tree.Evaluate(rig.skeleton, cache, palette);
+	// the walk only below the spine, the swing only above it
+	EXPECT_EQ(cache.GetStats().samples, (unsigned long long)rig.skeleton.Count());
+	EXPECT_GT(upper, 0u);
+	EXPECT_LT(upper, rig.skeleton.Count());
+}
+
+TEST_F(CoreTest, CacheSharesSamplesWithinATick)
+{
+	const CharacterRig& rig = rigs.rigs[KNIGHT];
+	BlendTree tree;
+	PoseCache cache;
+	std::vector<glm::mat4> first, second;
+	cache.Begin();
+	tree.AddClip(0, rig.clips[CLIP_IDLE], 1.25f, 1.0f);
+	tree.Evaluate(rig.skeleton, cache, first);
+	tree.Evaluate(rig.skeleton, cache, second);
+	EXPECT_EQ(cache.GetStats().requests, 2ull * rig.skeleton.Count());
+	EXPECT_EQ(cache.GetStats().samples, (unsigned long long)rig.skeleton.Count());
+	EXPECT_TRUE(first == second);
+
+	cache.Begin();
+	tree.Evaluate(rig.skeleton, cache, second);
+	EXPECT_EQ(cache.GetStats().samples, 2ull * rig.skeleton.Count());
+}
+
+TEST_F(CoreTest, TwoClipBlendMatchesChainedNlerpHalfway)
+{
+	const CharacterRig& rig = rigs.rigs[KNIGHT];
+	BlendTree tree;
+	PoseCache cache;
+	std::vector<glm::mat4> palette;
+	cache.Begin();
+	tree.AddClip(0, rig.clips[CLIP_IDLE], 0.5f, 0.5f);
+	tree.AddClip(0, rig.clips[CLIP_WALK], 0.5f, 0.5f);
+	tree.Evaluate(rig.skeleton, cache, palette);
+
+	PoseClip* clips[2] = { rig.clips[CLIP_IDLE], rig.clips[CLIP_WALK] };
+	const float times[2] = { 0.5f, 0.5f };
+	const float factors[2] = { 1.0f, 0.5f };
+	const BoneMask* masks[2] = { nullptr, nullptr };
+	std::vector<JointPose> pose;
+	std::vector<glm::mat4> globals, chained;
+	evaluateChainedBlend(rig.skeleton, clips, times, factors, masks, 2, pose, globals, chained);
+	// at an even split slerp and nlerp agree
+	ASSERT_EQ(palette.size(), chained.size());
+	for (size_t i = 0; i < palette.size(); i++)
+		for (int c = 0; c < 4; c++)
+			for (int r = 0; r < 4; r++)
+				EXPECT_NEAR(palette[i][c][r], chained[i][c][r], 1e-3f);
+}
+
+TEST_F(CoreTest, AttackEventsOpenAndCloseTheHitWindow)
+{
+	World world;
+	unsigned int slot = world.Slot(spawnCharacter(world, KNIGHT, PLAYER_START, 0.0f));
+	AnimStateComponent& a = world.anim[slot];
+	a.clip0 = CLIP_ATTACK;
+	a.time0 = 0.0f;
+	const CharacterDef& def = characterDefs[KNIGHT];
+	advanceClipTime(world, slot, 0, def, 0.35f);
+	EXPECT_EQ(world.hitbox[slot].window, 1);
+	advanceClipTime(world, slot, 0, def, 0.3f);
+	EXPECT_EQ(world.hitbox[slot].window, 0);
+}
+
+TEST_F(CoreTest, WrappingStepFiresEventsAcrossTheLoop)
+{
+	World world;
+	unsigned int slot = world.Slot(spawnCharacter(world, KNIGHT, PLAYER_START, 0.0f));
+	AnimStateComponent& a = world.anim[slot];
+	a.clip0 = CLIP_ATTACK;
+	a.time0 = 0.9f;
+	// past the end and round to the window again
+	advanceClipTime(world, slot, 0, characterDefs[KNIGHT], 0.5f);
+	EXPECT_EQ(world.hitbox[slot].window, 1);
+	EXPECT_NEAR(a.time0, 0.37f, EPSILON);
+}
+
+TEST_F(CoreTest, WalkIntentBlendsIntoWalk)
+{
+	World world;
+	unsigned int slot = world.Slot(spawnCharacter(world, KNIGHT, PLAYER_START, 0.0f));
+	world.anim[slot].intent = INTENT_FORWARD;
+	updateAnimStates(world, 1.0f / 60.0f);
+	EXPECT_EQ(world.anim[slot].state, IDLE_WALK);
+	StepAnim(world, 60);
+	EXPECT_EQ(world.anim[slot].state, WALK);
+	EXPECT_EQ(world.anim[slot].clip0, CLIP_WALK);
+}
+
+TEST_F(CoreTest, BlendTakesTheSameTimeAtAnyTickRate)
+{
+	float seconds[2];
+	const float rates[2] = { 30.0f, 240.0f };
+	for (int r = 0; r < 2; r++)
+	{
+		World world;
+		unsigned int slot = world.Slot(spawnCharacter(world, KNIGHT, PLAYER_START, 0.0f));
+		world.anim[slot].intent = INTENT_FORWARD;
+		seconds[r] = 0.0f;
+		for (int t = 0; t < 1000 && world.anim[slot].state != WALK; t++)
+		{
+			updateAnimStates(world, 1.0f / rates[r]);
+			seconds[r] += 1.0f / rates[r];
+		}
+		EXPECT_EQ(world.anim[slot].state, WALK);
+	}
+	// apart from the tick that starts the blend and the last one overshooting it
+	EXPECT_NEAR(seconds[0], seconds[1], 2.0f / rates[0]);
+}
+
+TEST_F(CoreTest, RunIntentSpeedsUpTowardsTheRun)
+{
+	World world;
+	unsigned int slot = world.Slot(spawnCharacter(world, KNIGHT, PLAYER_START, 0.0f));
+	world.anim[slot].intent = INTENT_FORWARD | INTENT_RUN;
+	glm::vec3 start = world.transform[slot].position;
+	for (int t = 0; t < 120; t++)
+		updateMovement(world, 1.0f / 60.0f);
+	const TransformComponent& tr = world.transform[slot];
+	EXPECT_NEAR(tr.speed, PLAYER_MOVE_SPEED * RUN_SPEED_FACTOR, EPSILON);
+	EXPECT_NEAR(runBlendWeight(tr), 1.0f, EPSILON);
+	// the knight faces down -z at yaw 0
+	EXPECT_LT(tr.position.z, start.z);
+}
+
+TEST(FlowFieldTest, PublishesWhileTheGoalKeepsMoving)
+{
+	NavGrid grid;
+	buildHeadlessNavGrid(grid);
+	FlowField field;
+	field.Init(&grid);
+	// a new cell every update and far too small a budget to finish a search in one
+	bool published = false;
+	for (int t = 0; t < 400 && !published; t++)
+	{
+		field.SetGoal(PLAYER_START + glm::vec3(0.0f, 0.0f, -NAV_CELL_SIZE * (t % 8)));
+		published = field.Update(64);
+	}
+	EXPECT_TRUE(published);
+	EXPECT_GT(field.Sample(ENEMY_START).z, 0.0f);
+}
+
+TEST_F(CoreTest, PosesAttachTheHitboxToTheHand)
+{
+	World world;
+	Entity knight = spawnCharacter(world, KNIGHT, PLAYER_START, 0.0f);
+	BlendTree tree;
+	PoseCache cache;
+	std::vector<std::vector<glm::mat4> > poses;
+	updatePoses(world, rigs.rigs, tree, cache, poses);
+	unsigned int slot = world.Slot(knight);
+	ASSERT_GT(poses.size(), (size_t)knight.index);
+	EXPECT_EQ(poses[knight.index].size(), rigs.rigs[KNIGHT].skeleton.paletteSize);
+	EXPECT_EQ(world.hitbox[slot].attached, 1);
+	glm::vec3 hand = glm::vec3(tree.GetGlobals()[rigs.rigs[KNIGHT].hitJoint][3]);
+	EXPECT_NEAR(glm::length(hitboxCenter(world.hitbox[slot]) - hand), 0.0f, EPSILON);
+}
+
+TEST_F(CoreTest, SwingHitsOpponentsInReachOnce)
+{
+	World world;
+	Entity knight = spawnCharacter(world, KNIGHT, PLAYER_START, 0.0f);
+	unsigned int slot = world.Slot(knight);
+	glm::vec3 ahead = world.transform[slot].forward * 0.7f;
+	Entity ally = spawnCharacter(world, KNIGHT, PLAYER_START + ahead, 0.0f);
+	Entity near = spawnCharacter(world, MONSTER, PLAYER_START + ahead, 0.0f);
+	Entity far = spawnCharacter(world, MONSTER, PLAYER_START + ahead * 8.0f, 0.0f);
+	world.anim[slot].state = ATTACK_IDLE;
+	world.hitbox[slot].window = 1;
+
+	std::vector<CombatEvent> events;
+	updateHitboxes(world, events);
+	ASSERT_EQ(events.size(), 1u);
+	EXPECT_EQ(events[0].kind, MONSTER);
+	EXPECT_EQ(world.hitbox[slot].hitPerformed, 1);
+	EXPECT_LT(world.health[world.Slot(near)].health, world.health[world.Slot(far)].health);
+	EXPECT_EQ(world.health[world.Slot(ally)].health, world.health[slot].health);
+
+	// the window is still open, but the swing has landed
+	updateHitboxes(world, events);
+	EXPECT_EQ(events.size(), 1u);
+	EXPECT_EQ(world.hitbox[slot].active, 1);
+}
+
+TEST_F(CoreTest, MonstersReachAndHitTheStandingPlayer)
+{
+	NavGrid grid;
+	buildHeadlessNavGrid(grid);
+	HeadlessArena arena;
+	arena.flowField.Init(&grid);
+	resetArena(arena, 1);
+	BlendTree tree;
+	PoseCache cache;
+	bool hit = false;
+	for (int t = 0; t < 60 * 30 && !hit; t++)
+	{
+		tickHeadlessArena(arena, rigs.rigs, tree, cache, 0, 1.0f / 60.0f);
+		for (const CombatEvent& event : arena.events)
+			hit |= event.kind == KNIGHT;
+	}
+	EXPECT_TRUE(hit);
+}
+
+TEST_F(CoreTest, SnapshotRoundTripsTheArena)
+{
+	NavGrid grid;
+	buildHeadlessNavGrid(grid);
+	HeadlessArena arena;
+	arena.flowField.Init(&grid);
+	resetArena(arena, 3);
+	BlendTree tree;
+	PoseCache cache;
+	for (int t = 0; t < 200; t++)
+		tickHeadlessArena(arena, rigs.rigs, tree, cache, botIntent(t), 1.0f / 60.0f);
+
+	World restored;
+	SnapshotReader reader(arena.state.data(), arena.state.size());
+	ASSERT_TRUE(WorldSnapshot::Read(reader, restored));
+	std::vector<uint8_t> again;
+	SnapshotWriter writer(again);
+	WorldSnapshot::Write(writer, restored);
+	EXPECT_TRUE(again == arena.state);
+}
+
+// bytes that change from one seed to the next, as a tick's state does
+static std::vector<uint8_t> makeState(size_t size, uint32_t seed)
+{
+	std::vector<uint8_t> state(size);
+	uint32_t x = seed * 2654435761u + 1;
+	for (size_t i = 0; i < size; i++)
+	{
+		x = x * 1664525u + 1013904223u;
+		state[i] = (uint8_t)(x >> 24);
+	}
+	return state;
+}
+
+// the base with a few scattered bytes changed, most of it as it was
+static std::vector<uint8_t> changeState(const std::vector<uint8_t>& base, uint32_t seed)
+{
+	std::vector<uint8_t> state = base;
+	for (size_t i = seed % 7; i < state.size(); i += 23 + seed % 5)
+		state[i] ^= (uint8_t)(seed | 1);
+	return state;
+}
+
+static bool applyDelta(std::vector<uint8_t>& state, const std::vector<uint8_t>& delta)
+{
+	return SnapshotDelta::Apply(state, delta.data(), delta.size());
+}
+
+TEST(SnapshotDeltaTest, RoundTripsAndShrinksWhatDidNotChange)
+{
+	std::vector<uint8_t> base = makeState(1000, 1), target = changeState(base, 3), delta;
+	SnapshotDelta::Encode(base, target, delta);
+	EXPECT_LT(delta.size(), target.size() / 4);
+	std::vector<uint8_t> state = base;
+	ASSERT_TRUE(applyDelta(state, delta));
+	EXPECT_TRUE(state == target);
+
+	// nothing changed at all
+	SnapshotDelta::Encode(target, target, delta);
+	EXPECT_LT(delta.size(), 8u);
+	ASSERT_TRUE(applyDelta(state, delta));
+	EXPECT_TRUE(state == target);
+}
+
+TEST(SnapshotDeltaTest, RoundTripsBetweenDifferentLengths)
+{
+	std::vector<uint8_t> base = makeState(500, 1), delta;
+	std::vector<uint8_t> grown = changeState(base, 4), shrunk(base.begin(), base.begin() + 300);
+	std::vector<uint8_t> more = makeState(120, 9);
+	grown.insert(grown.end(), more.begin(), more.end());
+	shrunk[10] ^= 1;
+
+	const std::vector<uint8_t>* targets[3] = { &grown, &shrunk, &base };
+	const std::vector<uint8_t> none;
+	const std::vector<uint8_t>* bases[2] = { &base, &none };
+	for (const std::vector<uint8_t>* b : bases)
+		for (const std::vector<uint8_t>* target : targets)
+		{
+			SnapshotDelta::Encode(*b, *target, delta);
+			std::vector<uint8_t> state = *b;
+			ASSERT_TRUE(applyDelta(state, delta));
+			EXPECT_TRUE(state == *target);
+		}
+}
+
+TEST(SnapshotDeltaTest, OnlyHoldsAgainstItsOwnBase)
+{
+	// the bytes where the bases differ come out wrong, the rest as the target
+	std::vector<uint8_t> base = makeState(400, 1), other = changeState(base, 6), target = changeState(base, 2), delta;
+	SnapshotDelta::Encode(base, target, delta);
+	std::vector<uint8_t> state = other;
+	ASSERT_TRUE(applyDelta(state, delta));
+	ASSERT_EQ(state.size(), target.size());
+	for (size_t i = 0; i < state.size(); i++)
+		EXPECT_EQ(state[i] != target[i], base[i] != other[i]) << "byte " << i;
+}
+
+TEST(SnapshotDeltaTest, RejectsTruncatedAndTrailingData)
+{
+	std::vector<uint8_t> base = makeState(300, 1), target = changeState(base, 5), delta;
+	SnapshotDelta::Encode(base, target, delta);
+	for (size_t size = 0; size < delta.size(); size++)
+	{
+		std::vector<uint8_t> state = base;
+		EXPECT_FALSE(SnapshotDelta::Apply(state, delta.data(), size)) << "cut to " << size;
+	}
+	delta.push_back(0);
+	std::vector<uint8_t> state = base;
+	EXPECT_FALSE(applyDelta(state, delta));
+
+	// a literal run past the target's end
+	const uint8_t overrun[] = { 4, 2, 8, 1, 2, 3, 4, 5, 6, 7, 8 };
+	state = base;
+	EXPECT_FALSE(SnapshotDelta::Apply(state, overrun, sizeof(overrun)));
+}
+
+TEST(SnapshotDeltaTest, RejectsSizesNoStateCouldHave)
+{
+	// a few bytes off the network claiming a state of 4GB, and then of 2 billion entities
+	const uint8_t delta[] = { 0xff, 0xff, 0xff, 0xff, 0x0f, 0, 0 };
+	std::vector<uint8_t> state;
+	EXPECT_FALSE(SnapshotDelta::Apply(state, delta, sizeof(delta)));
+
+	std::vector<uint8_t> image;
+	SnapshotWriter writer(image);
+	writer.Write(0x7fffffffu);
+	writer.Write(0x7fffffffu);
+	World world;
+	SnapshotReader reader(image.data(), image.size());
+	EXPECT_FALSE(WorldSnapshot::Read(reader, world));
+	EXPECT_EQ(world.transform.size(), 0u);
+}
+
+TEST(SnapshotHistoryTest, RestoresBetweenKeyframesAndDropsTheFuture)
+{
+	SnapshotHistory history(64);
+	std::vector<std::vector<uint8_t> > saved;
+	saved.push_back(makeState(600, 1));
+	for (uint32_t t = 0; t < 40; t++)
+	{
+		if (t > 0)
+			saved.push_back(changeState(saved.back(), t));
+		history.Save(t, saved.back());
+	}
+
+	std::vector<uint8_t> state;
+	ASSERT_TRUE(history.Restore(SnapshotHistory::KEYFRAME_INTERVAL + 5, state));
+	EXPECT_TRUE(state == saved[SnapshotHistory::KEYFRAME_INTERVAL + 5]);
+	EXPECT_EQ(history.NewestTick(), SnapshotHistory::KEYFRAME_INTERVAL + 5);
+	EXPECT_FALSE(history.Restore(30, state));
+
+	// the history goes on from the restored tick with the new states
+	std::vector<uint8_t> next = changeState(saved[SnapshotHistory::KEYFRAME_INTERVAL + 5], 99);
+	history.Save(SnapshotHistory::KEYFRAME_INTERVAL + 6, next);
+	ASSERT_TRUE(history.Restore(SnapshotHistory::KEYFRAME_INTERVAL + 6, state));
+	EXPECT_TRUE(state == next);
+	ASSERT_TRUE(history.Restore(3, state));
+	EXPECT_TRUE(state == saved[3]);
+}
+
+TEST(SnapshotHistoryTest, RestoresEveryTickItStillHolds)
+{
+	const unsigned int CAPACITY = 20;
+	SnapshotHistory history(CAPACITY);
+	std::vector<std::vector<uint8_t> > saved;
+	saved.push_back(makeState(600, 1));
+	for (uint32_t t = 0; t < 50; t++)
+	{
+		if (t > 0)
+			saved.push_back(changeState(saved.back(), t));
+		history.Save(t, saved.back());
+	}
+	EXPECT_EQ(history.OldestTick(), 50 - CAPACITY);
+
+	std::vector<uint8_t> state;
+	EXPECT_FALSE(history.Restore(50 - CAPACITY - 1, state));
+	// newest first, as restoring drops what comes after
+	for (uint32_t t = 49; t >= 50 - CAPACITY; t--)
+	{
+		ASSERT_TRUE(history.Restore(t, state)) << "tick " << t;
+		EXPECT_TRUE(state == saved[t]) << "tick " << t;
+	}
+}
+
+TEST_F(CoreTest, SnapshotReadRejectsATamperedCheckpoint)
+{
+	World world;
+	spawnCharacter(world, KNIGHT, PLAYER_START, 0.0f);
+	Entity gone = spawnCharacter(world, MONSTER, ENEMY_START, 0.0f);
+	spawnCharacter(world, MONSTER, ENEMY_START + glm::vec3(2.0f, 0.0f, 0.0f), 0.0f);
+	std::vector<uint8_t> whole;
+	SnapshotWriter writer(whole);
+	WorldSnapshot::Write(writer, world);
+
+	// a despawned index keeps a stale slot past the end, which must still read back
+	world.Despawn(gone);
+	std::vector<uint8_t> despawned;
+	SnapshotWriter despawnedWriter(despawned);
+	WorldSnapshot::Write(despawnedWriter, world);
+	World restored;
+	SnapshotReader despawnedReader(despawned.data(), despawned.size());
+	ASSERT_TRUE(WorldSnapshot::Read(despawnedReader, restored));
+	EXPECT_FALSE(restored.IsValid(gone));
+
+	// three live entities and no free ones, so the entity tables end the image as
+	// slot to index, sparse, generation (4 + 12 bytes each) and no free indices (4)
+	const size_t kindAt = 8;
+	const size_t sparseAt = whole.size() - 4 - 16 - 16 + 4;
+	const size_t slotToIndexAt = sparseAt - 16;
+	const size_t tampered[3] = { kindAt, sparseAt, slotToIndexAt };
+	const char* path = "core_tests_tampered.snap";
+	for (size_t offset : tampered)
+	{
+		std::vector<uint8_t> image = whole, read;
+		image[offset] = 200;
+		uint32_t tick = 0;
+		ASSERT_TRUE(WriteSnapshotFile(path, 7, image));
+		ASSERT_TRUE(ReadSnapshotFile(path, tick, read));
+		World loaded;
+		SnapshotReader reader(read.data(), read.size());
+		EXPECT_FALSE(WorldSnapshot::Read(reader, loaded)) << "byte " << offset;
+	}
+	std::remove(path);
+}
+
+TEST(SnapshotFileTest, RejectsASizeThatDisagreesWithTheFile)
+{
+	const char* path = "core_tests_snapshot.snap";
+	std::vector<uint8_t> state(100, 7), read;
+	uint32_t tick = 0;
+	ASSERT_TRUE(WriteSnapshotFile(path, 42, state));
+	ASSERT_TRUE(ReadSnapshotFile(path, tick, read));
+	EXPECT_EQ(tick, 42u);
+	EXPECT_TRUE(read == state);
+
+	// a header claiming far more than follows it
+	std::vector<uint8_t> image;
+	EncodeSnapshotFile(42, state, image);
+	uint32_t huge = 0xfffffff0u;
+	memcpy(&image[12], &huge, sizeof(huge));
+	std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(image.data()), image.size());
+	EXPECT_FALSE(ReadSnapshotFile(path, tick, read));
+	std::remove(path);
+}
+
+TEST(FlowFieldTest, SnapshotResumesTheSearchInProgress)
+{
+	NavGrid grid;
+	buildHeadlessNavGrid(grid);
+	FlowField field, restored;
+	field.Init(&grid);
+	restored.Init(&grid);
+	field.SetGoal(PLAYER_START);
+	field.Update(64);
+	ASSERT_TRUE(field.Pending());
+
+	std::vector<uint8_t> state;
+	SnapshotWriter writer(state);
+	FlowFieldSnapshot::Write(writer, field);
+	SnapshotReader reader(state.data(), state.size());
+	ASSERT_TRUE(FlowFieldSnapshot::Read(reader, restored));
+
+	// both finish the same search the same way
+	while (field.Pending())
+		field.Update(64);
+	while (restored.Pending())
+		restored.Update(64);
+	for (int z = 0; z < grid.Height(); z++)
+		for (int x = 0; x < grid.Width(); x++)
+		{
+			glm::vec2 center = grid.CellCenter(x, z);
+			glm::vec3 position(center.x, PLAYER_START.y, center.y);
+			EXPECT_EQ(field.Sample(position), restored.Sample(position));
+		}
+}
+
+// a 10 by 10 floor of 1m cells split across z = 5 by a wall from x = 0 to the given end
+static void buildWalledGrid(NavGrid& grid, float wallEnd)
+{
+	grid.Init(glm::vec3(0.0f), glm::vec3(10.0f, 0.0f, 10.0f), 1.0f, 0.0f, NAV_AGENT_HEIGHT);
+	grid.AddTriangle(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(10.0f, 0.0f, 10.0f), glm::vec3(10.0f, 0.0f, 0.0f));
+	grid.AddTriangle(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(10.0f, 0.0f, 10.0f));
+	grid.AddTriangle(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(wallEnd, 0.0f, 5.0f), glm::vec3(wallEnd, 3.0f, 5.0f));
+	grid.AddTriangle(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(wallEnd, 3.0f, 5.0f), glm::vec3(0.0f, 3.0f, 5.0f));
+	grid.Finish();
+}
+
+TEST(FlowFieldTest, SteersAroundTheWallToTheGoal)
+{
+	NavGrid grid;
+	buildWalledGrid(grid, 7.0f);
+	ASSERT_FALSE(grid.Walkable(3, 5));
+	ASSERT_TRUE(grid.Walkable(9, 5));
+	FlowField field;
+	field.Init(&grid);
+	const glm::vec3 goal(1.5f, 0.0f, 1.5f);
+	field.SetGoal(goal);
+	while (field.Pending())
+		field.Update(16);
+
+	// straight at the goal would run into the wall; the field goes through the gap
+	glm::vec3 position(1.5f, 0.0f, 8.5f);
+	bool throughGap = false;
+	for (int step = 0; step < 200 && grid.CellOf(position) != grid.CellOf(goal); step++)
+	{
+		position += field.Sample(position) * 0.25f;
+		glm::ivec2 cell = grid.CellOf(position);
+		ASSERT_TRUE(grid.Walkable(cell.x, cell.y)) << "step " << step;
+		throughGap |= cell.y == 5;
+	}
+	EXPECT_TRUE(grid.CellOf(position) == grid.CellOf(goal));
+	EXPECT_TRUE(throughGap);
+	EXPECT_EQ(field.Sample(goal), glm::vec3(0.0f));
+}
+
+TEST(FlowFieldTest, NoDirectionWhereTheGoalCannotBeReached)
+{
+	NavGrid grid;
+	buildWalledGrid(grid, 10.0f);
+	FlowField field;
+	field.Init(&grid);
+	field.SetGoal(glm::vec3(1.5f, 0.0f, 1.5f));
+	while (field.Pending())
+		field.Update(16);
+	EXPECT_NE(field.Sample(glm::vec3(8.5f, 0.0f, 3.5f)), glm::vec3(0.0f));
+	EXPECT_EQ(field.Sample(glm::vec3(8.5f, 0.0f, 8.5f)), glm::vec3(0.0f));
+	EXPECT_EQ(field.Sample(glm::vec3(1.5f, 0.0f, 6.5f)), glm::vec3(0.0f));
+}
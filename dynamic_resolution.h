@@ -0,0 +1,247 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+// renders the scene into an internal target whose resolution follows the GPU's frame time,
+// then upscales it to the output with a bilinear pass and a light sharpen (upscale.fs).
+//
+// the GPU time of whole frames is measured with timestamp queries, read a few frames late
+// so nothing waits on them, and smoothed. when it leaves the band between upThreshold and
+// downThreshold of the budget the scale is moved towards the middle of the band; pixel cost
+// goes with the square of the scale, so the step is the square root of the ratio. after
+// every change the scale is held for cooldownFrames, so it doesn't chase its own effect.
+// the target is allocated once at maxScale and smaller scales use a corner of it
+class DynamicResolution
+{
+public:
+	struct Settings
+	{
+		float budgetMs = 16.6f;
+		float minScale = 0.5f;
+		float maxScale = 1.0f;
+		float downThreshold = 0.95f;      // of the budget: above it the scale drops
+		float upThreshold = 0.75f;        // below it the scale rises
+		unsigned int cooldownFrames = 30;
+		float smoothing = 0.1f;           // weight of the newest frame
+		float sharpness = 0.25f;          // 0 is plain bilinear
+	};
+
+	struct Stats
+	{
+		unsigned int frames = 0;
+		unsigned int measured = 0;
+		unsigned int changes = 0;
+		double scaleSum = 0.0;
+		double gpuMsSum = 0.0;
+		float lowestScale = 1.0f;
+	};
+
+	~DynamicResolution()
+	{
+		Release();
+	}
+
+	void Init(const Settings& settings)
+	{
+		m_Settings = settings;
+		m_Settings.minScale = glm::clamp(m_Settings.minScale, MIN_SCALE, MAX_SCALE);
+		m_Settings.maxScale = glm::clamp(m_Settings.maxScale, m_Settings.minScale, MAX_SCALE);
+		m_Scale = m_Settings.maxScale;
+		m_Stats.lowestScale = m_Scale;
+		glGenQueries(QUERY_FRAMES * 2, m_Queries);
+		glGenVertexArrays(1, &m_VAO);
+	}
+
+	void Release()
+	{
+		if (!m_VAO)
+			return;
+		DestroyTarget();
+		glDeleteQueries(QUERY_FRAMES * 2, m_Queries);
+		glDeleteVertexArrays(1, &m_VAO);
+		m_VAO = 0;
+	}
+
+	// starts timing a frame; takes in the timings that have arrived and adjusts the scale
+	void BeginFrame()
+	{
+		while (m_Pending > 0)
+		{
+			unsigned int oldest = (m_Next + QUERY_FRAMES - m_Pending) % QUERY_FRAMES;
+			GLint available = 0;
+			glGetQueryObjectiv(m_Queries[oldest * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+			GLuint64 start = 0, end = 0;
+			glGetQueryObjectui64v(m_Queries[oldest * 2], GL_QUERY_RESULT, &start);
+			glGetQueryObjectui64v(m_Queries[oldest * 2 + 1], GL_QUERY_RESULT, &end);
+			m_Pending--;
+			Adjust((end - start) / 1e6f);
+		}
+		// all in flight: skip timing this frame rather than wait
+		m_Timing = m_Pending < QUERY_FRAMES;
+		if (m_Timing)
+			glQueryCounter(m_Queries[m_Next * 2], GL_TIMESTAMP);
+
+		m_Stats.frames++;
+		m_Stats.scaleSum += m_Scale;
+		m_Stats.lowestScale = std::min(m_Stats.lowestScale, m_Scale);
+	}
+
+	void EndFrame()
+	{
+		if (!m_Timing)
+			return;
+		glQueryCounter(m_Queries[m_Next * 2 + 1], GL_TIMESTAMP);
+		m_Next = (m_Next + 1) % QUERY_FRAMES;
+		m_Pending++;
+	}
+
+	// binds the internal target at the current scale for the scene; returns its size
+	glm::ivec2 BeginScene(const glm::ivec2& outputSize)
+	{
+		glm::ivec2 allocated = glm::ivec2(glm::vec2(outputSize) * m_Settings.maxScale + glm::vec2(0.5f));
+		allocated = glm::max(allocated, glm::ivec2(1));
+		if (allocated != m_Allocated)
+			CreateTarget(allocated);
+		m_SceneSize = glm::ivec2(glm::vec2(outputSize) * m_Scale + glm::vec2(0.5f));
+		m_SceneSize = glm::clamp(m_SceneSize, glm::ivec2(1), m_Allocated);
+		glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+		glViewport(0, 0, m_SceneSize.x, m_SceneSize.y);
+		return m_SceneSize;
+	}
+
+	// upscales the scene into the framebuffer and viewport bound by the caller
+	void Resolve(Shader& shader)
+	{
+		GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+		glDisable(GL_DEPTH_TEST);
+		shader.use();
+		shader.setInt("sceneTexture", 0);
+		shader.setVec2("sceneScale", glm::vec2(m_SceneSize) / glm::vec2(m_Allocated));
+		shader.setVec2("texelSize", glm::vec2(1.0f) / glm::vec2(m_Allocated));
+		shader.setFloat("sharpness", m_Scale < 1.0f ? m_Settings.sharpness : 0.0f);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, m_Color);
+		glBindVertexArray(m_VAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		if (depthTest)
+			glEnable(GL_DEPTH_TEST);
+	}
+
+	float GetScale() const
+	{
+		return m_Scale;
+	}
+
+	const Settings& GetSettings() const
+	{
+		return m_Settings;
+	}
+
+	const Stats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+private:
+	static const unsigned int QUERY_FRAMES = 4;
+	const float MIN_SCALE = 0.25f;
+	const float MAX_SCALE = 2.0f;
+	const float SCALE_STEP = 0.05f;   // scales are kept to multiples of this
+
+	void Adjust(float gpuMs)
+	{
+		m_Stats.measured++;
+		m_Stats.gpuMsSum += gpuMs;
+		m_SmoothedMs = m_SmoothedMs > 0.0f ? glm::mix(m_SmoothedMs, gpuMs, m_Settings.smoothing) : gpuMs;
+		if (m_Cooldown > 0)
+		{
+			m_Cooldown--;
+			return;
+		}
+
+		float budget = m_Settings.budgetMs;
+		if (m_SmoothedMs <= budget * m_Settings.downThreshold && m_SmoothedMs >= budget * m_Settings.upThreshold)
+			return;
+		float aim = budget * (m_Settings.downThreshold + m_Settings.upThreshold) * 0.5f;
+		float scale = m_Scale * std::sqrt(aim / std::max(m_SmoothedMs, 0.01f));
+		scale = std::round(scale / SCALE_STEP) * SCALE_STEP;
+		scale = glm::clamp(scale, m_Settings.minScale, m_Settings.maxScale);
+		if (std::fabs(scale - m_Scale) < SCALE_STEP * 0.5f)
+			return;
+
+		// the frames in flight were drawn at the old scale; start the average over
+		m_Scale = scale;
+		m_SmoothedMs = 0.0f;
+		m_Cooldown = m_Settings.cooldownFrames;
+		m_Stats.changes++;
+	}
+
+	void CreateTarget(const glm::ivec2& size)
+	{
+		DestroyTarget();
+		m_Allocated = size;
+		glGenFramebuffers(1, &m_Framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+
+		glGenTextures(1, &m_Color);
+		glBindTexture(GL_TEXTURE_2D, m_Color);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Color, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenRenderbuffers(1, &m_Depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, m_Depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size.x, size.y);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_Depth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Scene framebuffer is incomplete" << std::endl;
+	}
+
+	void DestroyTarget()
+	{
+		if (!m_Framebuffer)
+			return;
+		glDeleteFramebuffers(1, &m_Framebuffer);
+		glDeleteTextures(1, &m_Color);
+		glDeleteRenderbuffers(1, &m_Depth);
+		m_Framebuffer = m_Color = m_Depth = 0;
+		m_Allocated = glm::ivec2(0);
+	}
+
+	Settings m_Settings;
+	float m_Scale = 1.0f;
+	float m_SmoothedMs = 0.0f;
+	unsigned int m_Cooldown = 0;
+
+	unsigned int m_Queries[QUERY_FRAMES * 2] = {};
+	unsigned int m_Next = 0;
+	unsigned int m_Pending = 0;
+	bool m_Timing = false;
+
+	unsigned int m_Framebuffer = 0;
+	unsigned int m_Color = 0;
+	unsigned int m_Depth = 0;
+	unsigned int m_VAO = 0;
+	glm::ivec2 m_Allocated = glm::ivec2(0);
+	glm::ivec2 m_SceneSize = glm::ivec2(1);
+	Stats m_Stats;
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <glm/glm.hpp>
+
+#include "character.h"
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// stable handle; the generation detects use after despawn
+struct Entity
+{
+	uint32_t index = 0xffffffff;
+	uint32_t generation = 0;
+};
+
+enum ComponentMask {
+	COMPONENT_TRANSFORM = 1 << 0,
+	COMPONENT_HEALTH = 1 << 1,
+	COMPONENT_ANIM_STATE = 1 << 2,
+	COMPONENT_ANIMATOR = 1 << 3,  // posed and drawn; the pose itself lives with the renderer
+	COMPONENT_HITBOX = 1 << 4
+};
+
+struct TransformComponent
+{
+	glm::vec3 position;
+	glm::vec3 forward;
+	float yaw;
+	float scale;
+	float moveSpeed;
+	float yawSpeed;
+	float speed;         // along forward this tick; eases between walking and running
+};
+
+const float CHARACTER_MAX_HEALTH = 100.0f;
+
+struct HealthComponent
+{
+	float health;
+	uint8_t alive;
+	uint8_t dying;       // death requested, waiting for the anim state to pick it up
+};
+
+struct AnimStateComponent
+{
+	AnimState state;
+	uint32_t intent;
+	uint8_t clip0;
+	uint8_t clip1;       // CLIP_NONE unless blending
+	float time0;
+	float time1;
+	float blend;
+	uint8_t layerClip;   // played over the upper body on top of the state's clips, CLIP_NONE if none
+	uint8_t layerFading;
+	float layerTime;
+	float layerWeight;
+};
+
+struct HitboxComponent
+{
+	glm::vec3 offset;    // local to the attacker, before its scale
+	glm::vec3 size;
+	glm::vec3 bone;      // the hit bone's position in the same space, from the last evaluated pose
+	uint8_t attached;    // bone is valid and replaces offset
+	uint8_t window;      // between the clip's hitbox on and off events
+	uint8_t active;      // inside the hit window this tick
+	uint8_t hitPerformed;
+};
+
+// entity storage: one dense array per component, all indexed by the same slot.
+// systems walk the arrays front to back; despawn swaps the last slot into the hole,
+// so the arrays never fragment and handles stay valid through the sparse table.
+class World
+{
+public:
+	std::vector<uint8_t> kind;
+	std::vector<uint32_t> mask;
+	std::vector<TransformComponent> transform;
+	std::vector<HealthComponent> health;
+	std::vector<AnimStateComponent> anim;
+	std::vector<HitboxComponent> hitbox;
+
+	void Reserve(unsigned int count)
+	{
+		kind.reserve(count);
+		mask.reserve(count);
+		transform.reserve(count);
+		health.reserve(count);
+		anim.reserve(count);
+		hitbox.reserve(count);
+		m_SlotToIndex.reserve(count);
+		m_Sparse.reserve(count);
+		m_Generation.reserve(count);
+	}
+
+	Entity Spawn(CharacterKind characterKind, uint32_t components, const glm::vec3& position, float yaw)
+	{
+		Entity entity;
+		if (!m_FreeIndices.empty())
+		{
+			entity.index = m_FreeIndices.back();
+			m_FreeIndices.pop_back();
+		}
+		else
+		{
+			entity.index = (uint32_t)m_Sparse.size();
+			m_Sparse.push_back(0);
+			m_Generation.push_back(0);
+		}
+		entity.generation = m_Generation[entity.index];
+
+		unsigned int slot = Count();
+		m_Sparse[entity.index] = slot;
+		m_SlotToIndex.push_back(entity.index);
+
+		kind.push_back((uint8_t)characterKind);
+		mask.push_back(components);
+
+		TransformComponent t;
+		t.position = position;
+		t.forward = glm::vec3(0.0f, 0.0f, -1.0f);
+		t.yaw = yaw;
+		t.scale = 0.5f;
+		t.moveSpeed = 0.0f;
+		t.yawSpeed = 0.0f;
+		t.speed = 0.0f;
+		transform.push_back(t);
+
+		HealthComponent h;
+		h.health = CHARACTER_MAX_HEALTH;
+		h.alive = 1;
+		h.dying = 0;
+		health.push_back(h);
+
+		AnimStateComponent a;
+		a.state = IDLE;
+		a.intent = 0;
+		a.clip0 = CLIP_IDLE;
+		a.clip1 = CLIP_NONE;
+		a.time0 = 0.0f;
+		a.time1 = 0.0f;
+		a.blend = 0.0f;
+		a.layerClip = CLIP_NONE;
+		a.layerFading = 0;
+		a.layerTime = 0.0f;
+		a.layerWeight = 0.0f;
+		anim.push_back(a);
+
+		HitboxComponent b;
+		b.offset = glm::vec3(0.0f, 1.0f, 1.0f);
+		b.size = glm::vec3(1.0f, 1.5f, 1.0f);
+		b.bone = glm::vec3(0.0f);
+		b.attached = 0;
+		b.window = 0;
+		b.active = 0;
+		b.hitPerformed = 0;
+		hitbox.push_back(b);
+
+		return entity;
+	}
+
+	void Despawn(Entity entity)
+	{
+		if (!IsValid(entity))
+			return;
+
+		unsigned int slot = m_Sparse[entity.index];
+		unsigned int last = Count() - 1;
+		if (slot != last)
+		{
+			kind[slot] = kind[last];
+			mask[slot] = mask[last];
+			transform[slot] = transform[last];
+			health[slot] = health[last];
+			anim[slot] = anim[last];
+			hitbox[slot] = hitbox[last];
+			m_SlotToIndex[slot] = m_SlotToIndex[last];
+			m_Sparse[m_SlotToIndex[slot]] = slot;
+		}
+		kind.pop_back();
+		mask.pop_back();
+		transform.pop_back();
+		health.pop_back();
+		anim.pop_back();
+		hitbox.pop_back();
+		m_SlotToIndex.pop_back();
+
+		m_Generation[entity.index]++;
+		m_FreeIndices.push_back(entity.index);
+	}
+
+	// a despawned index keeps its stale slot, so liveness is checked through the slot
+	bool IsValid(Entity entity) const
+	{
+		if (entity.index >= m_Sparse.size() || m_Generation[entity.index] != entity.generation)
+			return false;
+		unsigned int slot = m_Sparse[entity.index];
+		return slot < Count() && m_SlotToIndex[slot] == entity.index;
+	}
+
+	// dense slot of a live entity; only valid until the next despawn
+	unsigned int Slot(Entity entity) const
+	{
+		assert(IsValid(entity));
+		return m_Sparse[entity.index];
+	}
+
+	Entity EntityAt(unsigned int slot) const
+	{
+		Entity entity;
+		entity.index = m_SlotToIndex[slot];
+		entity.generation = m_Generation[entity.index];
+		return entity;
+	}
+
+	unsigned int Count() const
+	{
+		return (unsigned int)m_SlotToIndex.size();
+	}
+
+	bool Has(unsigned int slot, uint32_t components) const
+	{
+		return (mask[slot] & components) == components;
+	}
+
+private:
+	friend class WorldSnapshot;
+
+	std::vector<uint32_t> m_SlotToIndex;
+	std::vector<uint32_t> m_Sparse;
+	std::vector<uint32_t> m_Generation;
+	std::vector<uint32_t> m_FreeIndices;
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include <glm/glm.hpp>
+
+#include "flow_field.h"
+
+#include <algorithm>
+#include <cmath>
+
+void NavGrid::Init(const glm::vec3& minBounds, const glm::vec3& maxBounds, float cellSize, float floorHeight, float agentHeight)
+{
+	m_Origin = glm::vec2(minBounds.x, minBounds.z);
+	m_CellSize = cellSize;
+	m_FloorHeight = floorHeight;
+	m_AgentHeight = agentHeight;
+	m_Width = std::max(1, (int)std::ceil((maxBounds.x - minBounds.x) / cellSize));
+	m_Height = std::max(1, (int)std::ceil((maxBounds.z - minBounds.z) / cellSize));
+	m_Floor.assign(m_Width * m_Height, 0);
+	m_Wall.assign(m_Width * m_Height, 0);
+}
+
+void NavGrid::AddTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	glm::vec3 normal = glm::cross(b - a, c - a);
+	float area = glm::length(normal);
+	if (area <= 0.0f)
+		return;
+	normal /= area;
+
+	float minY = std::min(a.y, std::min(b.y, c.y));
+	float maxY = std::max(a.y, std::max(b.y, c.y));
+
+	if (std::fabs(normal.y) > FLOOR_SLOPE)
+	{
+		// floor: cover every cell whose centre falls inside the triangle
+		if (std::fabs(maxY - m_FloorHeight) > FLOOR_TOLERANCE)
+			return;
+		int x0, z0, x1, z1;
+		CellBounds(a, b, c, x0, z0, x1, z1);
+		for (int z = z0; z <= z1; z++)
+			for (int x = x0; x <= x1; x++)
+				if (InsideXZ(CellCenter(x, z), a, b, c))
+					m_Floor[z * m_Width + x] = 1;
+	}
+	else if (maxY > m_FloorHeight + STEP_HEIGHT && minY < m_FloorHeight + m_AgentHeight)
+	{
+		// wall: nearly flat in XZ, so walk its edges instead
+		MarkSegment(a, b);
+		MarkSegment(b, c);
+		MarkSegment(c, a);
+	}
+}
+
+void NavGrid::Finish()
+{
+	if (std::find(m_Floor.begin(), m_Floor.end(), 1) == m_Floor.end())
+		std::fill(m_Floor.begin(), m_Floor.end(), 1);
+}
+
+void NavGrid::CellBounds(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, int& x0, int& z0, int& x1, int& z1) const
+{
+	glm::ivec2 lo = CellOf(glm::vec3(std::min(a.x, std::min(b.x, c.x)), 0.0f, std::min(a.z, std::min(b.z, c.z))));
+	glm::ivec2 hi = CellOf(glm::vec3(std::max(a.x, std::max(b.x, c.x)), 0.0f, std::max(a.z, std::max(b.z, c.z))));
+	x0 = lo.x; z0 = lo.y; x1 = hi.x; z1 = hi.y;
+}
+
+bool NavGrid::InsideXZ(const glm::vec2& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	float d0 = (b.x - a.x) * (p.y - a.z) - (b.z - a.z) * (p.x - a.x);
+	float d1 = (c.x - b.x) * (p.y - b.z) - (c.z - b.z) * (p.x - b.x);
+	float d2 = (a.x - c.x) * (p.y - c.z) - (a.z - c.z) * (p.x - c.x);
+	bool negative = d0 < 0.0f || d1 < 0.0f || d2 < 0.0f;
+	bool positive = d0 > 0.0f || d1 > 0.0f || d2 > 0.0f;
+	return !(negative && positive);
+}
+
+void NavGrid::MarkSegment(const glm::vec3& a, const glm::vec3& b)
+{
+	float length = glm::length(glm::vec2(b.x - a.x, b.z - a.z));
+	int steps = std::max(1, (int)std::ceil(length / (m_CellSize * 0.5f)));
+	for (int i = 0; i <= steps; i++)
+	{
+		glm::ivec2 cell = CellOf(a + (b - a) * ((float)i / steps));
+		m_Wall[cell.y * m_Width + cell.x] = 1;
+	}
+}
+
+void FlowField::Init(const NavGrid* grid)
+{
+	m_Grid = grid;
+	size_t cells = (size_t)grid->Width() * grid->Height();
+	m_Directions.assign(cells, NO_DIRECTION);
+	m_Building.assign(cells, NO_DIRECTION);
+	m_Visited.assign(cells, 0);
+	m_Frontier.clear();
+	m_Goal = glm::ivec2(-1, -1);
+	m_NextGoal = glm::ivec2(-1, -1);
+	m_Pending = false;
+}
+
+void FlowField::SetGoal(const glm::vec3& position)
+{
+	m_NextGoal = m_Grid->CellOf(position);
+	if (!m_Pending && m_NextGoal != m_Goal)
+		StartSearch(m_NextGoal);
+}
+
+bool FlowField::Update(int nodeBudget)
+{
+	if (!m_Pending)
+		return false;
+
+	int width = m_Grid->Width();
+	while (!m_Frontier.empty() && nodeBudget-- > 0)
+	{
+		int current = m_Frontier.front();
+		m_Frontier.pop_front();
+		int cx = current % width;
+		int cz = current / width;
+
+		for (uint8_t d = 0; d < 8; d++)
+		{
+			int nx = cx + OFFSETS[d][0];
+			int nz = cz + OFFSETS[d][1];
+			if (!m_Grid->Walkable(nx, nz))
+				continue;
+			// no corner cutting past walls
+			if (d >= 4 && (!m_Grid->Walkable(cx + OFFSETS[d][0], cz) || !m_Grid->Walkable(cx, cz + OFFSETS[d][1])))
+				continue;
+			int next = Index(nx, nz);
+			if (m_Visited[next])
+				continue;
+			m_Visited[next] = 1;
+			m_Building[next] = Opposite(d);
+			m_Frontier.push_back(next);
+		}
+	}
+
+	if (!m_Frontier.empty())
+		return false;
+	m_Directions.swap(m_Building);
+	m_Pending = false;
+	// the goal moved on while this one was searched
+	if (m_NextGoal != m_Goal)
+		StartSearch(m_NextGoal);
+	return true;
+}
+
+glm::vec3 FlowField::Sample(const glm::vec3& position) const
+{
+	glm::ivec2 cell = m_Grid->CellOf(position);
+	uint8_t d = m_Directions[Index(cell.x, cell.y)];
+	if (d == NO_DIRECTION)
+		return glm::vec3(0.0f);
+	glm::vec2 target = m_Grid->CellCenter(cell.x + OFFSETS[d][0], cell.y + OFFSETS[d][1]);
+	glm::vec3 direction = glm::vec3(target.x - position.x, 0.0f, target.y - position.z);
+	float length = glm::length(direction);
+	return length > 0.0f ? direction / length : glm::vec3(0.0f);
+}
+
+void FlowField::StartSearch(const glm::ivec2& cell)
+{
+	m_Goal = cell;
+	m_Pending = true;
+	m_Frontier.clear();
+	std::fill(m_Building.begin(), m_Building.end(), NO_DIRECTION);
+	std::fill(m_Visited.begin(), m_Visited.end(), 0);
+
+	int goal = Index(cell.x, cell.y);
+	m_Visited[goal] = 1;
+	m_Frontier.push_back(goal);
+}
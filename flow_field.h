@@ -0,0 +1,127 @@
+#ifndef FLOW_FIELD_H
+#define FLOW_FIELD_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// walkability grid on the XZ plane, rasterized from the map's triangles.
+// floor triangles near the agents' height mark cells walkable, walls crossing
+// the agents' body height block them.
+class NavGrid
+{
+public:
+	NavGrid() {}
+
+	// bounds of the area to cover; call before adding triangles
+	void Init(const glm::vec3& minBounds, const glm::vec3& maxBounds, float cellSize, float floorHeight, float agentHeight);
+
+	void AddTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+	// falls back to an open grid if the map produced no floor at the given height
+	void Finish();
+
+	bool Walkable(int x, int z) const
+	{
+		if (x < 0 || z < 0 || x >= m_Width || z >= m_Height)
+			return false;
+		int i = z * m_Width + x;
+		return m_Floor[i] && !m_Wall[i];
+	}
+
+	glm::ivec2 CellOf(const glm::vec3& position) const
+	{
+		int x = (int)std::floor((position.x - m_Origin.x) / m_CellSize);
+		int z = (int)std::floor((position.z - m_Origin.y) / m_CellSize);
+		return glm::ivec2(std::min(std::max(x, 0), m_Width - 1), std::min(std::max(z, 0), m_Height - 1));
+	}
+
+	glm::vec2 CellCenter(int x, int z) const
+	{
+		return m_Origin + glm::vec2((x + 0.5f) * m_CellSize, (z + 0.5f) * m_CellSize);
+	}
+
+	int Width() const { return m_Width; }
+	int Height() const { return m_Height; }
+
+private:
+	const float FLOOR_SLOPE = 0.7f;
+	const float FLOOR_TOLERANCE = 0.6f;
+	const float STEP_HEIGHT = 0.3f;
+
+	void CellBounds(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, int& x0, int& z0, int& x1, int& z1) const;
+
+	static bool InsideXZ(const glm::vec2& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+	void MarkSegment(const glm::vec3& a, const glm::vec3& b);
+
+	glm::vec2 m_Origin = glm::vec2(0.0f);
+	float m_CellSize = 1.0f;
+	float m_FloorHeight = 0.0f;
+	float m_AgentHeight = 1.0f;
+	int m_Width = 0;
+	int m_Height = 0;
+	std::vector<uint8_t> m_Floor;
+	std::vector<uint8_t> m_Wall;
+};
+
+// one flow field towards a single goal (the player), shared by every agent.
+// it is rebuilt with a breadth-first search whenever the goal changes cell; the search is
+// spread over frames with a node budget and fills a back buffer, so agents keep steering by
+// the last complete field until the new one is swapped in. a goal that moves while a search
+// runs waits for it to finish, so a field is published however often the goal changes cell.
+class FlowField
+{
+public:
+	static constexpr uint8_t NO_DIRECTION = 0xff;
+
+	void Init(const NavGrid* grid);
+
+	// searches towards the goal's cell once the current search, if any, is done
+	void SetGoal(const glm::vec3& position);
+
+	// expands at most nodeBudget cells; returns true when a new field was published
+	bool Update(int nodeBudget);
+
+	// unit XZ direction towards the goal from the given position, or zero if unreachable
+	glm::vec3 Sample(const glm::vec3& position) const;
+
+	// a search is running; a goal set meanwhile is searched once it is done
+	bool Pending() const
+	{
+		return m_Pending;
+	}
+
+private:
+	friend class FlowFieldSnapshot;
+
+	// 4 straight neighbours first, then diagonals
+	static constexpr int OFFSETS[8][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }, { 1, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 } };
+
+	static uint8_t Opposite(uint8_t d)
+	{
+		return d ^ 1;
+	}
+
+	int Index(int x, int z) const
+	{
+		return z * m_Grid->Width() + x;
+	}
+
+	void StartSearch(const glm::ivec2& cell);
+
+	const NavGrid* m_Grid = nullptr;
+	std::vector<uint8_t> m_Directions;
+	std::vector<uint8_t> m_Building;
+	std::vector<uint8_t> m_Visited;
+	std::deque<int> m_Frontier;
+	glm::ivec2 m_Goal = glm::ivec2(-1, -1);      // of the search running or last published
+	glm::ivec2 m_NextGoal = glm::ivec2(-1, -1);  // as last set
+	bool m_Pending = false;
+};
+
+#endif
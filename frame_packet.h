@@ -0,0 +1,118 @@
+#ifndef FRAME_PACKET_H
+#define FRAME_PACKET_H
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// one character to draw: its model matrix and its bones, a range of FramePacket::palette
+struct CharacterDraw
+{
+	int kind = 0;
+	glm::mat4 model = glm::mat4(1.0f);
+	unsigned int firstBone = 0;
+	unsigned int boneCount = 0;
+};
+
+// one wireframe box: an attack hitbox inside its hit window, or a placeholder for a
+// character that is in range but still streaming in
+struct BoxDraw
+{
+	glm::mat4 model = glm::mat4(1.0f);
+	bool hitbox = false;
+};
+
+// a health bar above a character, at the top of its head
+struct HealthBarDraw
+{
+	glm::vec3 position = glm::vec3(0.0f);
+	float fraction = 1.0f;
+	bool player = false;
+};
+
+// a recent hit for the HUD's message feed
+struct HudMessage
+{
+	int kind = 0;
+	bool defeated = false;
+	float health = 0.0f;
+	float time = 0.0f;   // simulated seconds when it landed
+};
+
+// everything the GL thread needs to draw one simulation tick, so it never touches the World.
+// the simulation thread fills it in; once published it is read-only
+struct FramePacket
+{
+	uint64_t tick = 0;
+	std::chrono::steady_clock::time_point sampled;   // when the tick read its input
+	float time = 0.0f;                               // seconds simulated, for effects that animate
+	glm::vec3 playerPosition = glm::vec3(0.0f);
+	std::vector<CharacterDraw> characters;
+	std::vector<glm::mat4> palette;                  // bone matrices of every character, back to back
+	std::vector<BoxDraw> boxes;
+	bool merchantTalking = false;
+	CharacterDraw merchantCloseUp;
+	float playerHealth = 0.0f;
+	std::vector<HealthBarDraw> healthBars;
+	std::vector<HudMessage> messages;                // newest last
+
+	// keeps the vectors' capacity, so a packet stops allocating once it has seen a busy tick
+	void Clear()
+	{
+		characters.clear();
+		palette.clear();
+		boxes.clear();
+		healthBars.clear();
+		messages.clear();
+		merchantTalking = false;
+	}
+};
+
+// hands the newest value from one producer thread to one consumer thread without locks and
+// without either side ever waiting. of the three slots the producer owns one (the back), the
+// consumer owns one (the front) and the third sits in the middle; publishing and consuming
+// each swap their slot with the middle one in a single atomic exchange. a value published
+// while the previous one was still unread replaces it, so the consumer always gets the latest
+template <typename T>
+class TripleBuffer
+{
+public:
+	// the slot to fill before the next Publish; may hold an old value
+	T& Back()
+	{
+		return m_Slots[m_Back];
+	}
+
+	void Publish()
+	{
+		m_Back = m_Middle.exchange((uint8_t)(m_Back | FRESH), std::memory_order_acq_rel) & INDEX;
+	}
+
+	// moves the newest published value to the front; false if nothing new arrived since the last call
+	bool Consume()
+	{
+		if (!(m_Middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		m_Front = m_Middle.exchange(m_Front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	const T& Front() const
+	{
+		return m_Slots[m_Front];
+	}
+
+private:
+	static const uint8_t INDEX = 3;
+	static const uint8_t FRESH = 4;
+
+	T m_Slots[3];
+	uint8_t m_Back = 0;
+	std::atomic<uint8_t> m_Middle{ 1 };
+	uint8_t m_Front = 2;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "headless_arena.h"
+
+#include <cmath>
+#include <string>
+
+// idle 3.3, walk 2.06, run 0.83, attack 1.03 and kick 1.6 are the knight's; the rest are picked
+// to hold their event tracks
+const float HEADLESS_CLIP_DURATIONS[CLIP_COUNT] = {
+	3.3f,    // idle
+	2.06f,   // walk
+	1.6f,    // walk back
+	0.83f,   // run
+	1.03f,   // attack
+	1.6f,    // kick
+	1.0f,    // turn
+	2.0f,    // dying
+	4.0f     // talk
+};
+
+const float HEADLESS_ARENA_HALF_WIDTH = 8.0f;
+const float HEADLESS_ARENA_NEAR = 4.0f;         // z of the wall behind the player
+const float HEADLESS_ARENA_FAR = -20.0f;        // z of the wall behind the monsters
+const float HEADLESS_WALL_HEIGHT = 3.0f;
+
+void loadHeadlessClipTimings()
+{
+	for (unsigned int i = 0; i < CLIP_ASSET_COUNT; i++)
+	{
+		const ClipAsset& asset = CLIP_ASSETS[i];
+		ClipInfo& clip = characterDefs[asset.kind].clips[asset.clip];
+		clip.duration = HEADLESS_CLIP_DURATIONS[asset.clip];
+		clip.ticksPerSecond = 1.0f;
+		clip.loaded = true;
+		loadClipEvents(asset.kind, asset.clip, clip);
+	}
+	for (int k = 0; k < CHARACTER_KIND_COUNT; k++)
+		characterDefs[k].active = true;
+}
+
+// two triangles for the quad a, b, c, d
+static void addQuad(std::vector<glm::vec3>& triangles, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d)
+{
+	const glm::vec3 corners[6] = { a, b, c, a, c, d };
+	triangles.insert(triangles.end(), corners, corners + 6);
+}
+
+void buildHeadlessNavGrid(NavGrid& grid)
+{
+	float y = ENEMY_START.y;
+	float top = y + HEADLESS_WALL_HEIGHT;
+	float w = HEADLESS_ARENA_HALF_WIDTH;
+	float n = HEADLESS_ARENA_NEAR;
+	float f = HEADLESS_ARENA_FAR;
+	std::vector<glm::vec3> triangles;
+	addQuad(triangles, glm::vec3(-w, y, n), glm::vec3(w, y, n), glm::vec3(w, y, f), glm::vec3(-w, y, f));
+	addQuad(triangles, glm::vec3(-w, y, n), glm::vec3(w, y, n), glm::vec3(w, top, n), glm::vec3(-w, top, n));
+	addQuad(triangles, glm::vec3(-w, y, f), glm::vec3(w, y, f), glm::vec3(w, top, f), glm::vec3(-w, top, f));
+	addQuad(triangles, glm::vec3(-w, y, n), glm::vec3(-w, y, f), glm::vec3(-w, top, f), glm::vec3(-w, top, n));
+	addQuad(triangles, glm::vec3(w, y, n), glm::vec3(w, y, f), glm::vec3(w, top, f), glm::vec3(w, top, n));
+	buildNavGrid(grid, triangles);
+}
+
+// adds a joint offset from its parent, with the inverse of its rest transform as the bone offset
+static int addHeadlessJoint(Skeleton& skeleton, std::vector<glm::mat4>& globals, const std::string& name, int parent, const glm::vec3& offset)
+{
+	glm::mat4 local = glm::translate(glm::mat4(1.0f), offset);
+	glm::mat4 global = parent >= 0 ? globals[parent] * local : local;
+	globals.push_back(global);
+	int joint = (int)skeleton.Count();
+	return (int)skeleton.AddJoint("mixamorig:" + name, parent, local, joint, glm::inverse(global));
+}
+
+void buildHeadlessSkeleton(Skeleton& skeleton)
+{
+	skeleton = Skeleton();
+	std::vector<glm::mat4> globals;
+	int hips = addHeadlessJoint(skeleton, globals, "Hips", -1, glm::vec3(0.0f, 1.0f, 0.0f));
+	int spine = addHeadlessJoint(skeleton, globals, "Spine", hips, glm::vec3(0.0f, 0.1f, 0.0f));
+	int spine1 = addHeadlessJoint(skeleton, globals, "Spine1", spine, glm::vec3(0.0f, 0.12f, 0.0f));
+	int spine2 = addHeadlessJoint(skeleton, globals, "Spine2", spine1, glm::vec3(0.0f, 0.14f, 0.0f));
+	int neck = addHeadlessJoint(skeleton, globals, "Neck", spine2, glm::vec3(0.0f, 0.15f, 0.0f));
+	int head = addHeadlessJoint(skeleton, globals, "Head", neck, glm::vec3(0.0f, 0.1f, 0.0f));
+	addHeadlessJoint(skeleton, globals, "HeadTop_End", head, glm::vec3(0.0f, 0.2f, 0.0f));
+
+	const char* const fingers[5] = { "Thumb", "Index", "Middle", "Ring", "Pinky" };
+	for (int side = 0; side < 2; side++)
+	{
+		std::string s = side == 0 ? "Left" : "Right";
+		float x = side == 0 ? 1.0f : -1.0f;
+		int shoulder = addHeadlessJoint(skeleton, globals, s + "Shoulder", spine2, glm::vec3(0.06f * x, 0.12f, 0.0f));
+		int arm = addHeadlessJoint(skeleton, globals, s + "Arm", shoulder, glm::vec3(0.12f * x, 0.0f, 0.0f));
+		int foreArm = addHeadlessJoint(skeleton, globals, s + "ForeArm", arm, glm::vec3(0.0f, 0.0f, 0.28f));
+		int hand = addHeadlessJoint(skeleton, globals, s + "Hand", foreArm, glm::vec3(0.0f, 0.0f, 0.26f));
+		for (int f = 0; f < 5; f++)
+		{
+			int joint = hand;
+			for (int n = 1; n <= 4; n++)
+				joint = addHeadlessJoint(skeleton, globals, s + "Hand" + fingers[f] + std::to_string(n), joint,
+					n == 1 ? glm::vec3(0.08f * x, 0.0f, 0.02f * (f - 2)) : glm::vec3(0.03f * x, 0.0f, 0.0f));
+		}
+
+		int upLeg = addHeadlessJoint(skeleton, globals, s + "UpLeg", hips, glm::vec3(0.09f * x, -0.05f, 0.0f));
+		int leg = addHeadlessJoint(skeleton, globals, s + "Leg", upLeg, glm::vec3(0.0f, -0.42f, 0.0f));
+		int foot = addHeadlessJoint(skeleton, globals, s + "Foot", leg, glm::vec3(0.0f, -0.4f, 0.0f));
+		int toe = addHeadlessJoint(skeleton, globals, s + "ToeBase", foot, glm::vec3(0.0f, -0.06f, 0.12f));
+		addHeadlessJoint(skeleton, globals, s + "Toe_End", toe, glm::vec3(0.0f, 0.0f, 0.08f));
+	}
+}
+
+// keys on every channel of every joint, like a mixamo export: each joint swings about its own
+// axis, once per clip, and the hips bob
+static KeyframeClip* buildHeadlessClip(const Skeleton& skeleton, ClipId clipId, float duration)
+{
+	KeyframeClip* clip = new KeyframeClip(skeleton.Count(), duration);
+	unsigned int keys = std::max(2u, (unsigned int)(duration * HEADLESS_KEYS_PER_SECOND) + 1);
+	for (unsigned int j = 0; j < skeleton.Count(); j++)
+	{
+		KeyframeTrack& track = clip->GetTrack(j);
+		const JointPose& rest = skeleton.rest[j];
+		glm::vec3 axis = glm::normalize(glm::vec3(std::sin(j * 1.3f), std::cos(j * 0.7f), std::sin(j * 2.1f + 1.0f)));
+		float amplitude = 0.2f + 0.05f * (float)((j + clipId) % 5);
+		for (unsigned int k = 0; k < keys; k++)
+		{
+			float time = duration * k / (keys - 1);
+			float angle = amplitude * std::sin(6.2831853f * k / (keys - 1) + j);
+			glm::vec3 position = rest.translation;
+			if (j == 0)
+				position.y += 0.03f * std::sin(12.566371f * k / (keys - 1));
+			track.positions.push_back({ time, position });
+			track.rotations.push_back({ time, glm::angleAxis(angle, axis) * rest.rotation });
+			track.scales.push_back({ time, rest.scale });
+		}
+	}
+	return clip;
+}
+
+void HeadlessRigs::Build()
+{
+	clips.clear();
+	for (int k = 0; k < CHARACTER_KIND_COUNT; k++)
+	{
+		CharacterRig& rig = rigs[k];
+		buildHeadlessSkeleton(rig.skeleton);
+		rig.Bind(characterDefs[k]);
+		for (int c = 0; c < CLIP_COUNT; c++)
+		{
+			rig.clips[c] = nullptr;
+			const ClipInfo& info = characterDefs[k].clips[c];
+			if (!info.loaded)
+				continue;
+			clips.emplace_back(buildHeadlessClip(rig.skeleton, (ClipId)c, info.duration));
+			rig.clips[c] = clips.back().get();
+		}
+	}
+}
+
+void tickHeadlessArena(HeadlessArena& arena, const CharacterRig* rigs, BlendTree& tree, PoseCache& cache, uint32_t intent, float dt)
+{
+	stepArena(arena, intent, dt);
+	updatePoses(arena.world, rigs, tree, cache, arena.poses);
+	SnapshotWriter writer(arena.state);
+	WorldSnapshot::Write(writer, arena.world);
+}
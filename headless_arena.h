@@ -0,0 +1,59 @@
+#ifndef HEADLESS_ARENA_H
+#define HEADLESS_ARENA_H
+
+#include <glm/glm.hpp>
+
+#include "arena.h"
+#include "blend_tree.h"
+#include "character_pose.h"
+#include "ecs.h"
+#include "flow_field.h"
+#include "keyframe_clip.h"
+#include "simulation.h"
+#include "snapshot.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// the game without assets, GL or a window, for the unit tests and benchmarks of the core library.
+// what the client and server read from files is made up here instead: clip timings from the
+// durations noted by CLIP_ASSETS, a walled floor covering the spawn points for the nav grid, and
+// keyframe clips on a mixamo-sized skeleton. the rules and poses are the game's own
+
+// seconds per clip slot, in clip time as the event tracks use
+extern const float HEADLESS_CLIP_DURATIONS[CLIP_COUNT];
+const float HEADLESS_KEYS_PER_SECOND = 30.0f;   // as mixamo exports
+
+// what the server's loadClipTimings does from the clip files: every kind gets timings and
+// event tracks for its clips and is made active
+void loadHeadlessClipTimings();
+
+// a floor at the characters' height from the merchant's corner to past the monster spawn, walled in
+void buildHeadlessNavGrid(NavGrid& grid);
+
+// 65 joints named like a mixamo rig, hips first, every joint with a palette slot. the arms are
+// held out in front (+z, the way models face), so swings reach what is ahead
+void buildHeadlessSkeleton(Skeleton& skeleton);
+
+// every kind on the headless skeleton, with a keyframe clip for each clip it has loaded
+struct HeadlessRigs
+{
+	CharacterRig rigs[CHARACTER_KIND_COUNT];
+	std::vector<std::unique_ptr<KeyframeClip> > clips;
+
+	// call after loadHeadlessClipTimings
+	void Build();
+};
+
+// a server arena that also poses every character and writes the snapshot each tick
+struct HeadlessArena : ArenaSimulation
+{
+	std::vector<std::vector<glm::mat4> > poses;   // by entity index, as the client keeps them
+	std::vector<uint8_t> state;                   // the tick's snapshot
+};
+
+// everything a tick costs without drawing: the rules (stepArena), every pose and the snapshot
+void tickHeadlessArena(HeadlessArena& arena, const CharacterRig* rigs, BlendTree& tree, PoseCache& cache, uint32_t intent, float dt);
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// key transitions as they arrive from the window system
+struct InputEvent
+{
+	double time;
+	uint16_t key;
+	uint8_t pressed;
+};
+
+// collects key events from the window callbacks and applies them once per tick, so the
+// simulation reads one consistent key state per tick instead of polling the window.
+// a session can be recorded to a binary log (tick length and the events consumed by each
+// tick) and replayed later without a window; replay feeds back the same ticks in the same
+// order, which makes a run reproducible bit for bit.
+// Push may come from another thread than the one running the ticks.
+//
+// log layout, little endian:
+//   header: "KNIN" magic, uint32 version
+//   tick:   float dt, uint16 event count, then per event uint16 key, uint8 pressed
+class InputQueue
+{
+public:
+	static const int MAX_KEYS = 512;
+
+	enum Mode { LIVE, RECORD, REPLAY };
+
+	~InputQueue()
+	{
+		Stop();
+	}
+
+	// from the key callback; repeats carry no new state and are dropped
+	void Push(int key, bool pressed, double time)
+	{
+		if (key < 0 || key >= MAX_KEYS || m_Mode == REPLAY)
+			return;
+		InputEvent event;
+		event.time = time;
+		event.key = (uint16_t)key;
+		event.pressed = pressed ? 1 : 0;
+		std::lock_guard<std::mutex> lock(m_PendingMutex);
+		m_Pending.push_back(event);
+	}
+
+	bool StartRecording(const std::string& path)
+	{
+		m_File.open(path, std::ios::binary | std::ios::trunc);
+		if (!m_File)
+		{
+			std::cout << "Failed to open input log for writing: " << path << std::endl;
+			return false;
+		}
+		m_File.write(MAGIC, 4);
+		WriteValue(VERSION);
+		m_Mode = RECORD;
+		return true;
+	}
+
+	// the whole log is read up front so replay does no I/O between ticks
+	bool StartReplay(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			std::cout << "Failed to open input log: " << path << std::endl;
+			return false;
+		}
+		m_Log.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		uint32_t version = 0;
+		if (m_Log.size() < 8 || memcmp(m_Log.data(), MAGIC, 4) != 0)
+		{
+			std::cout << "Not an input log: " << path << std::endl;
+			return false;
+		}
+		memcpy(&version, &m_Log[4], sizeof(version));
+		if (version != VERSION)
+		{
+			std::cout << "Unsupported input log version " << version << ": " << path << std::endl;
+			return false;
+		}
+		m_ReadOffset = 8;
+		m_Mode = REPLAY;
+		return true;
+	}
+
+	void Stop()
+	{
+		if (m_File.is_open())
+			m_File.close();
+		m_Mode = LIVE;
+	}
+
+	// applies this tick's events and returns the tick length to simulate with: the measured
+	// one when live or recording, the recorded one when replaying. returns false once the
+	// replay has run out of ticks
+	bool BeginTick(float& dt)
+	{
+		memset(m_Pressed, 0, sizeof(m_Pressed));
+		m_TickEvents.clear();
+
+		if (m_Mode == REPLAY)
+		{
+			uint16_t count = 0;
+			if (!ReadValue(dt) || !ReadValue(count))
+				return false;
+			for (uint16_t i = 0; i < count; i++)
+			{
+				InputEvent event;
+				event.time = 0.0;
+				if (!ReadValue(event.key) || !ReadValue(event.pressed) || event.key >= MAX_KEYS)
+					return false;
+				m_TickEvents.push_back(event);
+			}
+		}
+		else
+		{
+			std::lock_guard<std::mutex> lock(m_PendingMutex);
+			m_TickEvents.swap(m_Pending);
+			m_Pending.clear();
+		}
+
+		for (size_t i = 0; i < m_TickEvents.size(); i++)
+		{
+			const InputEvent& event = m_TickEvents[i];
+			if (event.pressed && !m_Down[event.key])
+				m_Pressed[event.key] = 1;
+			m_Down[event.key] = event.pressed;
+		}
+
+		if (m_Mode == RECORD)
+		{
+			WriteValue(dt);
+			WriteValue((uint16_t)m_TickEvents.size());
+			for (size_t i = 0; i < m_TickEvents.size(); i++)
+			{
+				WriteValue(m_TickEvents[i].key);
+				WriteValue(m_TickEvents[i].pressed);
+			}
+		}
+		m_Tick++;
+		return true;
+	}
+
+	// held at the end of the tick's events, like polling the window right before the tick
+	bool Down(int key) const
+	{
+		return key >= 0 && key < MAX_KEYS && m_Down[key];
+	}
+
+	// went down during this tick, even if it was released again before the tick ran
+	bool Pressed(int key) const
+	{
+		return key >= 0 && key < MAX_KEYS && m_Pressed[key];
+	}
+
+	Mode GetMode() const
+	{
+		return m_Mode;
+	}
+
+	unsigned long GetTick() const
+	{
+		return m_Tick;
+	}
+
+private:
+	static constexpr const char* MAGIC = "KNIN";
+	static constexpr uint32_t VERSION = 1;
+
+	template <typename T>
+	void WriteValue(const T& value)
+	{
+		m_File.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	bool ReadValue(T& value)
+	{
+		if (m_ReadOffset + sizeof(T) > m_Log.size())
+			return false;
+		memcpy(&value, &m_Log[m_ReadOffset], sizeof(T));
+		m_ReadOffset += sizeof(T);
+		return true;
+	}
+
+	Mode m_Mode = LIVE;
+	std::mutex m_PendingMutex;
+	std::vector<InputEvent> m_Pending;
+	std::vector<InputEvent> m_TickEvents;
+	uint8_t m_Down[MAX_KEYS] = {};
+	uint8_t m_Pressed[MAX_KEYS] = {};
+	unsigned long m_Tick = 0;
+
+	std::ofstream m_File;
+	std::vector<char> m_Log;
+	size_t m_ReadOffset = 0;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef KEYFRAME_CLIP_H
+#define KEYFRAME_CLIP_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "blend_tree.h"
+
+#include <vector>
+
+// a clip held as plain keyframes rather than an assimp Animation, so it can be built and sampled
+// without assets or GL (tests, benchmarks, procedural clips). sampling follows the Bone of
+// learnopengl/bone.h: the key before the time is found by a scan from the start, then
+// translation and scale are lerped and rotation slerped towards the next key
+struct KeyframeTrack
+{
+	struct VectorKey
+	{
+		float time;
+		glm::vec3 value;
+	};
+
+	struct RotationKey
+	{
+		float time;
+		glm::quat value;
+	};
+
+	std::vector<VectorKey> positions;
+	std::vector<RotationKey> rotations;
+	std::vector<VectorKey> scales;
+
+	bool Empty() const
+	{
+		return positions.empty() && rotations.empty() && scales.empty();
+	}
+};
+
+// the key a time falls after; past the last key holds it, where Bone would assert
+template <typename Key>
+inline unsigned int keyframeIndex(const std::vector<Key>& keys, float time)
+{
+	for (unsigned int i = 0; i + 1 < keys.size(); i++)
+		if (time < keys[i + 1].time)
+			return i;
+	return (unsigned int)keys.size() - 1;
+}
+
+inline float keyframeFactor(float lastTime, float nextTime, float time)
+{
+	float span = nextTime - lastTime;
+	return span > 0.0f ? glm::clamp((time - lastTime) / span, 0.0f, 1.0f) : 0.0f;
+}
+
+inline glm::vec3 sampleKeys(const std::vector<KeyframeTrack::VectorKey>& keys, float time, const glm::vec3& fallback)
+{
+	if (keys.empty())
+		return fallback;
+	unsigned int i = keyframeIndex(keys, time);
+	if (i + 1 >= keys.size())
+		return keys[i].value;
+	return glm::mix(keys[i].value, keys[i + 1].value, keyframeFactor(keys[i].time, keys[i + 1].time, time));
+}
+
+inline glm::quat sampleKeys(const std::vector<KeyframeTrack::RotationKey>& keys, float time, const glm::quat& fallback)
+{
+	if (keys.empty())
+		return fallback;
+	unsigned int i = keyframeIndex(keys, time);
+	if (i + 1 >= keys.size())
+		return glm::normalize(keys[i].value);
+	return glm::normalize(glm::slerp(keys[i].value, keys[i + 1].value, keyframeFactor(keys[i].time, keys[i + 1].time, time)));
+}
+
+// one track per skeleton joint; joints with an empty track aren't animated by the clip
+class KeyframeClip : public PoseClip
+{
+public:
+	KeyframeClip(unsigned int jointCount, float duration)
+		: m_Tracks(jointCount), m_Duration(duration)
+	{
+	}
+
+	KeyframeTrack& GetTrack(unsigned int joint)
+	{
+		return m_Tracks[joint];
+	}
+
+	bool Sample(unsigned int joint, float time, JointPose& pose) override
+	{
+		const KeyframeTrack& track = m_Tracks[joint];
+		if (track.Empty())
+			return false;
+		JointPose rest;
+		pose.translation = sampleKeys(track.positions, time, rest.translation);
+		pose.rotation = sampleKeys(track.rotations, time, rest.rotation);
+		pose.scale = sampleKeys(track.scales, time, rest.scale);
+		return true;
+	}
+
+	float GetDuration() override
+	{
+		return m_Duration;
+	}
+
+private:
+	std::vector<KeyframeTrack> m_Tracks;
+	float m_Duration;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#version 330 core
+// the lit surfaces of both the map (map.vs) and the characters (anim_model.vs)
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+in float ViewDepth;
+
+uniform sampler2D texture_diffuse1;
+
+// clustered lights, filled in by ClusteredLighting (clustered_lighting.h)
+uniform usamplerBuffer clusterCells;    // per cluster: first light index, light count
+uniform usamplerBuffer clusterIndices;  // light indices of all clusters, back to back
+uniform samplerBuffer clusterLights;    // per light: position and radius, then color
+uniform uvec3 clusterCount;
+uniform vec2 clusterViewport;
+uniform vec2 clusterDepthRange;         // view depth of the first and last slice
+uniform vec3 ambientLight;
+uniform int clusterLighting;
+
+// point light shadows, filled in by ShadowCache (shadow_cache.h): per casting light the
+// cached map of the dungeon and the overlay of the characters, as distance over radius
+const int MAX_SHADOW_CASTERS = 4;
+uniform samplerCube shadowStatic[MAX_SHADOW_CASTERS];
+uniform samplerCube shadowOverlay[MAX_SHADOW_CASTERS];
+uniform int shadowLights[MAX_SHADOW_CASTERS];   // light index per caster, -1 if none
+
+float pointShadow(samplerCube staticMap, samplerCube overlayMap, vec3 fromLight, float radius)
+{
+    float closest = min(texture(staticMap, fromLight).r, texture(overlayMap, fromLight).r) * radius;
+    return length(fromLight) - 0.05 > closest ? 0.0 : 1.0;
+}
+
+// sampler arrays only take constant indices in GLSL 3.30, hence the unrolled lookup
+float lightShadow(int index, vec3 fromLight, float radius)
+{
+    if (index == shadowLights[0])
+        return pointShadow(shadowStatic[0], shadowOverlay[0], fromLight, radius);
+    if (index == shadowLights[1])
+        return pointShadow(shadowStatic[1], shadowOverlay[1], fromLight, radius);
+    if (index == shadowLights[2])
+        return pointShadow(shadowStatic[2], shadowOverlay[2], fromLight, radius);
+    if (index == shadowLights[3])
+        return pointShadow(shadowStatic[3], shadowOverlay[3], fromLight, radius);
+    return 1.0;
+}
+
+// loops over the lights of this fragment's cluster only
+vec3 clusteredLight(vec3 position, vec3 normal)
+{
+    if (clusterLighting == 0)
+        return vec3(1.0);
+    vec2 tile = gl_FragCoord.xy / clusterViewport * vec2(clusterCount.xy);
+    float slice = (ViewDepth - clusterDepthRange.x) / (clusterDepthRange.y - clusterDepthRange.x) * float(clusterCount.z);
+    uvec3 cell = uvec3(clamp(vec3(tile, slice), vec3(0.0), vec3(clusterCount - 1u)));
+    uvec2 range = texelFetch(clusterCells, int((cell.z * clusterCount.y + cell.y) * clusterCount.x + cell.x)).xy;
+
+    vec3 light = ambientLight;
+    for (uint i = 0u; i < range.y; i++)
+    {
+        int index = int(texelFetch(clusterIndices, int(range.x + i)).x);
+        vec4 positionRadius = texelFetch(clusterLights, index * 2);
+        vec3 color = texelFetch(clusterLights, index * 2 + 1).rgb;
+        vec3 toLight = positionRadius.xyz - position;
+        float distance = length(toLight);
+        float falloff = clamp(1.0 - distance / positionRadius.w, 0.0, 1.0);
+        if (falloff <= 0.0)
+            continue;
+        float shadow = lightShadow(index, -toLight, positionRadius.w);
+        light += color * falloff * falloff * shadow * max(dot(normal, toLight / max(distance, 0.0001)), 0.0);
+    }
+    return light;
+}
+
+void main()
+{    
+    vec4 albedo = texture(texture_diffuse1, TexCoords);
+    FragColor = vec4(albedo.rgb * clusteredLight(FragPos, normalize(Normal)), albedo.a);
+}
@@ -0,0 +1,190 @@
+#ifndef NET_H
+#define NET_H
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// IPv4 host and port, both in host byte order
+struct NetAddress
+{
+	uint32_t host = 0;
+	uint16_t port = 0;
+
+	bool operator==(const NetAddress& other) const
+	{
+		return host == other.host && port == other.port;
+	}
+
+	bool operator<(const NetAddress& other) const
+	{
+		return host != other.host ? host < other.host : port < other.port;
+	}
+
+	// "host:port"; the host may be a name
+	static bool Parse(const std::string& text, NetAddress& address)
+	{
+		size_t colon = text.rfind(':');
+		if (colon == std::string::npos)
+			return false;
+		std::string host = text.substr(0, colon);
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_DGRAM;
+		addrinfo* result = NULL;
+		if (getaddrinfo(host.c_str(), NULL, &hints, &result) != 0 || !result)
+			return false;
+		address.host = ntohl(((sockaddr_in*)result->ai_addr)->sin_addr.s_addr);
+		address.port = (uint16_t)atoi(text.c_str() + colon + 1);
+		freeaddrinfo(result);
+		return address.port != 0;
+	}
+
+	std::string ToString() const
+	{
+		return std::to_string((host >> 24) & 0xff) + "." + std::to_string((host >> 16) & 0xff) + "." +
+			std::to_string((host >> 8) & 0xff) + "." + std::to_string(host & 0xff) + ":" + std::to_string(port);
+	}
+};
+
+// non-blocking UDP socket. sending from several threads at once is fine, receiving is
+// meant for one thread
+class UdpSocket
+{
+public:
+	~UdpSocket()
+	{
+		Close();
+	}
+
+	// port 0 picks any free port, as clients do
+	bool Open(uint16_t port)
+	{
+#ifdef _WIN32
+		WSADATA data;
+		WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+		m_Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (m_Socket == INVALID)
+		{
+			std::cout << "Failed to create UDP socket" << std::endl;
+			return false;
+		}
+
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+		if (bind(m_Socket, (sockaddr*)&address, sizeof(address)) != 0)
+		{
+			std::cout << "Failed to bind UDP port " << port << std::endl;
+			Close();
+			return false;
+		}
+
+#ifdef _WIN32
+		u_long nonBlocking = 1;
+		ioctlsocket(m_Socket, FIONBIO, &nonBlocking);
+#else
+		fcntl(m_Socket, F_SETFL, fcntl(m_Socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+		return true;
+	}
+
+	void Close()
+	{
+		if (m_Socket == INVALID)
+			return;
+#ifdef _WIN32
+		closesocket(m_Socket);
+		WSACleanup();
+#else
+		close(m_Socket);
+#endif
+		m_Socket = INVALID;
+	}
+
+	bool Send(const NetAddress& to, const void* data, size_t size)
+	{
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(to.host);
+		address.sin_port = htons(to.port);
+		return sendto(m_Socket, (const char*)data, (int)size, 0, (sockaddr*)&address, sizeof(address)) == (int)size;
+	}
+
+	// size of the datagram read, or -1 if none is waiting
+	int Receive(void* buffer, size_t size, NetAddress& from)
+	{
+		sockaddr_in address;
+		socklen_t length = sizeof(address);
+		int received = (int)recvfrom(m_Socket, (char*)buffer, (int)size, 0, (sockaddr*)&address, &length);
+		if (received < 0)
+			return -1;
+		from.host = ntohl(address.sin_addr.s_addr);
+		from.port = ntohs(address.sin_port);
+		return received;
+	}
+
+	// waits until a datagram arrives or the timeout runs out
+	bool Wait(int timeoutMs)
+	{
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(m_Socket, &readable);
+		timeval timeout;
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_usec = (timeoutMs % 1000) * 1000;
+		return select((int)m_Socket + 1, &readable, NULL, NULL, &timeout) > 0;
+	}
+
+private:
+#ifdef _WIN32
+	typedef SOCKET Handle;
+	static const Handle INVALID = INVALID_SOCKET;
+#else
+	typedef int Handle;
+	static const Handle INVALID = -1;
+#endif
+	Handle m_Socket = INVALID;
+};
+
+// arena protocol. every datagram starts with the protocol id and a packet type.
+//   HELLO    client -> server  join an arena
+//   WELCOME  server -> client  uint32 arena, float tick rate
+//   INPUT    client -> server  uint32 sequence, uint32 last snapshot tick received, uint32 intent
+//   SNAPSHOT server -> client  uint32 tick, uint32 base tick (NO_BASE for none), uint32 player
+//                              index and generation, then the world as a SnapshotDelta against
+//                              the base (against nothing for NO_BASE)
+//   BYE      either way        leave
+const uint32_t ARENA_PROTOCOL_ID = 0x4b4e4132; // "KNA2"
+const uint16_t ARENA_DEFAULT_PORT = 27015;
+const size_t ARENA_MAX_PACKET = 1400;
+const uint32_t ARENA_NO_BASE = 0xffffffff;
+
+enum ArenaPacket {
+	PACKET_HELLO = 1,
+	PACKET_WELCOME,
+	PACKET_INPUT,
+	PACKET_SNAPSHOT,
+	PACKET_BYE
+};
+
+#endif
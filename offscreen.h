@@ -0,0 +1,310 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// an OpenGL 3.3 core context without a window or display server, through EGL. the surfaceless
+// platform is tried first; it is what Mesa offers on machines without a GPU, where it renders
+// with its software rasterizer (llvmpipe). set LIBGL_ALWAYS_SOFTWARE=1 to force that on a
+// machine that has one. there is no default framebuffer, so draw into a RenderTarget
+class OffscreenContext
+{
+public:
+	~OffscreenContext()
+	{
+		Destroy();
+	}
+
+	bool Create()
+	{
+		m_Display = EGL_NO_DISPLAY;
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay)
+			m_Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (m_Display == EGL_NO_DISPLAY)
+			m_Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint major = 0, minor = 0;
+		if (m_Display == EGL_NO_DISPLAY || !eglInitialize(m_Display, &major, &minor))
+		{
+			std::cout << "Failed to initialize EGL" << std::endl;
+			return false;
+		}
+		if (!eglBindAPI(EGL_OPENGL_API))
+		{
+			std::cout << "EGL has no desktop OpenGL" << std::endl;
+			return false;
+		}
+
+		// no surface is ever made and the render target brings its own color and depth,
+		// so any config that can run desktop GL will do
+		const EGLint configAttributes[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_SURFACE_TYPE, 0,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint configCount = 0;
+		if (!eglChooseConfig(m_Display, configAttributes, &config, 1, &configCount) || configCount == 0)
+		{
+			std::cout << "No suitable EGL config" << std::endl;
+			return false;
+		}
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		m_Context = eglCreateContext(m_Display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (m_Context == EGL_NO_CONTEXT || !eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_Context))
+		{
+			std::cout << "Failed to create an OpenGL 3.3 context through EGL" << std::endl;
+			return false;
+		}
+		std::cout << "Offscreen context: EGL " << major << "." << minor << std::endl;
+		return true;
+	}
+
+	void Destroy()
+	{
+		if (m_Display == EGL_NO_DISPLAY)
+			return;
+		eglMakeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (m_Context != EGL_NO_CONTEXT)
+			eglDestroyContext(m_Display, m_Context);
+		eglTerminate(m_Display);
+		m_Display = EGL_NO_DISPLAY;
+		m_Context = EGL_NO_CONTEXT;
+	}
+
+	// for gladLoadGLLoader
+	static void* GetProcAddress(const char* name)
+	{
+		return (void*)eglGetProcAddress(name);
+	}
+
+private:
+	EGLDisplay m_Display = EGL_NO_DISPLAY;
+	EGLContext m_Context = EGL_NO_CONTEXT;
+};
+
+// framebuffer object with an RGBA8 color texture and a depth buffer
+class RenderTarget
+{
+public:
+	bool Create(unsigned int width, unsigned int height)
+	{
+		m_Width = width;
+		m_Height = height;
+		glGenFramebuffers(1, &m_Framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+
+		glGenTextures(1, &m_Color);
+		glBindTexture(GL_TEXTURE_2D, m_Color);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Color, 0);
+
+		glGenRenderbuffers(1, &m_Depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, m_Depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_Depth);
+
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if (!complete)
+			std::cout << "Offscreen framebuffer is incomplete" << std::endl;
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return complete;
+	}
+
+	void Destroy()
+	{
+		if (m_Framebuffer)
+		{
+			glDeleteFramebuffers(1, &m_Framebuffer);
+			glDeleteTextures(1, &m_Color);
+			glDeleteRenderbuffers(1, &m_Depth);
+		}
+		m_Framebuffer = m_Color = m_Depth = 0;
+	}
+
+	void Bind()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+		glViewport(0, 0, m_Width, m_Height);
+	}
+
+	// RGBA8, rows top to bottom as in an image file
+	void ReadPixels(std::vector<uint8_t>& rgba)
+	{
+		size_t rowBytes = (size_t)m_Width * 4;
+		rgba.resize(rowBytes * m_Height);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, m_Framebuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, m_Width, m_Height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+
+		std::vector<uint8_t> row(rowBytes);
+		for (unsigned int y = 0; y < m_Height / 2; y++)
+		{
+			uint8_t* top = &rgba[y * rowBytes];
+			uint8_t* bottom = &rgba[(m_Height - 1 - y) * rowBytes];
+			memcpy(row.data(), top, rowBytes);
+			memcpy(top, bottom, rowBytes);
+			memcpy(bottom, row.data(), rowBytes);
+		}
+	}
+
+	unsigned int GetWidth() const
+	{
+		return m_Width;
+	}
+
+	unsigned int GetHeight() const
+	{
+		return m_Height;
+	}
+
+private:
+	unsigned int m_Framebuffer = 0;
+	unsigned int m_Color = 0;
+	unsigned int m_Depth = 0;
+	unsigned int m_Width = 0;
+	unsigned int m_Height = 0;
+};
+
+// writes an RGBA8 image as PNG. the deflate stream uses stored blocks only: captures are
+// for comparing, not for keeping, and this avoids depending on zlib
+inline bool WritePng(const std::string& path, unsigned int width, unsigned int height, const std::vector<uint8_t>& rgba)
+{
+	struct Crc
+	{
+		uint32_t table[256];
+		Crc()
+		{
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+		}
+		uint32_t Update(uint32_t crc, const uint8_t* data, size_t size) const
+		{
+			for (size_t i = 0; i < size; i++)
+				crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+			return crc;
+		}
+	};
+	static const Crc crc;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "Failed to open " << path << " for writing" << std::endl;
+		return false;
+	}
+	auto bigEndian = [](std::vector<uint8_t>& out, uint32_t value) {
+		out.push_back((uint8_t)(value >> 24));
+		out.push_back((uint8_t)(value >> 16));
+		out.push_back((uint8_t)(value >> 8));
+		out.push_back((uint8_t)value);
+	};
+	auto writeChunk = [&](const char* type, const std::vector<uint8_t>& data) {
+		std::vector<uint8_t> chunk;
+		bigEndian(chunk, (uint32_t)data.size());
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		bigEndian(chunk, crc.Update(0xffffffffu, &chunk[4], chunk.size() - 4) ^ 0xffffffffu);
+		file.write((const char*)chunk.data(), chunk.size());
+	};
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	file.write((const char*)signature, sizeof(signature));
+
+	std::vector<uint8_t> header;
+	bigEndian(header, width);
+	bigEndian(header, height);
+	header.push_back(8);   // bit depth
+	header.push_back(6);   // RGBA
+	header.push_back(0);   // deflate
+	header.push_back(0);   // adaptive filtering
+	header.push_back(0);   // not interlaced
+	writeChunk("IHDR", header);
+
+	// every row is prefixed with filter type 0, then split into stored blocks of up to 65535 bytes
+	size_t rowBytes = (size_t)width * 4;
+	std::vector<uint8_t> raw;
+	raw.reserve((rowBytes + 1) * height);
+	for (unsigned int y = 0; y < height; y++)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), rgba.begin() + y * rowBytes, rgba.begin() + (y + 1) * rowBytes);
+	}
+	std::vector<uint8_t> deflated;
+	deflated.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	deflated.push_back(0x78);
+	deflated.push_back(0x01);
+	uint32_t a = 1, b = 0;
+	size_t offset = 0;
+	do
+	{
+		size_t size = std::min(raw.size() - offset, (size_t)65535);
+		bool last = offset + size == raw.size();
+		deflated.push_back(last ? 1 : 0);
+		deflated.push_back((uint8_t)size);
+		deflated.push_back((uint8_t)(size >> 8));
+		deflated.push_back((uint8_t)~size);
+		deflated.push_back((uint8_t)(~size >> 8));
+		deflated.insert(deflated.end(), raw.begin() + offset, raw.begin() + offset + size);
+		for (size_t i = offset; i < offset + size; i++)
+		{
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		offset += size;
+	} while (offset < raw.size());
+	bigEndian(deflated, (b << 16) | a);
+	writeChunk("IDAT", deflated);
+	writeChunk("IEND", std::vector<uint8_t>());
+	return (bool)file;
+}
+
+// a pixel differs when any channel is off by more than the tolerance
+struct ImageDiff
+{
+	size_t differingPixels = 0;
+	int maxDelta = 0;
+};
+
+inline ImageDiff CompareImages(const uint8_t* a, const uint8_t* b, size_t pixels, int tolerance)
+{
+	ImageDiff diff;
+	for (size_t i = 0; i < pixels; i++)
+	{
+		int delta = 0;
+		for (int c = 0; c < 4; c++)
+			delta = std::max(delta, std::abs((int)a[i * 4 + c] - (int)b[i * 4 + c]));
+		if (delta > tolerance)
+			diff.differingPixels++;
+		diff.maxDelta = std::max(diff.maxDelta, delta);
+	}
+	return diff;
+}
+
+#endif
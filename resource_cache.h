@@ -0,0 +1,707 @@
+#ifndef RESOURCE_CACHE_H
+#define RESOURCE_CACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <learnopengl/assimp_glm_helpers.h>
+#include <learnopengl/animdata.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/stb_image.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// flattened node hierarchy shared by every clip that animates the same skeleton
+// (nodes are stored parent-before-child, so one forward pass evaluates the whole tree)
+struct SkeletonHierarchy
+{
+	std::vector<std::string> names;
+	std::vector<int> parents;
+	std::vector<glm::mat4> transforms;
+	uint64_t hash = 0;
+};
+
+// a mesh's vertices and indices, hashed when read. shared by the cache entry holding its
+// buffers and every model drawing them; kept on the CPU to confirm hash matches and for the nav grid
+struct MeshGeometry
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	uint64_t hash = 0;
+};
+
+// a model file parsed and its textures decoded, without touching GL: what LearnOpenGL's Model
+// reads in its constructor, produced by ResourceCache::LoadModelData on any thread and uploaded
+// by ResourceCache::AcquireModel on the GL thread
+struct ModelData
+{
+	struct MeshData
+	{
+		std::shared_ptr<const MeshGeometry> geometry;
+		std::vector<unsigned int> textures;        // into ModelData::textures
+	};
+
+	struct TextureData
+	{
+		std::string path;                          // as the material names it, relative to the model
+		std::string type;                          // texture_diffuse, texture_specular, ...
+		uint64_t key = 0;
+		int width = 0;
+		int height = 0;
+		int components = 0;
+		std::shared_ptr<unsigned char> pixels;     // null when the cache already had the texture
+	};
+
+	uint64_t key = 0;                              // 0 when the file couldn't be read
+	std::string directory;
+	bool gamma = false;
+	std::vector<MeshData> meshes;
+	std::vector<TextureData> textures;
+	std::map<std::string, BoneInfo> boneInfo;
+	int boneCount = 0;
+};
+
+// a model as the cache uploaded it, drawn like LearnOpenGL's Model. its buffers and textures
+// belong to the cache and may be shared with other models
+class CachedModel
+{
+public:
+	struct DrawMesh
+	{
+		unsigned int VAO = 0;
+		std::shared_ptr<const MeshGeometry> geometry;
+		std::vector<Texture> textures;
+	};
+
+	std::vector<DrawMesh> meshes;
+	std::vector<unsigned int> textures;            // a cache reference each
+	std::map<std::string, BoneInfo> boneInfo;       // palette slots of the bones that skin the meshes
+
+	// as Mesh::Draw: samplers are named after the texture type and numbered per type
+	void Draw(Shader& shader) const
+	{
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			const DrawMesh& mesh = meshes[m];
+			unsigned int diffuseNr = 1;
+			unsigned int specularNr = 1;
+			unsigned int normalNr = 1;
+			unsigned int heightNr = 1;
+			for (unsigned int i = 0; i < mesh.textures.size(); i++)
+			{
+				glActiveTexture(GL_TEXTURE0 + i);
+				const std::string& name = mesh.textures[i].type;
+				std::string number;
+				if (name == "texture_diffuse")
+					number = std::to_string(diffuseNr++);
+				else if (name == "texture_specular")
+					number = std::to_string(specularNr++);
+				else if (name == "texture_normal")
+					number = std::to_string(normalNr++);
+				else if (name == "texture_height")
+					number = std::to_string(heightNr++);
+				glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+				glBindTexture(GL_TEXTURE_2D, mesh.textures[i].id);
+			}
+
+			glBindVertexArray(mesh.VAO);
+			glDrawElements(GL_TRIANGLES, (GLsizei)mesh.geometry->indices.size(), GL_UNSIGNED_INT, 0);
+			glBindVertexArray(0);
+			glActiveTexture(GL_TEXTURE0);
+		}
+	}
+};
+
+// process-wide cache of GPU and CPU resources, keyed by a hash of their content.
+// identical textures, mesh buffers and skeletons are decoded/uploaded once and reference counted;
+// GL objects are only released when the last owner lets go (must happen on the GL thread).
+class ResourceCache
+{
+public:
+	struct Stats
+	{
+		unsigned int modelHits = 0;
+		unsigned int modelMisses = 0;
+		unsigned int textureHits = 0;
+		unsigned int textureMisses = 0;
+		unsigned int meshHits = 0;
+		unsigned int meshMisses = 0;
+		unsigned int skeletonHits = 0;
+		unsigned int skeletonMisses = 0;
+	};
+
+	static ResourceCache& Get()
+	{
+		static ResourceCache cache;
+		return cache;
+	}
+
+	// FNV-1a, good enough to key assets and cheap compared to decoding them
+	static uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// hash of a file's content; 0 when the file can't be read
+	uint64_t HashFile(const std::string& path)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_PathHashes.find(path);
+			if (it != m_PathHashes.end())
+				return it->second;
+		}
+
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return 0;
+		std::vector<char> buffer(1 << 16);
+		uint64_t hash = 14695981039346656037ull;
+		while (file)
+		{
+			file.read(buffer.data(), buffer.size());
+			hash = HashBytes(buffer.data(), (size_t)file.gcount(), hash);
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_PathHashes[path] = hash;
+		return hash;
+	}
+
+	// the assimp import and the image decoding of a model, no GL involved, so any thread may call
+	// it. textures the cache holds already aren't decoded again. data is left empty if assimp
+	// can't read the file
+	bool LoadModelData(const std::string& path, ModelData& data, bool gamma = false)
+	{
+		data = ModelData();
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+		{
+			std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+			return false;
+		}
+		data.key = ContentKey(path, gamma);
+		data.directory = path.substr(0, path.find_last_of('/'));
+		data.gamma = gamma;
+		ReadNode(scene->mRootNode, scene, data);
+
+		for (unsigned int i = 0; i < data.textures.size(); i++)
+		{
+			ModelData::TextureData& texture = data.textures[i];
+			texture.key = ContentKey(data.directory + '/' + texture.path, gamma);
+			bool cached;
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				cached = texture.key != 0 && m_Textures.count(texture.key) != 0;
+			}
+			if (!cached)
+				DecodeTexture(data.directory, texture);
+		}
+		return true;
+	}
+
+	// returns the shared instance of a model; the same file (or an identical copy of it) already
+	// resident only bumps a reference count. otherwise data is uploaded, with textures and mesh
+	// buffers identical to ones owned by other models folded into the cached GL objects
+	std::shared_ptr<CachedModel> AcquireModel(ModelData& data)
+	{
+		uint64_t key = data.key;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_Models.find(key);
+			if (key != 0 && it != m_Models.end())
+			{
+				if (std::shared_ptr<CachedModel> model = it->second.lock())
+				{
+					m_Stats.modelHits++;
+					return model;
+				}
+			}
+			m_Stats.modelMisses++;
+		}
+
+		CachedModel* loaded = new CachedModel();
+		loaded->boneInfo = data.boneInfo;
+		std::vector<unsigned int> ids(data.textures.size(), 0);
+		for (unsigned int i = 0; i < data.textures.size(); i++)
+		{
+			ids[i] = AcquireTexture(data.textures[i], data.directory, data.gamma);
+			if (ids[i] != 0)
+				loaded->textures.push_back(ids[i]);
+		}
+		for (unsigned int i = 0; i < data.meshes.size(); i++)
+		{
+			const ModelData::MeshData& source = data.meshes[i];
+			CachedModel::DrawMesh mesh;
+			mesh.geometry = source.geometry;
+			mesh.VAO = AcquireMesh(mesh.geometry);
+			for (unsigned int j = 0; j < source.textures.size(); j++)
+			{
+				const ModelData::TextureData& texture = data.textures[source.textures[j]];
+				Texture drawn;
+				drawn.id = ids[source.textures[j]];
+				drawn.type = texture.type;
+				drawn.path = texture.path;
+				mesh.textures.push_back(drawn);
+			}
+			loaded->meshes.push_back(std::move(mesh));
+		}
+
+		std::shared_ptr<CachedModel> model(loaded, [this, key](CachedModel* m) {
+			ReleaseModelResources(*m);
+			delete m;
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_Models.find(key);
+			if (it != m_Models.end() && it->second.expired())
+				m_Models.erase(it);
+		});
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (key != 0)
+			m_Models[key] = model;
+		return model;
+	}
+
+	void ReleaseTexture(unsigned int id)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto key = m_TextureKeys.find(id);
+		if (key == m_TextureKeys.end())
+			return;
+		auto it = m_Textures.find(key->second);
+		if (--it->second.refs == 0)
+		{
+			glDeleteTextures(1, &id);
+			m_ResidentBytes -= it->second.bytes;
+			m_Textures.erase(it);
+			m_TextureKeys.erase(key);
+		}
+	}
+
+	// interns the node hierarchy of a clip file; clips of the same rig share one copy. the nodes
+	// are only hashed on the way down, and flattened when the rig isn't cached yet. any thread
+	std::shared_ptr<const SkeletonHierarchy> AcquireSkeleton(const aiNode* root)
+	{
+		int count = 0;
+		uint64_t hash = HashHierarchy(root, -1, count, 14695981039346656037ull);
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_Skeletons.find(hash);
+			if (it != m_Skeletons.end())
+			{
+				if (std::shared_ptr<const SkeletonHierarchy> shared = it->second.lock())
+				{
+					m_Stats.skeletonHits++;
+					return shared;
+				}
+			}
+		}
+
+		SkeletonHierarchy skeleton;
+		skeleton.names.reserve(count);
+		skeleton.parents.reserve(count);
+		skeleton.transforms.reserve(count);
+		FlattenHierarchy(root, -1, skeleton);
+		skeleton.hash = hash;
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_Skeletons.find(hash);
+		if (it != m_Skeletons.end())
+		{
+			// flattened by another clip meanwhile
+			if (std::shared_ptr<const SkeletonHierarchy> shared = it->second.lock())
+			{
+				m_Stats.skeletonHits++;
+				return shared;
+			}
+		}
+		m_Stats.skeletonMisses++;
+		// the entry goes with the last clip that shares it
+		std::shared_ptr<const SkeletonHierarchy> shared(new SkeletonHierarchy(std::move(skeleton)), [this, hash](const SkeletonHierarchy* s) {
+			delete s;
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_Skeletons.find(hash);
+			if (it != m_Skeletons.end() && it->second.expired())
+				m_Skeletons.erase(it);
+		});
+		m_Skeletons[hash] = shared;
+		return shared;
+	}
+
+	// GPU memory of every cached texture and mesh, each counted once however many models share it
+	size_t GetResidentBytes()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_ResidentBytes;
+	}
+
+	Stats GetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Stats;
+	}
+
+	void PrintStats()
+	{
+		Stats stats = GetStats();
+		std::cout << "Resource cache: models " << stats.modelHits << " shared / " << stats.modelMisses << " loaded, "
+			<< "textures " << stats.textureHits << " / " << stats.textureMisses << ", "
+			<< "meshes " << stats.meshHits << " / " << stats.meshMisses << ", "
+			<< "skeletons " << stats.skeletonHits << " / " << stats.skeletonMisses << std::endl;
+	}
+
+private:
+	struct GpuTexture
+	{
+		unsigned int id;
+		unsigned int refs;
+		size_t bytes;
+	};
+
+	struct GpuMesh
+	{
+		unsigned int VAO;
+		unsigned int VBO;
+		unsigned int EBO;
+		unsigned int refs;
+		size_t bytes;
+		std::shared_ptr<const MeshGeometry> geometry;
+	};
+	typedef std::multimap<uint64_t, GpuMesh> MeshMap;
+
+	ResourceCache() {}
+	ResourceCache(const ResourceCache&) = delete;
+	ResourceCache& operator=(const ResourceCache&) = delete;
+
+	// both walk the nodes parent first, numbering them in the same order
+	static uint64_t HashHierarchy(const aiNode* node, int parent, int& count, uint64_t hash)
+	{
+		int index = count++;
+		glm::mat4 transform = AssimpGLMHelpers::ConvertMatrixToGLMFormat(node->mTransformation);
+		hash = HashBytes(node->mName.data, node->mName.length, hash);
+		hash = HashBytes(&parent, sizeof(int), hash);
+		hash = HashBytes(&transform, sizeof(glm::mat4), hash);
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+			hash = HashHierarchy(node->mChildren[i], index, count, hash);
+		return hash;
+	}
+
+	static void FlattenHierarchy(const aiNode* node, int parent, SkeletonHierarchy& out)
+	{
+		int index = (int)out.names.size();
+		out.names.push_back(std::string(node->mName.data, node->mName.length));
+		out.parents.push_back(parent);
+		out.transforms.push_back(AssimpGLMHelpers::ConvertMatrixToGLMFormat(node->mTransformation));
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+			FlattenHierarchy(node->mChildren[i], index, out);
+	}
+
+	// textures decoded for gamma correction are different GL objects from the same file's linear
+	// ones, and so are the models holding them
+	uint64_t ContentKey(const std::string& path, bool gamma)
+	{
+		uint64_t key = HashFile(path);
+		if (key == 0)
+			return 0;
+		unsigned char srgb = gamma ? 1 : 0;
+		return HashBytes(&srgb, 1, key);
+	}
+
+	// Model::processNode and processMesh without the upload: meshes in node order, each
+	// material's textures listed once per model
+	static void ReadNode(const aiNode* node, const aiScene* scene, ModelData& data)
+	{
+		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+			ReadMesh(scene->mMeshes[node->mMeshes[i]], scene, data);
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+			ReadNode(node->mChildren[i], scene, data);
+	}
+
+	static void ReadMesh(const aiMesh* mesh, const aiScene* scene, ModelData& data)
+	{
+		std::shared_ptr<MeshGeometry> geometry = std::make_shared<MeshGeometry>();
+		// zeroed, so the unused fields hash and compare alike
+		geometry->vertices.assign(mesh->mNumVertices, Vertex());
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+		{
+			Vertex& vertex = geometry->vertices[i];
+			for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+				vertex.m_BoneIDs[j] = -1;
+			vertex.Position = AssimpGLMHelpers::GetGLMVec(mesh->mVertices[i]);
+			if (mesh->HasNormals())
+				vertex.Normal = AssimpGLMHelpers::GetGLMVec(mesh->mNormals[i]);
+			if (mesh->mTextureCoords[0])
+				vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+			if (mesh->HasTangentsAndBitangents())
+			{
+				vertex.Tangent = AssimpGLMHelpers::GetGLMVec(mesh->mTangents[i]);
+				vertex.Bitangent = AssimpGLMHelpers::GetGLMVec(mesh->mBitangents[i]);
+			}
+		}
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+		{
+			const aiFace& face = mesh->mFaces[i];
+			geometry->indices.insert(geometry->indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+		}
+		ReadBoneWeights(mesh, geometry->vertices, data);
+		geometry->hash = HashBytes(geometry->vertices.data(), geometry->vertices.size() * sizeof(Vertex));
+		geometry->hash = HashBytes(geometry->indices.data(), geometry->indices.size() * sizeof(unsigned int), geometry->hash);
+
+		ModelData::MeshData out;
+		out.geometry = geometry;
+		const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+		ReadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data, out);
+		ReadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data, out);
+		ReadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data, out);
+		ReadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data, out);
+		data.meshes.push_back(std::move(out));
+	}
+
+	// Model::ExtractBoneWeightForVertices: bones get palette slots in the order they are met
+	static void ReadBoneWeights(const aiMesh* mesh, std::vector<Vertex>& vertices, ModelData& data)
+	{
+		for (unsigned int b = 0; b < mesh->mNumBones; b++)
+		{
+			const aiBone* bone = mesh->mBones[b];
+			std::string name = bone->mName.C_Str();
+			auto it = data.boneInfo.find(name);
+			if (it == data.boneInfo.end())
+			{
+				BoneInfo info;
+				info.id = data.boneCount++;
+				info.offset = AssimpGLMHelpers::ConvertMatrixToGLMFormat(bone->mOffsetMatrix);
+				it = data.boneInfo.insert(std::make_pair(name, info)).first;
+			}
+			for (unsigned int w = 0; w < bone->mNumWeights; w++)
+			{
+				const aiVertexWeight& weight = bone->mWeights[w];
+				if (weight.mVertexId >= vertices.size())
+					continue;
+				Vertex& vertex = vertices[weight.mVertexId];
+				for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+				{
+					if (vertex.m_BoneIDs[j] < 0)
+					{
+						vertex.m_BoneIDs[j] = it->second.id;
+						vertex.m_Weights[j] = weight.mWeight;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	static void ReadMaterialTextures(const aiMaterial* material, aiTextureType type, const char* typeName, ModelData& data, ModelData::MeshData& mesh)
+	{
+		for (unsigned int i = 0; i < material->GetTextureCount(type); i++)
+		{
+			aiString path;
+			material->GetTexture(type, i, &path);
+			unsigned int index = 0;
+			while (index < data.textures.size() && data.textures[index].path != path.C_Str())
+				index++;
+			if (index == data.textures.size())
+			{
+				ModelData::TextureData texture;
+				texture.path = path.C_Str();
+				texture.type = typeName;
+				data.textures.push_back(texture);
+			}
+			mesh.textures.push_back(index);
+		}
+	}
+
+	// stb_image flips on load as set up at startup, before the streaming thread exists
+	static void DecodeTexture(const std::string& directory, ModelData::TextureData& texture)
+	{
+		std::string filename = directory + '/' + texture.path;
+		texture.pixels.reset(stbi_load(filename.c_str(), &texture.width, &texture.height, &texture.components, 0), stbi_image_free);
+		if (!texture.pixels)
+			std::cout << "Texture failed to load at path: " << texture.path << std::endl;
+	}
+
+	// the upload half of TextureFromFile; 0 if the image couldn't be decoded
+	static unsigned int UploadTexture(const ModelData::TextureData& texture, bool gamma)
+	{
+		if (!texture.pixels)
+			return 0;
+		GLenum format = GL_RGBA;
+		if (texture.components == 1)
+			format = GL_RED;
+		else if (texture.components == 3)
+			format = GL_RGB;
+		GLenum internalFormat = format;
+		if (gamma && format != GL_RED)
+			internalFormat = format == GL_RGB ? GL_SRGB : GL_SRGB_ALPHA;
+
+		unsigned int id;
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, texture.width, texture.height, 0, format, GL_UNSIGNED_BYTE, texture.pixels.get());
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return id;
+	}
+
+	// one more reference to a cached texture, or the texture uploaded as a new entry. the pixels
+	// are decoded here after all if the copy that was cached when the model was read is gone
+	unsigned int AcquireTexture(ModelData::TextureData& texture, const std::string& directory, bool gamma)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto it = m_Textures.find(texture.key);
+			if (texture.key != 0 && it != m_Textures.end())
+			{
+				it->second.refs++;
+				m_Stats.textureHits++;
+				return it->second.id;
+			}
+		}
+
+		if (!texture.pixels)
+			DecodeTexture(directory, texture);
+		unsigned int id = UploadTexture(texture, gamma);
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.textureMisses++;
+		if (id != 0 && texture.key != 0)
+		{
+			size_t bytes = (size_t)texture.width * texture.height * 4 * 4 / 3; // rgba8 + mip chain
+			m_Textures[texture.key] = { id, 1, bytes };
+			m_TextureKeys[id] = texture.key;
+			m_ResidentBytes += bytes;
+		}
+		return id;
+	}
+
+	// the VAO drawing geometry: a cached mesh's when the content is the same, whose geometry then
+	// replaces the caller's copy, or new buffers as Mesh::setupMesh makes them
+	unsigned int AcquireMesh(std::shared_ptr<const MeshGeometry>& geometry)
+	{
+		{
+			// equal hashes are only taken as equal content once the bytes agree
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto range = m_Meshes.equal_range(geometry->hash);
+			for (MeshMap::iterator it = range.first; it != range.second; ++it)
+			{
+				if (SameGeometry(*it->second.geometry, *geometry))
+				{
+					it->second.refs++;
+					m_Stats.meshHits++;
+					geometry = it->second.geometry;
+					return it->second.VAO;
+				}
+			}
+		}
+
+		GpuMesh cached;
+		UploadMesh(*geometry, cached);
+		cached.refs = 1;
+		cached.bytes = geometry->vertices.size() * sizeof(Vertex) + geometry->indices.size() * sizeof(unsigned int);
+		cached.geometry = geometry;
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.meshMisses++;
+		m_ResidentBytes += cached.bytes;
+		unsigned int VAO = cached.VAO;
+		m_MeshKeys[VAO] = m_Meshes.insert(std::make_pair(geometry->hash, cached));
+		return VAO;
+	}
+
+	static bool SameGeometry(const MeshGeometry& a, const MeshGeometry& b)
+	{
+		return a.vertices.size() == b.vertices.size() && a.indices.size() == b.indices.size()
+			&& std::memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(Vertex)) == 0
+			&& std::memcmp(a.indices.data(), b.indices.data(), a.indices.size() * sizeof(unsigned int)) == 0;
+	}
+
+	// Mesh::setupMesh's layout, which the shaders' attribute locations follow
+	static void UploadMesh(const MeshGeometry& geometry, GpuMesh& mesh)
+	{
+		glGenVertexArrays(1, &mesh.VAO);
+		glGenBuffers(1, &mesh.VBO);
+		glGenBuffers(1, &mesh.EBO);
+
+		glBindVertexArray(mesh.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+		glBufferData(GL_ARRAY_BUFFER, geometry.vertices.size() * sizeof(Vertex), geometry.vertices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, geometry.indices.size() * sizeof(unsigned int), geometry.indices.data(), GL_STATIC_DRAW);
+
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		glEnableVertexAttribArray(5);
+		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+		glEnableVertexAttribArray(6);
+		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+		glBindVertexArray(0);
+	}
+
+	void ReleaseModelResources(CachedModel& model)
+	{
+		for (unsigned int i = 0; i < model.textures.size(); i++)
+			ReleaseTexture(model.textures[i]);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (unsigned int i = 0; i < model.meshes.size(); i++)
+		{
+			auto key = m_MeshKeys.find(model.meshes[i].VAO);
+			if (key == m_MeshKeys.end())
+				continue;
+			MeshMap::iterator it = key->second;
+			if (--it->second.refs == 0)
+			{
+				glDeleteVertexArrays(1, &it->second.VAO);
+				glDeleteBuffers(1, &it->second.VBO);
+				glDeleteBuffers(1, &it->second.EBO);
+				m_ResidentBytes -= it->second.bytes;
+				m_Meshes.erase(it);
+				m_MeshKeys.erase(key);
+			}
+		}
+	}
+
+	std::mutex m_Mutex;
+	std::map<std::string, uint64_t> m_PathHashes;
+	std::map<uint64_t, std::weak_ptr<CachedModel>> m_Models;
+	std::map<uint64_t, GpuTexture> m_Textures;
+	std::map<unsigned int, uint64_t> m_TextureKeys;
+	MeshMap m_Meshes;
+	std::map<unsigned int, MeshMap::iterator> m_MeshKeys;
+	std::map<uint64_t, std::weak_ptr<const SkeletonHierarchy>> m_Skeletons;
+	size_t m_ResidentBytes = 0;
+	Stats m_Stats;
+};
+
+#endif
@@ -0,0 +1,366 @@
+#ifndef SHADOW_CACHE_H
+#define SHADOW_CACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include "clustered_lighting.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// cube shadow maps for the few point lights nearest the focus (the player), split in two:
+// a static map holding what never moves (the dungeon), rendered once when a light starts
+// casting or moves, and a small overlay rendered every frame with just the characters near
+// the light. lookups take the nearer of the two, see lit.fs.
+//
+// each map stores the distance to the light over the light's radius, LearnOpenGL point
+// shadow style, one face at a time. a light's static map stays valid until the light moves
+// or is invalidated; lights keep their slot while they stay among the nearest, so walking
+// around re-renders only the maps of lights that newly came into range
+class ShadowCache
+{
+public:
+	static const int MAX_CASTERS = 4;
+	static const int STATIC_SIZE = 512;
+	static const int OVERLAY_SIZE = 256;
+
+	// texture units, after the clustered lighting's
+	static const int FIRST_TEXTURE_UNIT = ClusteredLighting::FIRST_TEXTURE_UNIT + 3;
+
+	// per frame. the GPU times are of earlier frames' passes: those whose timings arrived since
+	// the last frame, summed. usually one, none while the GPU is behind
+	struct Stats
+	{
+		unsigned int casters = 0;
+		unsigned int staticRenders = 0;   // static maps rendered this frame
+		unsigned int overlayRenders = 0;  // overlays with characters in them
+		unsigned int timed = 0;           // frames the GPU times below are of
+		float staticMs = 0.0f;
+		float overlayMs = 0.0f;
+		float maxMs = 0.0f;               // the longest of those frames, both passes
+	};
+
+	~ShadowCache()
+	{
+		Release();
+	}
+
+	// full: no caching, every caster's map is rendered from scratch each frame with the
+	// characters in it, for comparing against
+	void Init(bool full)
+	{
+		m_Full = full;
+		for (int i = 0; i < MAX_CASTERS; i++)
+		{
+			CreateMap(m_Slots[i].staticMap, STATIC_SIZE);
+			CreateMap(m_Slots[i].overlayMap, OVERLAY_SIZE);
+			ClearMap(m_Slots[i].overlayMap);
+		}
+		glGenQueries(QUERY_FRAMES * 2, m_Queries);
+	}
+
+	void Release()
+	{
+		if (!m_Queries[0])
+			return;
+		for (int i = 0; i < MAX_CASTERS; i++)
+		{
+			DestroyMap(m_Slots[i].staticMap);
+			DestroyMap(m_Slots[i].overlayMap);
+			m_Slots[i] = Slot();
+		}
+		glDeleteQueries(QUERY_FRAMES * 2, m_Queries);
+		for (unsigned int i = 0; i < QUERY_FRAMES * 2; i++)
+			m_Queries[i] = 0;
+		m_Next = 0;
+		m_Pending = 0;
+	}
+
+	// re-renders a light's static map the next time it casts
+	void Invalidate(int light)
+	{
+		for (int i = 0; i < MAX_CASTERS; i++)
+			if (m_Slots[i].light == light)
+				m_Slots[i].valid = false;
+	}
+
+	void InvalidateAll()
+	{
+		for (int i = 0; i < MAX_CASTERS; i++)
+			m_Slots[i].valid = false;
+	}
+
+	// picks this frame's casters, the lights nearest the focus. lights still among them keep
+	// their slot and their static map
+	void SelectCasters(const std::vector<PointLight>& lights, const glm::vec3& focus)
+	{
+		m_Nearest.clear();
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			glm::vec3 d = lights[i].position - focus;
+			m_Nearest.push_back(std::make_pair(glm::dot(d, d), (int)i));
+		}
+		size_t count = std::min(m_Nearest.size(), (size_t)MAX_CASTERS);
+		std::partial_sort(m_Nearest.begin(), m_Nearest.begin() + count, m_Nearest.end());
+
+		bool keep[MAX_CASTERS] = {};
+		for (size_t n = 0; n < count; n++)
+			for (int i = 0; i < MAX_CASTERS; i++)
+				if (m_Slots[i].light == m_Nearest[n].second)
+					keep[i] = true;
+		for (int i = 0; i < MAX_CASTERS; i++)
+			if (!keep[i])
+				m_Slots[i].light = NO_LIGHT;
+
+		for (size_t n = 0; n < count; n++)
+		{
+			int light = m_Nearest[n].second;
+			int free = -1;
+			for (int i = 0; i < MAX_CASTERS && light != NO_LIGHT; i++)
+			{
+				if (m_Slots[i].light == light)
+					light = NO_LIGHT;
+				else if (free < 0 && m_Slots[i].light == NO_LIGHT)
+					free = i;
+			}
+			if (light != NO_LIGHT && free >= 0)
+			{
+				m_Slots[free].light = light;
+				m_Slots[free].valid = false;
+			}
+		}
+
+		// a light that moved invalidates its own map only
+		for (int i = 0; i < MAX_CASTERS; i++)
+		{
+			Slot& slot = m_Slots[i];
+			if (slot.light == NO_LIGHT)
+				continue;
+			const PointLight& light = lights[slot.light];
+			if (light.position != slot.position || light.radius != slot.radius)
+				slot.valid = false;
+			slot.position = light.position;
+			slot.radius = light.radius;
+		}
+	}
+
+	// renders the static maps that are out of date. drawStatic(depthShader) draws the static
+	// geometry with the shader in use and its view uniforms set; in full mode drawDynamic
+	// (below) is called into the same map right after
+	template <typename DrawStatic, typename DrawDynamic>
+	void Render(Shader& staticShader, Shader& dynamicShader, DrawStatic drawStatic, DrawDynamic drawDynamic)
+	{
+		m_Stats = Stats();
+		GLint viewport[4];
+		GLint framebuffer = 0;
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+		ReadQueries();
+
+		// all in flight: skip timing this frame rather than wait
+		bool timing = m_Pending < QUERY_FRAMES;
+		if (timing)
+			glBeginQuery(GL_TIME_ELAPSED, m_Queries[m_Next * 2]);
+		for (int i = 0; i < MAX_CASTERS; i++)
+		{
+			Slot& slot = m_Slots[i];
+			if (slot.light == NO_LIGHT)
+				continue;
+			m_Stats.casters++;
+			if (slot.valid && !m_Full)
+				continue;
+			for (int face = 0; face < 6; face++)
+			{
+				BeginFace(slot.staticMap, STATIC_SIZE, face);
+				SetFaceUniforms(staticShader, slot, face);
+				drawStatic(staticShader);
+				if (m_Full)
+				{
+					SetFaceUniforms(dynamicShader, slot, face);
+					drawDynamic(dynamicShader, slot.position, slot.radius);
+				}
+			}
+			slot.valid = true;
+			m_Stats.staticRenders++;
+		}
+		if (timing)
+			glEndQuery(GL_TIME_ELAPSED);
+
+		// overlays: characters only, each frame. drawDynamic(depthShader, lightPosition, radius)
+		// returns false when nothing is in reach of the light, which leaves the overlay empty
+		if (timing)
+			glBeginQuery(GL_TIME_ELAPSED, m_Queries[m_Next * 2 + 1]);
+		for (int i = 0; i < MAX_CASTERS && !m_Full; i++)
+		{
+			Slot& slot = m_Slots[i];
+			if (slot.light == NO_LIGHT)
+				continue;
+			bool drawn = false;
+			for (int face = 0; face < 6; face++)
+			{
+				BeginFace(slot.overlayMap, OVERLAY_SIZE, face);
+				SetFaceUniforms(dynamicShader, slot, face);
+				drawn = drawDynamic(dynamicShader, slot.position, slot.radius) || drawn;
+			}
+			if (drawn)
+				m_Stats.overlayRenders++;
+		}
+		if (timing)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			m_Next = (m_Next + 1) % QUERY_FRAMES;
+			m_Pending++;
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+	// binds the maps and sets the shadow uniforms; the shader must be in use. every
+	// shader sampling the maps needs this, even with casting off, so its cube samplers
+	// never share a unit with a 2D texture
+	void Bind(const Shader& shader, bool casting)
+	{
+		for (int i = 0; i < MAX_CASTERS; i++)
+		{
+			const Slot& slot = m_Slots[i];
+			std::string index = "[" + std::to_string(i) + "]";
+			glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + i * 2);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, slot.staticMap.texture);
+			shader.setInt("shadowStatic" + index, FIRST_TEXTURE_UNIT + i * 2);
+			glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + i * 2 + 1);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, slot.overlayMap.texture);
+			shader.setInt("shadowOverlay" + index, FIRST_TEXTURE_UNIT + i * 2 + 1);
+			shader.setInt("shadowLights" + index, casting && slot.valid ? slot.light : NO_LIGHT);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	const Stats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+	bool IsFull() const
+	{
+		return m_Full;
+	}
+
+private:
+	static const int NO_LIGHT = -1;
+	static const unsigned int QUERY_FRAMES = 4;   // a static and an overlay query each
+
+	struct CubeMap
+	{
+		unsigned int texture = 0;
+		unsigned int framebuffer = 0;
+	};
+
+	struct Slot
+	{
+		int light = NO_LIGHT;
+		bool valid = false;
+		glm::vec3 position = glm::vec3(0.0f);
+		float radius = 0.0f;
+		CubeMap staticMap;
+		CubeMap overlayMap;
+	};
+
+	void CreateMap(CubeMap& map, int size)
+	{
+		glGenTextures(1, &map.texture);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, map.texture);
+		for (int face = 0; face < 6; face++)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+		glGenFramebuffers(1, &map.framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, map.framebuffer);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+
+	void DestroyMap(CubeMap& map)
+	{
+		glDeleteFramebuffers(1, &map.framebuffer);
+		glDeleteTextures(1, &map.texture);
+		map = CubeMap();
+	}
+
+	void BeginFace(const CubeMap& map, int size, int face)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, map.framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, map.texture, 0);
+		glViewport(0, 0, size, size);
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	void ClearMap(const CubeMap& map)
+	{
+		for (int face = 0; face < 6; face++)
+			BeginFace(map, OVERLAY_SIZE, face);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// one cube face as seen from the light, on the depth shader about to draw
+	void SetFaceUniforms(Shader& shader, const Slot& slot, int face)
+	{
+		static const glm::vec3 directions[6] = {
+			glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+		};
+		static const glm::vec3 ups[6] = {
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+			glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+		};
+		glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, NEAR_PLANE, slot.radius);
+		shader.use();
+		shader.setMat4("shadowMatrix", projection * glm::lookAt(slot.position, slot.position + directions[face], ups[face]));
+		shader.setVec3("lightPos", slot.position);
+		shader.setFloat("farPlane", slot.radius);
+	}
+
+	// takes in the timings that have arrived, oldest first, without waiting on the GPU; the
+	// overlay query ends after the static one, so once it is available both are
+	void ReadQueries()
+	{
+		while (m_Pending > 0)
+		{
+			unsigned int oldest = (m_Next + QUERY_FRAMES - m_Pending) % QUERY_FRAMES;
+			GLint available = 0;
+			glGetQueryObjectiv(m_Queries[oldest * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+			GLuint64 staticNs = 0, overlayNs = 0;
+			glGetQueryObjectui64v(m_Queries[oldest * 2], GL_QUERY_RESULT, &staticNs);
+			glGetQueryObjectui64v(m_Queries[oldest * 2 + 1], GL_QUERY_RESULT, &overlayNs);
+			m_Pending--;
+			m_Stats.timed++;
+			m_Stats.staticMs += staticNs / 1e6f;
+			m_Stats.overlayMs += overlayNs / 1e6f;
+			m_Stats.maxMs = std::max(m_Stats.maxMs, (staticNs + overlayNs) / 1e6f);
+		}
+	}
+
+	const float NEAR_PLANE = 0.05f;
+
+	bool m_Full = false;
+	Slot m_Slots[MAX_CASTERS];
+	std::vector<std::pair<float, int> > m_Nearest;
+	unsigned int m_Queries[QUERY_FRAMES * 2] = {};
+	unsigned int m_Next = 0;      // query pair for the next timed frame
+	unsigned int m_Pending = 0;   // timed frames not read back yet
+	Stats m_Stats;
+};
+
+#endif
@@ -0,0 +1,11 @@
+#version 330 core
+in vec3 FragPos;
+
+uniform vec3 lightPos;
+uniform float farPlane;
+
+void main()
+{
+    // distance to the light, mapped to [0, 1] by the light's radius
+    gl_FragDepth = length(FragPos - lightPos) / farPlane;
+}
@@ -0,0 +1,33 @@
+#version 330 core
+layout(location = 0) in vec3 pos;
+layout(location = 5) in ivec4 boneIds; 
+layout(location = 6) in vec4 weights;
+
+out vec3 FragPos;
+
+uniform mat4 model;
+uniform mat4 shadowMatrix;
+
+const int MAX_BONES = 100;
+const int MAX_BONE_INFLUENCE = 4;
+uniform mat4 finalBonesMatrices[MAX_BONES];
+
+void main()
+{
+    vec4 totalPosition = vec4(0.0f);
+    for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
+    {
+        if(boneIds[i] == -1) 
+            continue;
+        if(boneIds[i] >=MAX_BONES) 
+        {
+            totalPosition = vec4(pos,1.0f);
+            break;
+        }
+        totalPosition += finalBonesMatrices[boneIds[i]] * vec4(pos,1.0f) * weights[i];
+    }
+
+    vec4 worldPos = model * totalPosition;
+    FragPos = worldPos.xyz;
+    gl_Position = shadowMatrix * worldPos;
+}
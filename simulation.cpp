@@ -0,0 +1,537 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "simulation.h"
+
+#include <algorithm>
+#include <cmath>
+
+CharacterDef characterDefs[CHARACTER_KIND_COUNT];
+
+void initCharacterDefs()
+{
+	characterDefs[KNIGHT].blendRate = 3.3f;
+	characterDefs[KNIGHT].dyingBlendRate = 0.18f;
+	characterDefs[KNIGHT].modelYaw = 180.0f;
+	characterDefs[KNIGHT].attackDamage = 40.0f;
+	characterDefs[KNIGHT].kickDamage = 20.0f;
+	characterDefs[KNIGHT].team = TEAM_PLAYER;
+	characterDefs[KNIGHT].hitboxBone = "mixamorig:RightHand";
+	characterDefs[KNIGHT].upperBodyJoint = "mixamorig:Spine1";
+	characterDefs[MONSTER].blendRate = 0.3f;
+	characterDefs[MONSTER].dyingBlendRate = 0.3f;
+	characterDefs[MONSTER].modelYaw = 0.0f;
+	characterDefs[MONSTER].attackDamage = 150.0f;
+	characterDefs[MONSTER].team = TEAM_MONSTER;
+	characterDefs[MONSTER].hitboxBone = "mixamorig:RightHand";
+	characterDefs[MERCHANT].blendRate = 1.8f;
+	characterDefs[MERCHANT].modelYaw = 90.0f;
+}
+
+void loadClipEvents(CharacterKind kind, ClipId clip, ClipInfo& info)
+{
+	info.events.clear();
+	for (unsigned int i = 0; i < CLIP_EVENT_COUNT; i++)
+		if (CLIP_EVENTS[i].kind == kind && CLIP_EVENTS[i].clip == clip)
+			info.events.push_back(CLIP_EVENTS[i].event);
+	std::stable_sort(info.events.begin(), info.events.end(), [](const AnimEvent& a, const AnimEvent& b) {
+		return a.time < b.time;
+	});
+}
+
+bool checkAABBCollision(const glm::mat4& attackModel, const glm::vec3& hitboxOffset, const glm::vec3& hitboxSize, const glm::vec3& targetPos, float targetScale)
+{
+	// Target's AABB
+	float targetMinX = targetPos.x - targetScale;
+	float targetMaxX = targetPos.x + targetScale;
+	float targetMinY = targetPos.y - targetScale;
+	float targetMaxY = targetPos.y + targetScale * 2.0f;
+	float targetMinZ = targetPos.z - targetScale;
+	float targetMaxZ = targetPos.z + targetScale;
+
+	// Attack hitbox corners (Local space)
+	glm::vec3 half = hitboxSize * 0.5f;
+	glm::vec3 corners[8] = {
+		glm::vec3(-half.x, -half.y, -half.z) + hitboxOffset,
+		glm::vec3(half.x, -half.y, -half.z) + hitboxOffset,
+		glm::vec3(half.x,  half.y, -half.z) + hitboxOffset,
+		glm::vec3(-half.x,  half.y, -half.z) + hitboxOffset,
+
+		glm::vec3(-half.x, -half.y,  half.z) + hitboxOffset,
+		glm::vec3(half.x, -half.y,  half.z) + hitboxOffset,
+		glm::vec3(half.x,  half.y,  half.z) + hitboxOffset,
+		glm::vec3(-half.x,  half.y,  half.z) + hitboxOffset
+	};
+
+	for (int i = 0; i < 8; ++i)
+	{
+		glm::vec4 worldCorner = attackModel * glm::vec4(corners[i], 1.0f);
+
+		// Check if any world-space corner is inside the target's AABB
+		if (worldCorner.x >= targetMinX && worldCorner.x <= targetMaxX &&
+			worldCorner.y >= targetMinY && worldCorner.y <= targetMaxY &&
+			worldCorner.z >= targetMinZ && worldCorner.z <= targetMaxZ)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void damageEntity(World& world, unsigned int slot, float damage, std::vector<CombatEvent>& events)
+{
+	HealthComponent& h = world.health[slot];
+	if (!h.alive) return;
+
+	h.health -= damage;
+	if (h.health <= 0.0f) {
+		h.health = 0.0f;
+		h.dying = 1;
+	}
+
+	CombatEvent event;
+	event.kind = world.kind[slot];
+	event.defeated = h.dying;
+	event.health = h.health;
+	events.push_back(event);
+}
+
+Entity spawnCharacter(World& world, CharacterKind kind, const glm::vec3& position, float yaw)
+{
+	uint32_t components = COMPONENT_TRANSFORM | COMPONENT_ANIM_STATE | COMPONENT_ANIMATOR;
+	if (kind != MERCHANT)
+		components |= COMPONENT_HEALTH | COMPONENT_HITBOX;
+
+	Entity entity = world.Spawn(kind, components, position, yaw);
+	unsigned int slot = world.Slot(entity);
+	TransformComponent& t = world.transform[slot];
+	HitboxComponent& b = world.hitbox[slot];
+	switch (kind) {
+	case KNIGHT:
+		t.moveSpeed = PLAYER_MOVE_SPEED;
+		t.yawSpeed = PLAYER_YAW_SPEED;
+		b.offset = HITBOX_OFFSET;
+		b.size = glm::vec3(HITBOX_WIDTH, HITBOX_HEIGHT, HITBOX_DEPTH);
+		break;
+	case MONSTER:
+		t.moveSpeed = ENEMY_MOVE_SPEED;
+		t.yawSpeed = ENEMY_YAW_SPEED;
+		b.offset = ENEMY_HITBOX_OFFSET;
+		b.size = glm::vec3(ENEMY_HITBOX_WIDTH, ENEMY_HITBOX_HEIGHT, ENEMY_HITBOX_DEPTH);
+		break;
+	default:
+		t.yawSpeed = MERCHANT_YAW_SPEED;
+		break;
+	}
+	float radians = glm::radians(t.yaw + characterDefs[kind].modelYaw);
+	t.forward = glm::vec3(sin(radians), 0.0f, cos(radians));
+	return entity;
+}
+
+glm::mat4 entityModelMatrix(const World& world, unsigned int slot)
+{
+	const TransformComponent& t = world.transform[slot];
+	glm::mat4 model = glm::mat4(1.0f);
+	model = glm::translate(model, t.position);
+	model = glm::scale(model, glm::vec3(t.scale));
+	model = glm::rotate(model, glm::radians(characterDefs[world.kind[slot]].modelYaw + t.yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+	return model;
+}
+
+void resetCharacter(World& world, unsigned int slot)
+{
+	AnimStateComponent& a = world.anim[slot];
+	a.state = IDLE;
+	a.clip0 = CLIP_IDLE;
+	a.clip1 = CLIP_NONE;
+	a.time0 = 0.0f;
+	a.time1 = 0.0f;
+	a.blend = 0.0f;
+	a.layerClip = CLIP_NONE;
+	a.layerFading = 0;
+	a.layerTime = 0.0f;
+	a.layerWeight = 0.0f;
+	world.transform[slot].speed = 0.0f;
+	world.hitbox[slot].attached = 0;
+	world.hitbox[slot].window = 0;
+	world.hitbox[slot].active = 0;
+	world.hitbox[slot].hitPerformed = 0;
+}
+
+void buildNavGrid(NavGrid& grid, const std::vector<glm::vec3>& triangles)
+{
+	glm::vec3 minBounds = glm::vec3(1e9f);
+	glm::vec3 maxBounds = glm::vec3(-1e9f);
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		minBounds = glm::min(minBounds, triangles[i]);
+		maxBounds = glm::max(maxBounds, triangles[i]);
+	}
+
+	// characters stand at the same height everywhere in the dungeon
+	grid.Init(minBounds, maxBounds, NAV_CELL_SIZE, ENEMY_START.y, NAV_AGENT_HEIGHT);
+	for (size_t i = 0; i + 2 < triangles.size(); i += 3)
+		grid.AddTriangle(triangles[i], triangles[i + 1], triangles[i + 2]);
+	grid.Finish();
+}
+
+void updateMonsterAI(World& world, const FlowField& flowField, const glm::vec3& target, bool targetAlive, unsigned int& cursor)
+{
+	unsigned int count = world.Count();
+	unsigned int budget = std::min(AI_AGENTS_PER_FRAME, count);
+	for (unsigned int n = 0; n < budget; n++)
+	{
+		unsigned int i = (cursor + n) % count;
+		if (world.kind[i] != MONSTER || !world.health[i].alive || !characterDefs[MONSTER].active)
+			continue;
+
+		AnimStateComponent& a = world.anim[i];
+		const TransformComponent& t = world.transform[i];
+		a.intent = 0;
+		if (!targetAlive || world.health[i].dying || a.state == IDLE_ATTACK || a.state == ATTACK_IDLE)
+			continue;
+
+		glm::vec3 toTarget = target - t.position;
+		toTarget.y = 0.0f;
+		float distance = glm::length(toTarget);
+		if (distance > AI_AGGRO_RADIUS || distance <= 0.0f)
+			continue;
+
+		// steer by the flow field, straight at the target once close or off the grid
+		glm::vec3 direction = distance < AI_ATTACK_RANGE ? glm::vec3(0.0f) : flowField.Sample(t.position);
+		if (direction == glm::vec3(0.0f))
+			direction = toTarget / distance;
+
+		float desiredYaw = glm::degrees(atan2(direction.x, direction.z)) - characterDefs[MONSTER].modelYaw;
+		float turn = fmod(desiredYaw - t.yaw + 540.0f, 360.0f) - 180.0f;
+
+		if (turn > AI_FACING_TOLERANCE)
+			a.intent |= INTENT_TURN_LEFT;
+		else if (turn < -AI_FACING_TOLERANCE)
+			a.intent |= INTENT_TURN_RIGHT;
+		else if (distance < AI_ATTACK_RANGE)
+			a.intent = INTENT_ATTACK;
+
+		if (distance >= AI_ATTACK_RANGE && fabs(turn) < AI_WALK_ANGLE)
+			a.intent |= INTENT_FORWARD;
+	}
+	if (count > 0)
+		cursor = (cursor + budget) % count;
+}
+
+void updateMovement(World& world, float dt)
+{
+	for (unsigned int i = 0; i < world.Count(); i++)
+	{
+		if (!world.health[i].alive || !characterDefs[world.kind[i]].active)
+			continue;
+
+		TransformComponent& t = world.transform[i];
+		uint32_t intent = world.anim[i].intent;
+		if (intent & INTENT_TURN_LEFT)
+			t.yaw += t.yawSpeed * dt;
+		if (intent & INTENT_TURN_RIGHT)
+			t.yaw -= t.yawSpeed * dt;
+
+		const CharacterDef& def = characterDefs[world.kind[i]];
+		float radians = glm::radians(t.yaw + def.modelYaw);
+		t.forward = glm::vec3(sin(radians), 0.0f, cos(radians));
+
+		// walking starts and stops at once; only the change between walking and running is
+		// eased, which gives the walk/run blend a speed to follow
+		if (intent & INTENT_FORWARD) {
+			float target = (intent & INTENT_RUN) && def.HasClip(CLIP_RUN) ? t.moveSpeed * RUN_SPEED_FACTOR : t.moveSpeed;
+			float step = t.moveSpeed * RUN_ACCELERATION * dt;
+			t.speed = std::max(t.speed, t.moveSpeed);
+			t.speed = target > t.speed ? std::min(target, t.speed + step) : std::max(target, t.speed - step);
+			t.position += t.forward * t.speed * dt;
+		}
+		else
+			t.speed = 0.0f;
+		if (intent & INTENT_BACK)
+			t.position -= t.forward * t.moveSpeed * dt;
+	}
+}
+
+float walkCycleRate(const CharacterDef& def, float runWeight)
+{
+	if (runWeight <= 0.0f || !def.HasClip(CLIP_WALK) || !def.HasClip(CLIP_RUN))
+		return 1.0f;
+	const ClipInfo& walk = def.clips[CLIP_WALK];
+	const ClipInfo& run = def.clips[CLIP_RUN];
+	float walkCycles = walk.ticksPerSecond / walk.duration;
+	float runCycles = run.ticksPerSecond / run.duration;
+	return glm::mix(walkCycles, runCycles, runWeight) / walkCycles;
+}
+
+bool stepBlend(AnimStateComponent& a, float rate, float dt)
+{
+	a.blend = std::min(a.blend + rate * dt, 1.0f);
+	if (a.blend > BLEND_DONE) {
+		a.blend = 0.0f;
+		a.clip0 = a.clip1;
+		a.time0 = a.time1;
+		a.clip1 = CLIP_NONE;
+		return true;
+	}
+	return false;
+}
+
+void fireAnimEvent(World& world, unsigned int i, unsigned int slot, const AnimEvent& event)
+{
+	AnimStateComponent& a = world.anim[i];
+	HitboxComponent& b = world.hitbox[i];
+	switch (event.type) {
+	case EVENT_HITBOX_ON:
+		b.window = 1;
+		b.hitPerformed = 0;
+		break;
+	case EVENT_HITBOX_OFF:
+		b.window = 0;
+		break;
+	case EVENT_BLEND_OUT:
+		if (slot == 0 && a.clip1 == CLIP_NONE && (a.state == TURN_IDLE || a.state == ATTACK_IDLE || a.state == KICK_IDLE))
+			a.clip1 = CLIP_IDLE;
+		if (slot == 2)
+			a.layerFading = 1;
+		break;
+	case EVENT_FOOTSTEP:
+		// no rules hang off footsteps; the track carries them for sound and effects
+		break;
+	}
+}
+
+void advanceClipTime(World& world, unsigned int i, unsigned int slot, const CharacterDef& def, float dt)
+{
+	AnimStateComponent& a = world.anim[i];
+	uint8_t clip = slot == 0 ? a.clip0 : slot == 1 ? a.clip1 : a.layerClip;
+	float& time = slot == 0 ? a.time0 : slot == 1 ? a.time1 : a.layerTime;
+	if (!def.HasClip(clip))
+		return;
+	const ClipInfo& info = def.clips[clip];
+	float step = info.ticksPerSecond * dt;
+	const std::vector<AnimEvent>& track = info.events;
+	if (!track.empty() && step > 0.0f && info.duration > 0.0f)
+	{
+		float from = time;
+		float to = time + step;
+		for (unsigned int loop = 0; loop < MAX_EVENT_LOOPS && from < to; loop++)
+		{
+			float end = std::min(to, info.duration);
+			auto event = std::lower_bound(track.begin(), track.end(), from, [](const AnimEvent& e, float t) {
+				return e.time < t;
+			});
+			for (; event != track.end() && event->time < end; ++event)
+				fireAnimEvent(world, i, slot, *event);
+			from = 0.0f;
+			to -= info.duration;
+		}
+	}
+	time = fmod(time + step, info.duration);
+}
+
+void updateAnimStates(World& world, float dt)
+{
+	for (unsigned int i = 0; i < world.Count(); i++)
+	{
+		const CharacterDef& def = characterDefs[world.kind[i]];
+		HealthComponent& h = world.health[i];
+		AnimStateComponent& a = world.anim[i];
+		if (!h.alive || !def.active)
+			continue;
+
+		uint32_t intent = a.intent;
+		bool wantsWalk = (intent & (INTENT_FORWARD | INTENT_TURN_LEFT | INTENT_TURN_RIGHT)) != 0;
+
+		switch (a.state) {
+		case IDLE:
+			if (wantsWalk && def.HasClip(CLIP_WALK))
+				beginBlend(a, CLIP_WALK, IDLE_WALK);
+			else if ((intent & INTENT_BACK) && def.HasClip(CLIP_WALKBACK))
+				beginBlend(a, CLIP_WALKBACK, IDLE_WALKBACK);
+			else if ((intent & INTENT_ATTACK) && def.HasClip(CLIP_ATTACK) && a.layerClip == CLIP_NONE)
+				beginBlend(a, CLIP_ATTACK, IDLE_ATTACK);
+			else if ((intent & INTENT_KICK) && def.HasClip(CLIP_KICK) && a.layerClip == CLIP_NONE)
+				beginBlend(a, CLIP_KICK, IDLE_KICK);
+			else if ((intent & INTENT_TURN_AROUND) && def.HasClip(CLIP_TURN))
+				beginBlend(a, CLIP_TURN, IDLE_TURN);
+			else if (((intent & INTENT_DIE) || h.dying) && def.HasClip(CLIP_DYING))
+				beginBlend(a, CLIP_DYING, IDLE_DYING);
+			else if ((intent & INTENT_TALK) && def.HasClip(CLIP_TALK))
+				beginBlend(a, CLIP_TALK, IDLE_TALK);
+			break;
+		case IDLE_WALK:
+			if (stepBlend(a, def.blendRate, dt))
+				a.state = WALK;
+			break;
+		case WALK:
+			if (!wantsWalk)
+				a.state = WALK_IDLE;
+			break;
+		case IDLE_WALKBACK:
+			if (stepBlend(a, def.blendRate, dt))
+				a.state = WALKBACK;
+			break;
+		case WALKBACK:
+			if (!(intent & INTENT_BACK))
+				a.state = WALKBACK_IDLE;
+			break;
+		case IDLE_TURN:
+			if (stepBlend(a, def.blendRate, dt))
+				a.state = TURN_IDLE;
+			break;
+		case IDLE_ATTACK:
+			if (stepBlend(a, def.blendRate, dt))
+				a.state = ATTACK_IDLE;
+			break;
+		case IDLE_KICK:
+			if (stepBlend(a, def.blendRate, dt))
+				a.state = KICK_IDLE;
+			break;
+		case IDLE_TALK:
+			if (stepBlend(a, def.blendRate, dt))
+				a.state = TALK;
+			break;
+		case TALK:
+			if (intent & INTENT_TALK)
+				a.state = TALK_IDLE;
+			break;
+		case IDLE_DYING:
+			if (stepBlend(a, def.dyingBlendRate, dt))
+				h.alive = 0;
+			break;
+		case WALK_IDLE:
+		case WALKBACK_IDLE:
+		case TALK_IDLE:
+			a.clip1 = CLIP_IDLE;
+			// fall through
+		case TURN_IDLE:
+		case ATTACK_IDLE:
+		case KICK_IDLE:
+			// one-shot clips play out until their blend-out event hands over to idle
+			if (a.clip1 != CLIP_NONE && stepBlend(a, def.blendRate, dt))
+				a.state = IDLE;
+			break;
+		}
+
+		// swings while walking play on the upper body layer and leave the legs to the state
+		if (a.layerClip == CLIP_NONE) {
+			if ((intent & INTENT_ATTACK) && (a.state == WALK || a.state == WALKBACK) && def.upperBodyJoint && def.HasClip(CLIP_ATTACK)) {
+				a.layerClip = CLIP_ATTACK;
+				a.layerFading = 0;
+				a.layerTime = 0.0f;
+				a.layerWeight = 0.0f;
+			}
+		}
+		else if (a.layerFading) {
+			a.layerWeight -= def.blendRate * dt;
+			if (a.layerWeight <= 0.0f) {
+				a.layerClip = CLIP_NONE;
+				a.layerWeight = 0.0f;
+			}
+		}
+		else
+			a.layerWeight = std::min(1.0f, a.layerWeight + def.blendRate * dt);
+
+		float walkRate = walkCycleRate(def, runBlendWeight(world.transform[i]));
+		advanceClipTime(world, i, 0, def, a.clip0 == CLIP_WALK ? dt * walkRate : dt);
+		if (a.clip1 != CLIP_NONE)
+			advanceClipTime(world, i, 1, def, a.clip1 == CLIP_WALK ? dt * walkRate : dt);
+		if (a.layerClip != CLIP_NONE)
+			advanceClipTime(world, i, 2, def, dt);
+	}
+}
+
+// a character a swing could land on, with what the broad test needs
+struct HitTarget
+{
+	unsigned int slot;
+	glm::vec3 position;
+	float reach;           // from position to the farthest corner of its box
+};
+
+void updateHitboxes(World& world, std::vector<CombatEvent>& events)
+{
+	std::vector<std::pair<unsigned int, float> > attackers;
+	for (unsigned int i = 0; i < world.Count(); i++)
+	{
+		const CharacterDef& def = characterDefs[world.kind[i]];
+		HitboxComponent& b = world.hitbox[i];
+		const AnimStateComponent& a = world.anim[i];
+		b.active = 0;
+		if (!world.Has(i, COMPONENT_HITBOX) || !world.health[i].alive || !def.active || !b.window)
+			continue;
+
+		float damage = a.state == ATTACK_IDLE ? def.attackDamage : a.state == KICK_IDLE ? def.kickDamage : 0.0f;
+		if (a.layerClip == CLIP_ATTACK && a.layerWeight >= LAYER_HIT_WEIGHT)
+			damage = def.attackDamage;
+		if (damage <= 0.0f)
+			continue;
+
+		b.active = 1;
+		if (!b.hitPerformed)
+			attackers.push_back(std::make_pair(i, damage));
+	}
+	if (attackers.empty())
+		return;
+
+	// the target box spans a scale either side in x and z, and from one below to two above
+	const float TARGET_REACH = sqrtf(6.0f);
+	std::vector<HitTarget> targets[TEAM_COUNT];
+	for (unsigned int j = 0; j < world.Count(); j++)
+	{
+		const CharacterDef& targetDef = characterDefs[world.kind[j]];
+		if (!world.Has(j, COMPONENT_HEALTH) || !world.health[j].alive || !targetDef.active)
+			continue;
+		const TransformComponent& t = world.transform[j];
+		targets[targetDef.team].push_back({ j, t.position, t.scale * TARGET_REACH });
+	}
+
+	for (size_t n = 0; n < attackers.size(); n++)
+	{
+		unsigned int i = attackers[n].first;
+		float damage = attackers[n].second;
+		int team = characterDefs[world.kind[i]].team;
+		HitboxComponent& b = world.hitbox[i];
+		glm::mat4 attackModel = entityModelMatrix(world, i);
+		glm::vec3 center = glm::vec3(attackModel * glm::vec4(hitboxCenter(b), 1.0f));
+		float reach = glm::length(b.size * 0.5f) * world.transform[i].scale;
+		for (int k = 0; k < TEAM_COUNT; k++)
+		{
+			if (k == team)
+				continue;
+			for (size_t m = 0; m < targets[k].size(); m++)
+			{
+				const HitTarget& target = targets[k][m];
+				float r = reach + target.reach;
+				glm::vec3 d = target.position - center;
+				if (glm::dot(d, d) > r * r)
+					continue;
+				if (checkAABBCollision(attackModel, hitboxCenter(b), b.size, target.position, world.transform[target.slot].scale)) {
+					damageEntity(world, target.slot, damage, events);
+					b.hitPerformed = 1;
+				}
+			}
+		}
+	}
+}
+
+void stepSimulation(World& world, FlowField& flowField, unsigned int& aiCursor, Entity player, float dt, std::vector<CombatEvent>& events)
+{
+	bool targetAlive = false;
+	glm::vec3 target = glm::vec3(0.0f);
+	if (world.IsValid(player))
+	{
+		unsigned int slot = world.Slot(player);
+		const HealthComponent& h = world.health[slot];
+		target = world.transform[slot].position;
+		targetAlive = h.alive && !h.dying;
+		flowField.SetGoal(target);
+		flowField.Update(FLOW_NODES_PER_FRAME);
+	}
+	updateMonsterAI(world, flowField, target, targetAlive, aiCursor);
+	updateMovement(world, dt);
+	updateAnimStates(world, dt);
+	updateHitboxes(world, events);
+}
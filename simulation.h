@@ -0,0 +1,216 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "character.h"
+#include "ecs.h"
+#include "flow_field.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// the game rules: character kinds, movement, the anim state machine, hit detection and the
+// monster AI. shared by the client and the arena server, so nothing in here touches GL
+
+// spawn points
+const glm::vec3 PLAYER_START = glm::vec3(0.4f, 1.1f, -0.4f);
+const glm::vec3 ENEMY_START = glm::vec3(0.0f, 1.1f, -14.0f);
+const glm::vec3 MERCHANT_START = glm::vec3(-1.9f, 1.1f, -3.1f);
+
+// movement
+const float PLAYER_MOVE_SPEED = 1.2f;
+const float PLAYER_YAW_SPEED = 150.0f;
+const float ENEMY_MOVE_SPEED = 2.0f;
+const float ENEMY_YAW_SPEED = 100.0f;
+const float MERCHANT_YAW_SPEED = 100.0f;
+const float RUN_SPEED_FACTOR = 2.5f;         // of the walking speed, for kinds with a run clip
+const float RUN_ACCELERATION = 2.0f;         // walking speeds per second
+
+// upper body swings over walking
+const float LAYER_HIT_WEIGHT = 0.5f;         // a swing blending in lands once it owns this much
+
+// attack hitbox
+const float HITBOX_WIDTH = 1.0f;
+const float HITBOX_HEIGHT = 1.5f;
+const float HITBOX_DEPTH = 1.0f;
+const glm::vec3 HITBOX_OFFSET = glm::vec3(0.0f, 1.0f, 1.0f);
+
+// enemy attack hitbox
+const float ENEMY_HITBOX_WIDTH = 1.0f;
+const float ENEMY_HITBOX_HEIGHT = 1.5f;
+const float ENEMY_HITBOX_DEPTH = 1.0f;
+const glm::vec3 ENEMY_HITBOX_OFFSET = glm::vec3(0.0f, 1.0f, 1.0f); // Offset is forward relative to enemy forward
+
+// monster AI
+const float NAV_CELL_SIZE = 0.5f;
+const float NAV_AGENT_HEIGHT = 1.8f;
+const int FLOW_NODES_PER_FRAME = 2048;        // flow field expansion budget
+const unsigned int AI_AGENTS_PER_FRAME = 256; // agents that re-plan each frame, round robin
+const float AI_AGGRO_RADIUS = 15.0f;
+const float AI_ATTACK_RANGE = 1.0f;
+const float AI_FACING_TOLERANCE = 10.0f;
+const float AI_WALK_ANGLE = 60.0f;
+
+// assets, relative to the resource root
+const float MAP_SCALE = 0.5f;
+const char* const MAP_PATH = "resources/objects/map/dungeon/source/DungeonBlend/DungeonBlend/dungeon_v11.obj";
+const char* const CHARACTER_MODEL_PATHS[CHARACTER_KIND_COUNT] = {
+	"resources/objects/mixamo/knight/model/model.dae",
+	"resources/objects/mixamo/monster/model/model.dae",
+	"resources/objects/mixamo/merchant/Model/Model.dae"
+};
+
+struct ClipAsset
+{
+	CharacterKind kind;
+	ClipId clip;
+	const char* path;
+	bool onDemand;         // only loaded once something asks for it
+};
+
+// idle 3.3, walk 2.06, run 0.83, attack 1.03, kick 1.6
+const ClipAsset CLIP_ASSETS[] = {
+	{ KNIGHT, CLIP_IDLE, "resources/objects/mixamo/knight/Idle/Idle.dae", false },
+	{ KNIGHT, CLIP_WALK, "resources/objects/mixamo/knight/Walking/Walking.dae", false },
+	{ KNIGHT, CLIP_WALKBACK, "resources/objects/mixamo/knight/WalkBack/WalkBack.dae", false },
+	{ KNIGHT, CLIP_RUN, "resources/objects/mixamo/knight/Running/Running.dae", false },
+	{ KNIGHT, CLIP_ATTACK, "resources/objects/mixamo/knight/Slash/Slash.dae", false },
+	{ KNIGHT, CLIP_KICK, "resources/objects/mixamo/knight/SwordKick/SwordKick.dae", false },
+	{ KNIGHT, CLIP_TURN, "resources/objects/mixamo/knight/Turn/Turn.dae", false },
+	{ KNIGHT, CLIP_DYING, "resources/objects/mixamo/knight/Death/Death.dae", true },
+	{ MONSTER, CLIP_IDLE, "resources/objects/mixamo/monster/Idle/Idle.dae", false },
+	{ MONSTER, CLIP_WALK, "resources/objects/mixamo/monster/Walk/Walk.dae", false },
+	{ MONSTER, CLIP_ATTACK, "resources/objects/mixamo/monster/Attack/Attack.dae", false },
+	{ MONSTER, CLIP_DYING, "resources/objects/mixamo/monster/Dying/Dying.dae", true },
+	{ MERCHANT, CLIP_IDLE, "resources/objects/mixamo/merchant/Idle/Idle.dae", false },
+	{ MERCHANT, CLIP_TALK, "resources/objects/mixamo/merchant/Talking/Talking.dae", false }
+};
+const unsigned int CLIP_ASSET_COUNT = sizeof(CLIP_ASSETS) / sizeof(CLIP_ASSETS[0]);
+
+struct ClipEventAsset
+{
+	CharacterKind kind;
+	ClipId clip;
+	AnimEvent event;
+};
+
+// event tracks, in clip time like the durations above; a clip gets its track when it loads
+const ClipEventAsset CLIP_EVENTS[] = {
+	{ KNIGHT, CLIP_WALK, { 0.5f, EVENT_FOOTSTEP } },
+	{ KNIGHT, CLIP_WALK, { 1.53f, EVENT_FOOTSTEP } },
+	{ KNIGHT, CLIP_WALKBACK, { 0.4f, EVENT_FOOTSTEP } },
+	{ KNIGHT, CLIP_WALKBACK, { 1.2f, EVENT_FOOTSTEP } },
+	{ KNIGHT, CLIP_RUN, { 0.2f, EVENT_FOOTSTEP } },
+	{ KNIGHT, CLIP_RUN, { 0.62f, EVENT_FOOTSTEP } },
+	{ KNIGHT, CLIP_ATTACK, { 0.3f, EVENT_HITBOX_ON } },
+	{ KNIGHT, CLIP_ATTACK, { 0.6f, EVENT_HITBOX_OFF } },
+	{ KNIGHT, CLIP_ATTACK, { 0.7f, EVENT_BLEND_OUT } },
+	{ KNIGHT, CLIP_KICK, { 0.3f, EVENT_HITBOX_ON } },
+	{ KNIGHT, CLIP_KICK, { 0.6f, EVENT_HITBOX_OFF } },
+	{ KNIGHT, CLIP_KICK, { 1.0f, EVENT_BLEND_OUT } },
+	{ KNIGHT, CLIP_TURN, { 0.7f, EVENT_BLEND_OUT } },
+	{ MONSTER, CLIP_WALK, { 0.4f, EVENT_FOOTSTEP } },
+	{ MONSTER, CLIP_WALK, { 1.0f, EVENT_FOOTSTEP } },
+	{ MONSTER, CLIP_ATTACK, { 0.3f, EVENT_HITBOX_ON } },
+	{ MONSTER, CLIP_ATTACK, { 0.6f, EVENT_HITBOX_OFF } },
+	{ MONSTER, CLIP_ATTACK, { 0.7f, EVENT_BLEND_OUT } }
+};
+const unsigned int CLIP_EVENT_COUNT = sizeof(CLIP_EVENTS) / sizeof(CLIP_EVENTS[0]);
+
+// a step covering more loops of a clip than this fires the events of this many
+const unsigned int MAX_EVENT_LOOPS = 4;
+
+// per-kind constants; clip timings are filled in by whoever loads the clips
+extern CharacterDef characterDefs[CHARACTER_KIND_COUNT];
+
+void initCharacterDefs();
+
+// gives a clip its event track, ordered by time
+void loadClipEvents(CharacterKind kind, ClipId clip, ClipInfo& info);
+
+bool checkAABBCollision(const glm::mat4& attackModel, const glm::vec3& hitboxOffset, const glm::vec3& hitboxSize, const glm::vec3& targetPos, float targetScale);
+
+// a hit landed this tick, for the HUD
+struct CombatEvent
+{
+	uint8_t kind;        // of the character hit
+	uint8_t defeated;
+	float health;        // left after the hit
+};
+
+void damageEntity(World& world, unsigned int slot, float damage, std::vector<CombatEvent>& events);
+
+Entity spawnCharacter(World& world, CharacterKind kind, const glm::vec3& position, float yaw);
+
+glm::mat4 entityModelMatrix(const World& world, unsigned int slot);
+
+void resetCharacter(World& world, unsigned int slot);
+
+// the attack box's center, local to the attacker: on the hit bone when a pose placed it there
+inline glm::vec3 hitboxCenter(const HitboxComponent& b)
+{
+	return b.attached ? b.bone : b.offset;
+}
+
+// walkable cells from the map's triangles, given as a flat list of world space corners
+void buildNavGrid(NavGrid& grid, const std::vector<glm::vec3>& triangles);
+
+// monsters chase the player along the shared flow field and attack once in reach.
+// only AI_AGENTS_PER_FRAME characters re-plan each frame; the others keep their last intent
+void updateMonsterAI(World& world, const FlowField& flowField, const glm::vec3& target, bool targetAlive, unsigned int& cursor);
+
+void updateMovement(World& world, float dt);
+
+// how far the walk has turned into a run, for the walk/run blend space
+inline float runBlendWeight(const TransformComponent& t)
+{
+	if (t.moveSpeed <= 0.0f)
+		return 0.0f;
+	return glm::clamp((t.speed - t.moveSpeed) / (t.moveSpeed * (RUN_SPEED_FACTOR - 1.0f)), 0.0f, 1.0f);
+}
+
+// the walk clip's playback rate: the walk and run cycles are kept in step at a shared phase,
+// which goes round at the rate of whichever the speed is closer to
+float walkCycleRate(const CharacterDef& def, float runWeight);
+
+// start blending from idle into another clip
+inline void beginBlend(AnimStateComponent& a, uint8_t clip, AnimState next)
+{
+	a.blend = 0.0f;
+	a.clip0 = CLIP_IDLE;
+	a.clip1 = clip;
+	a.time1 = 0.0f;
+	a.state = next;
+}
+
+// advance the blend by rate per second; once done the target clip carries on alone from where it got to
+bool stepBlend(AnimStateComponent& a, float rate, float dt);
+
+// what the rules do at a clip's events. slot is where the clip is in the blend: 0 for the
+// clip the state is about, 1 for the one being blended in, 2 for the upper body layer
+void fireAnimEvent(World& world, unsigned int i, unsigned int slot, const AnimEvent& event);
+
+// moves a clip on by dt and fires the events in [time, time + step), in order. the step may
+// wrap around the end of the clip, several times when it is large. the first event is found
+// by binary search, so the cost follows the events fired rather than the length of the track
+void advanceClipTime(World& world, unsigned int i, unsigned int slot, const CharacterDef& def, float dt);
+
+// the character state machine shared by every kind; which transitions can happen
+// depends only on the intents its controller sets and the clips the kind has
+void updateAnimStates(World& world, float dt);
+
+// attacks land once per swing, on every opposing character the hitbox reaches while the clip's
+// hit window is open. the window is kept by the clip's events; swings still blending in don't hit.
+// only characters mid-swing look for targets, and only in the other teams' lists, gathered once
+// per tick; a distance test skips the box check for targets out of reach
+void updateHitboxes(World& world, std::vector<CombatEvent>& events);
+
+// one simulation tick: AI, movement, the anim state machine and hits, in that order.
+// the hits that landed are appended to events
+void stepSimulation(World& world, FlowField& flowField, unsigned int& aiCursor, Entity player, float dt, std::vector<CombatEvent>& events);
+
+#endif
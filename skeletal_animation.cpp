@@ -8,49 +8,84 @@
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
-#include <learnopengl/animator.h>
 #include <learnopengl/model_animation.h>
 
+#include "animation_clip.h"
+#include "arena_client.h"
+#include "asset_streamer.h"
+#include "blend_tree.h"
+#include "character_pose.h"
+#include "clustered_lighting.h"
+#include "dynamic_resolution.h"
+#include "frame_packet.h"
+#include "input.h"
+#include "offscreen.h"
+#include "shadow_cache.h"
+#include "simulation.h"
+#include "snapshot.h"
+#include "ui_batch.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow* window);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void processInput(GLFWwindow* window, const InputQueue& input);
 unsigned int loadCubemap(vector<std::string> faces);
-void updatePlayerPosition(int direction);
 void setupHitbox();
-bool checkAABBCollision(const glm::mat4& playerAttackModel, const glm::vec3& enemyPos, float enemyScale);
-bool checkEnemyAttackCollision(const glm::mat4& enemyAttackModel, const glm::vec3& playerPos, float playerScale);
-void damageEnemy(float damage);
-void damagePlayer(float damage);
-
-enum AnimState {
-	IDLE = 1,
-	IDLE_ATTACK,
-	ATTACK_IDLE,
-	IDLE_KICK,
-	KICK_IDLE,
-	IDLE_WALK,
-	WALK_IDLE,
-	WALK,
-	IDLE_WALKBACK,
-	WALKBACK_IDLE,
-	WALKBACK,
-	IDLE_TURN,
-	TURN_IDLE,
-	IDLE_DYING,
-	IDLE_TALK,
-	TALK,
-	TALK_IDLE
-};
+uint32_t knightIntent(const InputQueue& input);
+void updateControllers(World& world, const InputQueue& input);
+void requestAssets(AssetStreamer& streamer, const InputQueue& input);
+void refreshCharacterDefs(AssetStreamer& streamer);
+void bindPoseClips(AssetStreamer& streamer, int kind);
+void simulationTick(AssetStreamer& streamer, FlowField& flowField, GLFWwindow* window, FramePacket& packet);
+void buildFramePacket(AssetStreamer& streamer, uint64_t tick, std::chrono::steady_clock::time_point sampled, FramePacket& packet);
+void simulationLoop(AssetStreamer* streamer, FlowField* flowField, GLFWwindow* window);
+std::vector<glm::mat4>& entityPose(const World& world, unsigned int slot);
+void collectMapTriangles(CachedModel& map, const glm::mat4& transform, std::vector<glm::vec3>& triangles);
+uint64_t worldChecksum(const World& world);
+void captureState(const FlowField& flowField, std::vector<uint8_t>& state);
+bool restoreState(FlowField& flowField, const std::vector<uint8_t>& state);
+void saveTickSnapshot(const FlowField& flowField, uint32_t tick);
+bool rewindTo(FlowField& flowField, uint32_t tick);
+void printSnapshotStats();
+void crashHandler(int signal);
+void printTickTimings(std::vector<float>& tickMs, float totalSeconds);
+void printThreadTimings(float totalSeconds);
+bool captureFrame(RenderTarget& target, const std::string& name);
+void placeTorches(const NavGrid& grid, unsigned int count, std::vector<PointLight>& torches);
+void printLightingStats();
+void printShadowStats();
+void drawHud(UiBatch& ui, const FramePacket& packet);
+void printUiStats();
+void printResolutionStats();
 
 // settings
 const unsigned int SCR_WIDTH = 1000;
 const unsigned int SCR_HEIGHT = 800;
+unsigned int renderWidth = SCR_WIDTH;
+unsigned int renderHeight = SCR_HEIGHT;
 
 // camera
 Camera camera(glm::vec3(0.0f, 4.0f, 4.0f));
@@ -58,91 +93,300 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-// player
-glm::vec3 playerPosition = glm::vec3(0.4f, 1.1f, -0.4f);
-glm::vec3 playerForward = glm::vec3(0.0f, 0.0f, -1.0f);
-float moveSpeed = 1.2f;
-float playerYaw = 0.0f;
-float yawSpeed = 150.0f;
-enum AnimState charState = IDLE;
-float playerHealth = 100.0f;
-bool isPlayerAlive = true;
-bool playDyingAnim = false;
-
-// enemy
-glm::vec3 enemyPosition = glm::vec3(0.0f, 1.1f, -14.0f);
-glm::vec3 enemyForward = glm::vec3(0.0f, 0.0f, -1.0f);
-float enemyMoveSpeed = 2.0f;
-float enemyYaw = 0.0f;
-float enemyYawSpeed = 100.0f;
-enum AnimState enemyState = IDLE;
-float enemyHealth = 100.0f;
-bool isEnemyAlive = true;
-bool playEnemyDyingAnim = false;
-
-// merchant
-glm::vec3 merchantPosition = glm::vec3(-1.9f, 1.1f, -3.1f);
-float merchantYaw = 0.0f;
-float merchantYawSpeed = 100.0f;
-enum AnimState merchantState = IDLE;
-bool isTalkingToMerchant = false;
-
-// attack hitbox
-const float HITBOX_WIDTH = 1.0f;
-const float HITBOX_HEIGHT = 1.5f;
-const float HITBOX_DEPTH = 1.0f;
-const glm::vec3 HITBOX_OFFSET = glm::vec3(0.0f, 1.0f, 1.0f);
+// input
+InputQueue input;
+
+// arena server connection, when playing online
+ArenaClient client;
+const char* serverAddress = NULL;
+const float CONNECT_TIMEOUT = 5.0f;
+
+// characters
+World world;
+Entity player;
+Entity merchant;
+std::vector<std::vector<glm::mat4> > poses;   // bone palettes, indexed by entity index
+unsigned int aiCursor = 0;
+
+// hitbox wireframe
 unsigned int hitboxVAO = 0;
 unsigned int hitboxVBO = 0;
 
-// enemy attack hitbox
-const float ENEMY_HITBOX_WIDTH = 1.0f;
-const float ENEMY_HITBOX_HEIGHT = 1.5f;
-const float ENEMY_HITBOX_DEPTH = 1.0f;
-const glm::vec3 ENEMY_HITBOX_OFFSET = glm::vec3(0.0f, 1.0f, 1.0f); // Offset is forward relative to enemy forward
+// streaming
+const size_t STREAMING_BUDGET = 512u * 1024u * 1024u;
+const float STREAMING_RADIUS = 20.0f;
+AssetStreamer::Handle kindModels[CHARACTER_KIND_COUNT];
+AssetStreamer::Handle kindClips[CHARACTER_KIND_COUNT][CLIP_COUNT];
+std::mutex assetMutex;   // the streamer, shared by the simulation and GL threads; characterDefs is the simulation's own
+
+// pose evaluation: each kind's skeleton comes from its idle clip, and every resident clip is
+// bound to it. used on the simulation thread only
+CharacterRig rigs[CHARACTER_KIND_COUNT];
+unsigned int skeletonLoads[CHARACTER_KIND_COUNT];     // idle clip load the skeleton was built from
+std::unique_ptr<AnimationClip> poseClips[CHARACTER_KIND_COUNT][CLIP_COUNT];
+unsigned int poseClipLoads[CHARACTER_KIND_COUNT][CLIP_COUNT];
+BlendTree blendTree;
+PoseCache poseCache;
+
+// snapshots
+const unsigned int SNAPSHOT_HISTORY = 256;     // ticks kept for rewinding
+const unsigned int SNAPSHOT_REWIND_TICKS = 60;
+const char* CHECKPOINT_PATH = "checkpoint.snap";
+const char* CRASH_DUMP_PATH = "crash_state.snap";
+SnapshotHistory snapshotHistory(SNAPSHOT_HISTORY);
+std::vector<uint8_t> snapshotScratch;
+// the crash dump's file image, rebuilt after every tick's snapshot so the signal handler only
+// has to write(2) it: two buffers, the handler takes the one last published
+std::vector<uint8_t> crashDumps[2];
+std::atomic<int> crashDumpReady(-1);
+struct SnapshotTimings
+{
+	unsigned int saves = 0;
+	unsigned int restores = 0;
+	float saveUs = 0.0f;
+	float restoreUs = 0.0f;
+	float maxSaveUs = 0.0f;
+	float maxRestoreUs = 0.0f;
+	size_t rawBytes = 0;
+	size_t encodedBytes = 0;
+} snapshotTimings;
+
+// lighting: torches along the dungeon walls, shaded through clustered forward lighting
+const unsigned int TORCH_COUNT_DEFAULT = 256;
+const float TORCH_RADIUS = 3.5f;
+const float TORCH_HEIGHT = 1.6f;                        // above the floor
+const glm::vec3 TORCH_COLOR = glm::vec3(1.0f, 0.55f, 0.25f);
+const glm::vec3 AMBIENT_LIGHT = glm::vec3(0.35f);
+ClusteredLighting lighting;
+std::vector<PointLight> torches;
+std::vector<PointLight> frameLights;                    // torches with this frame's flicker
+float simulationTime = 0.0f;                            // seconds simulated, drives the flicker
+struct LightingTimings
+{
+	unsigned int frames = 0;
+	double visibleLights = 0.0;
+	float assignUs = 0.0f;
+	float maxAssignUs = 0.0f;
+	unsigned int maxPerCluster = 0;
+	unsigned int overflowingClusters = 0;
+} lightingTimings;
+
+// shadows: the torches nearest the player cast them, from cached maps of the dungeon plus
+// per-frame overlays of the characters
+const float CHARACTER_SHADOW_REACH = 1.5f;             // beyond a light's radius, for a character's extent
+ShadowCache shadows;
+struct ShadowTimings
+{
+	unsigned int frames = 0;
+	unsigned int staticRenders = 0;
+	unsigned int overlayRenders = 0;
+	unsigned int timed = 0;   // frames with GPU times, which arrive late and are skipped rather than waited for
+	double staticMs = 0.0;
+	double overlayMs = 0.0;
+	float maxMs = 0.0f;
+} shadowTimings;
+
+// HUD: the player's health, a feed of recent hits and a health bar over every character
+const float HEALTH_BAR_HEIGHT = 1.9f;                  // above the feet
+const glm::vec2 HEALTH_BAR_SIZE = glm::vec2(40.0f, 5.0f);   // pixels
+const glm::vec2 HUD_BAR_SIZE = glm::vec2(200.0f, 14.0f);
+const float HUD_MARGIN = 16.0f;
+const float HUD_TEXT_SCALE = 2.0f;
+const float HUD_MESSAGE_SECONDS = 3.0f;
+const unsigned int HUD_MESSAGE_LINES = 6;
+UiBatch ui;
+std::vector<CombatEvent> combatEvents;    // this tick's, simulation thread
+std::deque<HudMessage> combatFeed;        // the last few seconds', simulation thread
+struct UiTimings
+{
+	unsigned int frames = 0;
+	double quads = 0.0;
+	double draws = 0.0;
+	unsigned int maxQuads = 0;
+	unsigned int dropped = 0;
+} uiTimings;
+
+// dynamic resolution: the scene renders at a scale that keeps the GPU inside the frame budget
+// and is upscaled to the window; the HUD is drawn after, at full resolution. off by default
+// offscreen, where captures must match their goldens pixel for pixel
+DynamicResolution resolution;
+
+// threads: the simulation publishes one frame packet per tick, the GL thread draws the newest
+const float SIMULATION_RATE = 120.0f;   // ticks per second at most
+TripleBuffer<FramePacket> frames;
+std::atomic<bool> simulationRunning(false);
 
 // timing
-float deltaTime = 0.0f;
+float deltaTime = 0.0f;   // length of the tick being simulated
 float lastFrame = 0.0f;
-
-int main()
+struct ThreadTiming
 {
-	// glfw: initialize and configure
-	// ------------------------------
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	unsigned long count = 0;
+	double totalMs = 0.0;
+	float maxMs = 0.0f;
 
-#ifdef __APPLE__
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-	// glfw window creation
-	// --------------------
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-	if (window == NULL)
+	void Add(float ms)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
+		count++;
+		totalMs += ms;
+		maxMs = std::max(maxMs, ms);
+	}
+};
+ThreadTiming simulationTiming;   // written by the simulation thread, read after it has joined
+ThreadTiming renderTiming;
+ThreadTiming packetLatency;      // tick input sampled to frame presented
+unsigned long packetsShown = 0;
+
+// offscreen rendering: captures are named after the tick they show, so the captures of a replay
+// line up with its goldens
+const unsigned int CAPTURE_EVERY_DEFAULT = 60;        // ticks
+const int GOLDEN_TOLERANCE_DEFAULT = 8;                // per channel, out of 255
+const float GOLDEN_MAX_DIFFERING = 0.001f;             // fraction of pixels allowed past the tolerance
+const char* captureDir = NULL;
+const char* goldenDir = NULL;
+int goldenTolerance = GOLDEN_TOLERANCE_DEFAULT;
+unsigned int captures = 0;
+unsigned int goldenMismatches = 0;
+std::vector<uint8_t> capturePixels;
+
+int main(int argc, char** argv)
+{
+	// command line: --record <log> saves the session's input, --replay <log> plays one back,
+	// --headless replays without showing a window or rendering, --connect <host:port> plays
+	// in an arena on an arena server instead of simulating locally.
+	// --offscreen replays into a framebuffer without a window or display (--size WxH), and can
+	// --capture <dir> a PNG every --capture-every <ticks> and compare each against the same
+	// file in --golden <dir>, allowing --tolerance <0-255> per channel.
+	// --torches <n> sets how many torch lights line the walls, --full-shadows re-renders
+	// every shadow map each frame instead of caching the dungeon's, for comparison.
+	// --frame-budget <ms> is the GPU time dynamic resolution aims for (0 turns it off),
+	// between --min-scale and --max-scale of the output resolution.
+	const char* recordPath = NULL;
+	const char* replayPath = NULL;
+	bool headless = false;
+	bool offscreen = false;
+	unsigned int captureEvery = CAPTURE_EVERY_DEFAULT;
+	unsigned int torchCount = TORCH_COUNT_DEFAULT;
+	bool fullShadows = false;
+	DynamicResolution::Settings resolutionSettings;
+	bool resolutionBudgetSet = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayPath = argv[++i];
+		else if (strcmp(argv[i], "--headless") == 0)
+			headless = true;
+		else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc)
+			serverAddress = argv[++i];
+		else if (strcmp(argv[i], "--offscreen") == 0)
+			offscreen = true;
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			sscanf(argv[++i], "%ux%u", &renderWidth, &renderHeight);
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+			captureDir = argv[++i];
+		else if (strcmp(argv[i], "--capture-every") == 0 && i + 1 < argc)
+			captureEvery = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+			goldenDir = argv[++i];
+		else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+			goldenTolerance = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--torches") == 0 && i + 1 < argc)
+			torchCount = std::min((unsigned int)std::max(0, atoi(argv[++i])), ClusteredLighting::MAX_LIGHTS);
+		else if (strcmp(argv[i], "--full-shadows") == 0)
+			fullShadows = true;
+		else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc)
+		{
+			resolutionSettings.budgetMs = (float)atof(argv[++i]);
+			resolutionBudgetSet = true;
+		}
+		else if (strcmp(argv[i], "--min-scale") == 0 && i + 1 < argc)
+			resolutionSettings.minScale = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--max-scale") == 0 && i + 1 < argc)
+			resolutionSettings.maxScale = (float)atof(argv[++i]);
+	}
+	if (serverAddress && (recordPath || replayPath))
+	{
+		std::cout << "--connect can't be combined with --record or --replay" << std::endl;
 		return -1;
 	}
-	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
-
-	// tell GLFW to capture our mouse
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-	// glad: load all OpenGL function pointers
-	// ---------------------------------------
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	if ((headless || offscreen) && !replayPath)
+	{
+		std::cout << "--headless and --offscreen need --replay <log>" << std::endl;
+		return -1;
+	}
+	if ((captureDir || goldenDir) && !offscreen)
 	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
+		std::cout << "--capture and --golden need --offscreen" << std::endl;
+		return -1;
+	}
+	if (offscreen && (renderWidth == 0 || renderHeight == 0))
+	{
+		std::cout << "Bad --size, expected WxH" << std::endl;
 		return -1;
 	}
 
+	// offscreen: an EGL context rendering into a framebuffer object, no window or display
+	// ------------------------------------------------------------------------------------
+	GLFWwindow* window = NULL;
+	OffscreenContext offscreenContext;
+	RenderTarget renderTarget;
+	if (offscreen)
+	{
+		if (!offscreenContext.Create())
+			return -1;
+		if (!gladLoadGLLoader((GLADloadproc)OffscreenContext::GetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
+		if (!renderTarget.Create(renderWidth, renderHeight))
+			return -1;
+		renderTarget.Bind();
+	}
+	else
+	{
+		// glfw: initialize and configure
+		// ------------------------------
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+		if (headless)
+			glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+		// glfw window creation
+		// --------------------
+		window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+		if (window == NULL)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
+		glfwSetKeyCallback(window, key_callback);
+
+		// tell GLFW to capture our mouse
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+		// glad: load all OpenGL function pointers
+		// ---------------------------------------
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
+	}
+
 	// tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
 	stbi_set_flip_vertically_on_load(true);
 
@@ -152,670 +396,461 @@ int main()
 
 	// build and compile shaders
 	// -------------------------
-	Shader ourShader("anim_model.vs", "anim_model.fs");
-	Shader mapShader("map.vs", "map.fs");
+	Shader ourShader("anim_model.vs", "lit.fs");
+	Shader mapShader("map.vs", "lit.fs");
 	Shader skyboxShader("6.1.skybox.vs", "6.1.skybox.fs");
 	Shader hitboxShader("hitbox.vs", "hitbox.fs");
+	Shader shadowShader("shadow_depth.vs", "shadow_depth.fs");
+	Shader animShadowShader("shadow_depth_anim.vs", "shadow_depth.fs");
+	Shader uiShader("ui.vs", "ui.fs");
+	Shader upscaleShader("upscale.vs", "upscale.fs");
+
 
+	// character kinds
+	// ---------------
+	initCharacterDefs();
 
 	// load models
 	// -----------
-	// idle 3.3, walk 2.06, run 0.83, attack 1.03, kick 1.6
-	Model ourModel(FileSystem::getPath("resources/objects/mixamo/knight/model/model.dae"));
-	Model mapModel(FileSystem::getPath("resources/objects/map/dungeon/source/DungeonBlend/DungeonBlend/dungeon_v11.obj"));
-	Model enemyModel(FileSystem::getPath("resources/objects/mixamo/monster/model/model.dae"));
-	Model merchantModel(FileSystem::getPath("resources/objects/mixamo/merchant/Model/Model.dae"));
-	Animation idleAnimation(FileSystem::getPath("resources/objects/mixamo/knight/Idle/Idle.dae"), &ourModel);
-	Animation walkAnimation(FileSystem::getPath("resources/objects/mixamo/knight/Walking/Walking.dae"), &ourModel);
-	Animation walkBackAnimation(FileSystem::getPath("resources/objects/mixamo/knight/WalkBack/WalkBack.dae"), &ourModel);
-	Animation runAnimation(FileSystem::getPath("resources/objects/mixamo/knight/Running/Running.dae"), &ourModel);
-	Animation attackAnimation(FileSystem::getPath("resources/objects/mixamo/knight/Slash/Slash.dae"), &ourModel);
-	Animation kickAnimation(FileSystem::getPath("resources/objects/mixamo/knight/SwordKick/SwordKick.dae"), &ourModel);
-	Animation turnAnimation(FileSystem::getPath("resources/objects/mixamo/knight/Turn/Turn.dae"), &ourModel);
-	Animation dyingAnimation(FileSystem::getPath("resources/objects/mixamo/knight/Death/Death.dae"), &ourModel);
-	Animation enemyIdleAnimation(FileSystem::getPath("resources/objects/mixamo/monster/Idle/Idle.dae"), &enemyModel);
-	Animation enemyWalkAnimation(FileSystem::getPath("resources/objects/mixamo/monster/Walk/Walk.dae"), &enemyModel);
-	Animation enemyAttackAnimation(FileSystem::getPath("resources/objects/mixamo/monster/Attack/Attack.dae"), &enemyModel);
-	Animation enemyDyingAnimation(FileSystem::getPath("resources/objects/mixamo/monster/Dying/Dying.dae"), &enemyModel);
-	Animation merchantIdleAnimation(FileSystem::getPath("resources/objects/mixamo/merchant/Idle/Idle.dae"), &merchantModel);
-	Animation merchantTalkAnimation(FileSystem::getPath("resources/objects/mixamo/merchant/Talking/Talking.dae"), &merchantModel);
-	Animator animator(&idleAnimation);
-	Animator enemyAnimator(&enemyIdleAnimation);
-	Animator merchantAnimator(&merchantIdleAnimation);
-	float blendAmount = 0.0f;
-	float blendRate = 0.055f;
-	float enemyBlendAmount = 0.0f;
-	float enemyBlendRate = 0.005f;
-	float merchantBlendAmount = 0.0f;
-	float merchantBlendRate = 0.03f;
+	// only the map, the player and the idle clip are loaded before the first frame;
+	// everything else streams in on a background thread as the player gets close
+	AssetStreamer streamer(STREAMING_BUDGET);
+	AssetStreamer::Handle mapAsset = streamer.RegisterModel(FileSystem::getPath(MAP_PATH), glm::vec3(0.0f), 0.0f);
+	for (int k = 0; k < CHARACTER_KIND_COUNT; k++)
+		for (int c = 0; c < CLIP_COUNT; c++)
+			kindClips[k][c] = AssetStreamer::InvalidHandle;
+
+	kindModels[KNIGHT] = streamer.RegisterModel(FileSystem::getPath(CHARACTER_MODEL_PATHS[KNIGHT]), PLAYER_START, 0.0f);
+	kindModels[MONSTER] = streamer.RegisterModel(FileSystem::getPath(CHARACTER_MODEL_PATHS[MONSTER]), ENEMY_START, STREAMING_RADIUS);
+	kindModels[MERCHANT] = streamer.RegisterModel(FileSystem::getPath(CHARACTER_MODEL_PATHS[MERCHANT]), MERCHANT_START, STREAMING_RADIUS);
+	for (unsigned int i = 0; i < CLIP_ASSET_COUNT; i++)
+	{
+		const ClipAsset& clip = CLIP_ASSETS[i];
+		kindClips[clip.kind][clip.clip] = streamer.RegisterAnimation(FileSystem::getPath(clip.path), kindModels[clip.kind], clip.onDemand);
+	}
+
+	streamer.Pin(mapAsset);
+	streamer.Pin(kindModels[KNIGHT]);
+	for (int c = 0; c < CLIP_COUNT; c++)
+		if (kindClips[KNIGHT][c] != AssetStreamer::InvalidHandle)
+			streamer.Pin(kindClips[KNIGHT][c]);
+	streamer.WaitUntilResident(mapAsset);
+	streamer.WaitUntilResident(kindModels[KNIGHT]);
+	streamer.WaitUntilResident(kindClips[KNIGHT][CLIP_IDLE]);
+	CachedModel& mapModel = *streamer.GetModel(mapAsset);
+	glm::mat4 mapTransform = glm::mat4(1.0f);
+	mapTransform = glm::translate(mapTransform, glm::vec3(0.0f, 0.0f, 0.0f));
+	mapTransform = glm::scale(mapTransform, glm::vec3(MAP_SCALE));
+	mapTransform = glm::rotate(mapTransform, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	// navigation
+	// ----------
+	// one nav grid from the dungeon mesh and one flow field towards the player, shared by all monsters
+	NavGrid navGrid;
+	std::vector<glm::vec3> mapTriangles;
+	collectMapTriangles(mapModel, mapTransform, mapTriangles);
+	buildNavGrid(navGrid, mapTriangles);
+	FlowField flowField;
+	flowField.Init(&navGrid);
+
+	// spawn
+	// -----
+	player = spawnCharacter(world, KNIGHT, PLAYER_START, 0.0f);
+	spawnCharacter(world, MONSTER, ENEMY_START, 0.0f);
+	merchant = spawnCharacter(world, MERCHANT, MERCHANT_START, 0.0f);
 
 	setupHitbox();
 
+	// lighting
+	// --------
+	placeTorches(navGrid, torchCount, torches);
+	lighting.Init();
+	shadows.Init(fullShadows);
+	ui.Init();
+	bool dynamicResolution = resolutionSettings.budgetMs > 0.0f && (!offscreen || resolutionBudgetSet);
+	if (dynamicResolution)
+		resolution.Init(resolutionSettings);
+
+	// online, the server owns the world; ours is just the last interpolated snapshot
+	if (serverAddress)
+	{
+		if (!client.Connect(serverAddress, CONNECT_TIMEOUT))
+			return -1;
+		merchant = Entity();
+		client.Interpolate(0.0f, world, player);
+	}
+
+	// recorded and replayed runs load synchronously, so a replay sees exactly what the recording did
+	if (recordPath && !input.StartRecording(recordPath))
+		return -1;
+	if (replayPath && !input.StartReplay(replayPath))
+		return -1;
+	bool deterministic = input.GetMode() != InputQueue::LIVE;
+	std::signal(SIGSEGV, crashHandler);
+	std::signal(SIGABRT, crashHandler);
+	std::vector<float> tickMs;
+	auto runStart = std::chrono::high_resolution_clock::now();
+
+	// threads
+	// -------
+	// live play simulates on its own thread and hands each tick to this one as a frame packet,
+	// so animation cost no longer adds to frame time. recorded and replayed runs stay on this
+	// thread, because they must settle streaming between ticks exactly like the recording did
+	{
+		std::lock_guard<std::mutex> lock(assetMutex);
+		refreshCharacterDefs(streamer);
+	}
+	updatePoses(world, rigs, blendTree, poseCache, poses);
+	buildFramePacket(streamer, 0, std::chrono::steady_clock::now(), frames.Back());
+	frames.Publish();
+	std::thread simulation;
+	if (!deterministic)
+	{
+		simulationRunning = true;
+		simulation = std::thread(simulationLoop, &streamer, &flowField, window);
+	}
+
 	// render loop
 	// -----------
-	while (!glfwWindowShouldClose(window))
+	uint64_t shownTick = 0;
+	while (!window || !glfwWindowShouldClose(window))
 	{
 		// per-frame time logic
 		// --------------------
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
+		float currentFrame = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - runStart).count();
+		float frameTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+		auto frameStart = std::chrono::high_resolution_clock::now();
 
-		// input
-		// -----
-		processInput(window);
-		if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
-			animator.PlayAnimation(&idleAnimation, NULL, 0.0f, 0.0f, 0.0f);
-		if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
-			animator.PlayAnimation(&walkAnimation, NULL, 0.0f, 0.0f, 0.0f);
-		if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
-			animator.PlayAnimation(&attackAnimation, NULL, 0.0f, 0.0f, 0.0f);
-		if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
-			animator.PlayAnimation(&kickAnimation, NULL, 0.0f, 0.0f, 0.0f);
-		if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS)
-			animator.PlayAnimation(&turnAnimation, NULL, 0.0f, 0.0f, 0.0f);
-		/*if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS)
-			isTalkingToMerchant = !isTalkingToMerchant;*/
-
-
-		switch (charState) {
-		case IDLE:
-			if ((glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) || (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) || (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)) {
-				blendAmount = 0.0f;
-				animator.PlayAnimation(&idleAnimation, &walkAnimation, animator.m_CurrentTime, 0.0f, blendAmount);
-				charState = IDLE_WALK;
-			}
-			else if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-				blendAmount = 0.0f;
-				animator.PlayAnimation(&idleAnimation, &walkBackAnimation, animator.m_CurrentTime, 0.0f, blendAmount);
-				charState = IDLE_WALKBACK;
-			}
-			else if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
-				blendAmount = 0.0f;
-				animator.PlayAnimation(&idleAnimation, &attackAnimation, animator.m_CurrentTime, 0.0f, blendAmount);
-				charState = IDLE_ATTACK;
-			}
-			else if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
-				blendAmount = 0.0f;
-				animator.PlayAnimation(&idleAnimation, &kickAnimation, animator.m_CurrentTime, 0.0f, blendAmount);
-				charState = IDLE_KICK;
-			}
-			else if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS) {
-				blendAmount = 0.0f;
-				animator.PlayAnimation(&idleAnimation, &turnAnimation, animator.m_CurrentTime, 0.0f, blendAmount);
-				charState = IDLE_TURN;
-			}
-			else if ((glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) || playDyingAnim) {
-				blendAmount = 0.0f;
-				animator.PlayAnimation(&idleAnimation, &dyingAnimation, animator.m_CurrentTime, 0.0f, blendAmount);
-				charState = IDLE_DYING;
-			}
-			//printf("idle \n");
-			break;
-		case IDLE_WALK:
-			blendAmount += blendRate;
-			blendAmount = fmod(blendAmount, 1.0f);
-			animator.PlayAnimation(&idleAnimation, &walkAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if (blendAmount > 0.9f) {
-				blendAmount = 0.0f;
-				float startTime = animator.m_CurrentTime2;
-				animator.PlayAnimation(&walkAnimation, NULL, startTime, 0.0f, blendAmount);
-				charState = WALK;
-			}
-			//printf("idle_walk \n");
-			break;
-		case WALK:
-			animator.PlayAnimation(&walkAnimation, NULL, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if ((glfwGetKey(window, GLFW_KEY_W) != GLFW_PRESS) && (glfwGetKey(window, GLFW_KEY_A) != GLFW_PRESS) && (glfwGetKey(window, GLFW_KEY_D) != GLFW_PRESS)) {
-				charState = WALK_IDLE;
-			}
-			//printf("walking\n");
-			break;
-		case WALK_IDLE:
-			blendAmount += blendRate;
-			blendAmount = fmod(blendAmount, 1.0f);
-			animator.PlayAnimation(&walkAnimation, &idleAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if (blendAmount > 0.9f) {
-				blendAmount = 0.0f;
-				float startTime = animator.m_CurrentTime2;
-				animator.PlayAnimation(&idleAnimation, NULL, startTime, 0.0f, blendAmount);
-				charState = IDLE;
-			}
-			//printf("walk_idle \n");
-			break;
-		case IDLE_WALKBACK:
-			blendAmount += blendRate;
-			blendAmount = fmod(blendAmount, 1.0f);
-			animator.PlayAnimation(&idleAnimation, &walkBackAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if (blendAmount > 0.9f) {
-				blendAmount = 0.0f;
-				float startTime = animator.m_CurrentTime2;
-				animator.PlayAnimation(&walkBackAnimation, NULL, startTime, 0.0f, blendAmount);
-				charState = WALKBACK;
-			}
-			//printf("idle_walkback \n");
-			break;
-		case WALKBACK:
-			animator.PlayAnimation(&walkBackAnimation, NULL, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if ((glfwGetKey(window, GLFW_KEY_S) != GLFW_PRESS)) {
-				charState = WALKBACK_IDLE;
-			}
-			//printf("walking_back\n");
-			break;
-		case WALKBACK_IDLE:
-			blendAmount += blendRate;
-			blendAmount = fmod(blendAmount, 1.0f);
-			animator.PlayAnimation(&walkBackAnimation, &idleAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if (blendAmount > 0.9f) {
-				blendAmount = 0.0f;
-				float startTime = animator.m_CurrentTime2;
-				animator.PlayAnimation(&idleAnimation, NULL, startTime, 0.0f, blendAmount);
-				charState = IDLE;
-			}
-			//printf("walkback_idle \n");
-			break;
-		case IDLE_TURN:
-			blendAmount += blendRate;
-			blendAmount = fmod(blendAmount, 1.0f);
-			animator.PlayAnimation(&idleAnimation, &turnAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if (blendAmount > 0.9f) {
-				blendAmount = 0.0f;
-				float startTime = animator.m_CurrentTime2;
-				animator.PlayAnimation(&turnAnimation, NULL, startTime, 0.0f, blendAmount);
-				charState = TURN_IDLE;
-			}
-			//printf("idle_turn\n");
-			break;
-		case TURN_IDLE:
-			if (animator.m_CurrentTime > 0.7f) {
-				blendAmount += blendRate;
-				blendAmount = fmod(blendAmount, 1.0f);
-				animator.PlayAnimation(&turnAnimation, &idleAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-				if (blendAmount > 0.9f) {
-					blendAmount = 0.0f;
-					//playerYaw -= 90.0f;
-					float startTime = animator.m_CurrentTime2;
-					animator.PlayAnimation(&idleAnimation, NULL, startTime, 0.0f, blendAmount);
-					charState = IDLE;
-				}
-				//printf("turn_idle \n");
-			}
-			else {
-				// turning
-				//printf("turning \n");
-			}
-			break;
-		case IDLE_ATTACK:
-			blendAmount += blendRate;
-			blendAmount = fmod(blendAmount, 1.0f);
-			animator.PlayAnimation(&idleAnimation, &attackAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if (blendAmount > 0.9f) {
-				blendAmount = 0.0f;
-				float startTime = animator.m_CurrentTime2;
-				animator.PlayAnimation(&attackAnimation, NULL, startTime, 0.0f, blendAmount);
-				charState = ATTACK_IDLE;
-			}
-			//printf("idle_attack\n");
-			break;
-		case ATTACK_IDLE:
-			if (animator.m_CurrentTime > 0.7f) {
-				blendAmount += blendRate;
-				blendAmount = fmod(blendAmount, 1.0f);
-				animator.PlayAnimation(&attackAnimation, &idleAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-				if (blendAmount > 0.9f) {
-					blendAmount = 0.0f;
-					float startTime = animator.m_CurrentTime2;
-					animator.PlayAnimation(&idleAnimation, NULL, startTime, 0.0f, blendAmount);
-					charState = IDLE;
-				}
-				//printf("attack_idle \n");
-			}
-			else {
-				// attacking
-				//printf("attacking \n");
-			}
-			break;
-		case IDLE_KICK:
-			blendAmount += blendRate;
-			blendAmount = fmod(blendAmount, 1.0f);
-			animator.PlayAnimation(&idleAnimation, &kickAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if (blendAmount > 0.9f) {
-				blendAmount = 0.0f;
-				float startTime = animator.m_CurrentTime2;
-				animator.PlayAnimation(&kickAnimation, NULL, startTime, 0.0f, blendAmount);
-				charState = KICK_IDLE;
-			}
-			//printf("idle_kick\n");
-			break;
-		case KICK_IDLE:
-			if (animator.m_CurrentTime > 1.0f) {
-				blendAmount += blendRate;
-				blendAmount = fmod(blendAmount, 1.0f);
-				animator.PlayAnimation(&kickAnimation, &idleAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-				if (blendAmount > 0.9f) {
-					blendAmount = 0.0f;
-					float startTime = animator.m_CurrentTime2;
-					animator.PlayAnimation(&idleAnimation, NULL, startTime, 0.0f, blendAmount);
-					charState = IDLE;
-				}
-				//printf("kick_idle \n");
-			}
-			else {
-				// kicking
-				//printf("kicking \n");
-			}
-			break;
-		case IDLE_DYING:
-			blendAmount += (blendRate - 0.052);
-			blendAmount = fmod(blendAmount, 1.0f);
-			animator.PlayAnimation(&idleAnimation, &dyingAnimation, animator.m_CurrentTime, animator.m_CurrentTime2, blendAmount);
-			if (blendAmount > 0.9f) {
-				blendAmount = 0.0f;
-				float startTime = animator.m_CurrentTime2;
-				animator.PlayAnimation(&dyingAnimation, NULL, startTime, 0.0f, blendAmount);
-				isPlayerAlive = false;
-			}
-			break;
-		}
-
-		animator.UpdateAnimation(deltaTime);
-
-
-		glm::mat4 playerAttackModel = glm::mat4(1.0f);
-		playerAttackModel = glm::translate(playerAttackModel, playerPosition);
-		playerAttackModel = glm::scale(playerAttackModel, glm::vec3(.5f, .5f, .5f));
-		playerAttackModel = glm::rotate(playerAttackModel, glm::radians(180.0f + playerYaw), glm::vec3(0.0f, 1.0f, 0.0f));
-
-		bool showHitbox = false;
-		float enemyScale = 0.5f;
-
-		static bool attackHitPerformed = false;
-		static bool kickHitPerformed = false;
-
-		if (charState == ATTACK_IDLE && animator.m_CurrentTime > 0.3f && animator.m_CurrentTime < 0.6f) {
-			showHitbox = true;
-			if (!attackHitPerformed) {
-				if (isEnemyAlive && checkAABBCollision(playerAttackModel, enemyPosition, enemyScale)) {
-					damageEnemy(40.0f);
-					attackHitPerformed = true;
-				}
-			}
-		}
-		if (charState == ATTACK_IDLE && animator.m_CurrentTime > 0.7f) {
-			attackHitPerformed = false;
-		}
-
-		if (charState == KICK_IDLE && animator.m_CurrentTime > 0.3f && animator.m_CurrentTime < 0.6f) {
-			showHitbox = true;
-			if (!kickHitPerformed) {
-				if (isEnemyAlive && checkAABBCollision(playerAttackModel, enemyPosition, enemyScale)) {
-					damageEnemy(20.0f);
-					kickHitPerformed = true;
-				}
-			}
-		}
-		if (charState == KICK_IDLE && animator.m_CurrentTime > 0.7f) {
-			kickHitPerformed = false;
+		if (deterministic)
+		{
+			// input
+			// -----
+			// consumes the events gathered since the last tick; replays substitute the recorded tick length
+			deltaTime = frameTime;
+			if (!input.BeginTick(deltaTime))
+				break;
+			auto tickStart = std::chrono::high_resolution_clock::now();
+
+			// streaming
+			// ---------
+			requestAssets(streamer, input);
+			streamer.Update(world.transform[world.Slot(player)].position, deltaTime);
+			streamer.Settle();
+
+			simulationTick(streamer, flowField, window, frames.Back());
+			frames.Publish();
+
+			auto tickEnd = std::chrono::high_resolution_clock::now();
+			tickMs.push_back(std::chrono::duration<float, std::milli>(tickEnd - tickStart).count());
+
+			// headless replays only run the simulation
+			if (headless)
+				continue;
 		}
 
+		// the newest tick the simulation has finished; the previous one is drawn again if none arrived
+		frames.Consume();
+		const FramePacket& packet = frames.Front();
 
-		switch (enemyState) {
-		case IDLE:
-			if ((glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)) {
-				enemyBlendAmount = 0.0f;
-				enemyAnimator.PlayAnimation(&enemyIdleAnimation, &enemyWalkAnimation, enemyAnimator.m_CurrentTime, 0.0f, enemyBlendAmount);
-				enemyState = IDLE_WALK;
-			}
-			else if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
-				enemyBlendAmount = 0.0f;
-				enemyAnimator.PlayAnimation(&enemyIdleAnimation, &enemyAttackAnimation, enemyAnimator.m_CurrentTime, 0.0f, enemyBlendAmount);
-				enemyState = IDLE_ATTACK;
-			}
-			else if ((glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) || playEnemyDyingAnim) {
-				enemyBlendAmount = 0.0f;
-				enemyAnimator.PlayAnimation(&enemyIdleAnimation, &enemyDyingAnimation, enemyAnimator.m_CurrentTime, 0.0f, enemyBlendAmount);
-				enemyState = IDLE_DYING;
-			}
-			break;
-		case IDLE_WALK:
-			enemyBlendAmount += enemyBlendRate;
-			enemyBlendAmount = fmod(enemyBlendAmount, 1.0f);
-			enemyAnimator.PlayAnimation(&enemyIdleAnimation, &enemyWalkAnimation, enemyAnimator.m_CurrentTime, enemyAnimator.m_CurrentTime2, enemyBlendAmount);
-			if (enemyBlendAmount > 0.9f) {
-				enemyBlendAmount = 0.0f;
-				float startTime = enemyAnimator.m_CurrentTime2;
-				enemyAnimator.PlayAnimation(&enemyWalkAnimation, NULL, startTime, 0.0f, enemyBlendAmount);
-				enemyState = WALK;
-			}
-			break;
-		case WALK:
-			enemyAnimator.PlayAnimation(&enemyWalkAnimation, NULL, enemyAnimator.m_CurrentTime, enemyAnimator.m_CurrentTime2, enemyBlendAmount);
-			if ((glfwGetKey(window, GLFW_KEY_I) != GLFW_PRESS)) {
-				enemyState = WALK_IDLE;
-			}
-			break;
-		case WALK_IDLE:
-			enemyBlendAmount += enemyBlendRate;
-			enemyBlendAmount = fmod(enemyBlendAmount, 1.0f);
-			enemyAnimator.PlayAnimation(&enemyWalkAnimation, &enemyIdleAnimation, enemyAnimator.m_CurrentTime, enemyAnimator.m_CurrentTime2, enemyBlendAmount);
-			if (enemyBlendAmount > 0.9f) {
-				enemyBlendAmount = 0.0f;
-				float startTime = enemyAnimator.m_CurrentTime2;
-				enemyAnimator.PlayAnimation(&enemyIdleAnimation, NULL, startTime, 0.0f, enemyBlendAmount);
-				enemyState = IDLE;
-			}
-			break;
-		case IDLE_ATTACK:
-			enemyBlendAmount += enemyBlendRate;
-			enemyBlendAmount = fmod(enemyBlendAmount, 1.0f);
-			enemyAnimator.PlayAnimation(&enemyIdleAnimation, &enemyAttackAnimation, enemyAnimator.m_CurrentTime, enemyAnimator.m_CurrentTime2, enemyBlendAmount);
-			if (enemyBlendAmount > 0.9f) {
-				enemyBlendAmount = 0.0f;
-				float startTime = enemyAnimator.m_CurrentTime2;
-				enemyAnimator.PlayAnimation(&enemyAttackAnimation, NULL, startTime, 0.0f, enemyBlendAmount);
-				enemyState = ATTACK_IDLE;
-			}
-			break;
-		case ATTACK_IDLE:
-			if (enemyAnimator.m_CurrentTime > 0.7f) {
-				enemyBlendAmount += enemyBlendRate;
-				enemyBlendAmount = fmod(enemyBlendAmount, 1.0f);
-				enemyAnimator.PlayAnimation(&enemyAttackAnimation, &enemyIdleAnimation, enemyAnimator.m_CurrentTime, enemyAnimator.m_CurrentTime2, enemyBlendAmount);
-				if (enemyBlendAmount > 0.9f) {
-					enemyBlendAmount = 0.0f;
-					float startTime = enemyAnimator.m_CurrentTime2;
-					enemyAnimator.PlayAnimation(&enemyIdleAnimation, NULL, startTime, 0.0f, enemyBlendAmount);
-					enemyState = IDLE;
-				}
-				printf("attack_idle \n");
-			}
-			else {
-			}
-			break;
-		case IDLE_DYING:
-			enemyBlendAmount += enemyBlendRate;
-			enemyBlendAmount = fmod(enemyBlendAmount, 1.0f);
-			enemyAnimator.PlayAnimation(&enemyIdleAnimation, &enemyDyingAnimation, enemyAnimator.m_CurrentTime, enemyAnimator.m_CurrentTime2, enemyBlendAmount);
-			if (enemyBlendAmount > 0.9f) {
-				enemyBlendAmount = 0.0f;
-				float startTime = enemyAnimator.m_CurrentTime2;
-				enemyAnimator.PlayAnimation(&enemyDyingAnimation, NULL, startTime, 0.0f, enemyBlendAmount);
-				isEnemyAlive = false;
-			}
-			break;
+		// streaming
+		// ---------
+		// finishes loads and evicts on this thread, where the GL context is; the simulation
+		// picks up what changed at the start of its next tick
+		CachedModel* kindModelPtrs[CHARACTER_KIND_COUNT];
+		{
+			std::lock_guard<std::mutex> lock(assetMutex);
+			if (!deterministic)
+				streamer.Update(packet.playerPosition, frameTime);
+			for (int k = 0; k < CHARACTER_KIND_COUNT; k++)
+				kindModelPtrs[k] = streamer.GetModel(kindModels[k]);
 		}
 
-		enemyAnimator.UpdateAnimation(deltaTime);
-
-		glm::mat4 enemyAttackModel = glm::mat4(1.0f);
-		enemyAttackModel = glm::translate(enemyAttackModel, enemyPosition);
-		enemyAttackModel = glm::scale(enemyAttackModel, glm::vec3(.5f, .5f, .5f));
-		// Enemy rotation: enemyYaw is 0.0f, the model is loaded "forward" so no extra 180 deg
-		enemyAttackModel = glm::rotate(enemyAttackModel, glm::radians(0.0f + enemyYaw), glm::vec3(0.0f, 1.0f, 0.0f));
-
-		bool showEnemyHitbox = false;
-		float playerScale = 0.5f; // Player's scale
-		static bool enemyAttackHitPerformed = false;
-
-		// Check collision when enemy is in the attack phase of the ATTACK_IDLE state
-		if (enemyState == ATTACK_IDLE && enemyAnimator.m_CurrentTime > 0.3f && enemyAnimator.m_CurrentTime < 0.6f) {
-			showEnemyHitbox = true;
-			if (!enemyAttackHitPerformed) {
-				if (isPlayerAlive && checkEnemyAttackCollision(enemyAttackModel, playerPosition, playerScale)) {
-					damagePlayer(150.0f); // Adjust damage as needed
-					enemyAttackHitPerformed = true;
+		if (dynamicResolution)
+			resolution.BeginFrame();
+
+		// shadows
+		// -------
+		// the dungeon's maps are only drawn when a torch starts casting; the characters in
+		// reach of a casting torch are drawn into its overlay every frame
+		shadows.SelectCasters(torches, packet.playerPosition);
+		shadows.Render(shadowShader, animShadowShader,
+			[&](Shader& depthShader) {
+				depthShader.setMat4("model", mapTransform);
+				mapModel.Draw(depthShader);
+			},
+			[&](Shader& depthShader, const glm::vec3& lightPosition, float radius) {
+				bool drawn = false;
+				for (size_t i = 0; i < packet.characters.size(); i++)
+				{
+					const CharacterDraw& character = packet.characters[i];
+					if (!kindModelPtrs[character.kind] || glm::length(glm::vec3(character.model[3]) - lightPosition) > radius + CHARACTER_SHADOW_REACH)
+						continue;
+					for (unsigned int j = 0; j < character.boneCount; ++j)
+						depthShader.setMat4("finalBonesMatrices[" + std::to_string(j) + "]", packet.palette[character.firstBone + j]);
+					depthShader.setMat4("model", character.model);
+					kindModelPtrs[character.kind]->Draw(depthShader);
+					drawn = true;
 				}
-			}
-		}
-		// Reset the hit flag after the attack animation window
-		if (enemyState == ATTACK_IDLE && enemyAnimator.m_CurrentTime > 0.7f) {
-			enemyAttackHitPerformed = false;
-		}
-
-
-		switch (merchantState) {
-		case IDLE:
-			if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) {
-				merchantBlendAmount = 0.0f;
-				merchantAnimator.PlayAnimation(&merchantIdleAnimation, &merchantTalkAnimation, merchantAnimator.m_CurrentTime, 0.0f, merchantBlendAmount);
-				merchantState = IDLE_TALK;
-				isTalkingToMerchant = true;
-			}
-			break;
-		case IDLE_TALK:
-			merchantBlendAmount += merchantBlendRate;
-			merchantBlendAmount = fmod(merchantBlendAmount, 1.0f);
-			merchantAnimator.PlayAnimation(&merchantIdleAnimation, &merchantTalkAnimation, merchantAnimator.m_CurrentTime, merchantAnimator.m_CurrentTime2, merchantBlendAmount);
-			if (merchantBlendAmount > 0.9f) {
-				merchantBlendAmount = 0.0f;
-				float startTime = merchantAnimator.m_CurrentTime2;
-				merchantAnimator.PlayAnimation(&merchantTalkAnimation, NULL, startTime, 0.0f, merchantBlendAmount);
-				merchantState = TALK;
-			}
-			break;
-		case TALK:
-			merchantAnimator.PlayAnimation(&merchantTalkAnimation, NULL, merchantAnimator.m_CurrentTime, merchantAnimator.m_CurrentTime2, merchantBlendAmount);
-			if ((glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) || !isTalkingToMerchant) {
-				merchantState = TALK_IDLE;
-				isTalkingToMerchant = false;
-			}
-			break;
-		case TALK_IDLE:
-			merchantBlendAmount += merchantBlendRate;
-			merchantBlendAmount = fmod(merchantBlendAmount, 1.0f);
-			merchantAnimator.PlayAnimation(&merchantTalkAnimation, &merchantIdleAnimation, merchantAnimator.m_CurrentTime, merchantAnimator.m_CurrentTime2, merchantBlendAmount);
-			if (merchantBlendAmount > 0.9f) {
-				merchantBlendAmount = 0.0f;
-				float startTime = merchantAnimator.m_CurrentTime2;
-				merchantAnimator.PlayAnimation(&merchantIdleAnimation, NULL, startTime, 0.0f, merchantBlendAmount);
-				merchantState = IDLE;
-			}
-			break;
-		}
-
-		merchantAnimator.UpdateAnimation(deltaTime);
-
-
+				return drawn;
+			});
+		const ShadowCache::Stats& shadowStats = shadows.GetStats();
+		shadowTimings.frames++;
+		shadowTimings.staticRenders += shadowStats.staticRenders;
+		shadowTimings.overlayRenders += shadowStats.overlayRenders;
+		shadowTimings.timed += shadowStats.timed;
+		shadowTimings.staticMs += shadowStats.staticMs;
+		shadowTimings.overlayMs += shadowStats.overlayMs;
+		shadowTimings.maxMs = std::max(shadowTimings.maxMs, shadowStats.maxMs);
 
 		// render
 		// ------
+		glm::ivec2 outputSize = glm::ivec2(renderWidth, renderHeight);
+		if (window)
+			glfwGetFramebufferSize(window, &outputSize.x, &outputSize.y);
+		if (offscreen)
+			renderTarget.Bind();
+		if (dynamicResolution)
+			resolution.BeginScene(outputSize);
 		glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glm::mat4 playerRotationMatrix = glm::mat4(1.0f);
-		playerRotationMatrix = glm::rotate(playerRotationMatrix, glm::radians(playerYaw), glm::vec3(0, 1, 0));
-
-		playerForward = glm::normalize(glm::vec3(playerRotationMatrix * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
-
 		// don't forget to enable shader before setting uniforms
 		ourShader.use();
 
 		// view/projection transformations
-		float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+		float aspect = (float)renderWidth / (float)renderHeight;
 		float orthoScale = 4.0f;
 		glm::mat4 projection = glm::ortho(-orthoScale * aspect, orthoScale * aspect, -orthoScale, orthoScale, -50.0f, 50.0f);
-		glm::vec3 camTarget = playerPosition;
+		glm::vec3 camTarget = packet.playerPosition;
 		glm::vec3 camPos = camTarget + glm::vec3(5.0f, 5.0f, 5.0f);
 		glm::mat4 view = glm::lookAt(camPos, camTarget, glm::vec3(0.0f, 1.0f, 0.0f));
 
 
-		ourShader.setMat4("projection", projection);
-		ourShader.setMat4("view", view);
-
-		// render the loaded model
-		glm::mat4 model = glm::mat4(1.0f);
-
-		// Draw the player
-		if (isPlayerAlive) {
-			auto transforms = animator.GetFinalBoneMatrices();
-			for (int i = 0; i < transforms.size(); ++i)
-				ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
-
-			model = glm::translate(model, playerPosition);
-			model = glm::scale(model, glm::vec3(.5f, .5f, .5f));
-			model = glm::rotate(model, glm::radians(180.0f + playerYaw), glm::vec3(0.0f, 1.0f, 0.0f));
-			ourShader.setMat4("model", model);
-			ourModel.Draw(ourShader);
+		// lights: flicker, then sort into the froxels of this view
+		frameLights = torches;
+		for (size_t i = 0; i < frameLights.size(); i++)
+		{
+			float flicker = 0.85f + 0.15f * std::sin(packet.time * 9.0f + i * 1.7f) * std::sin(packet.time * 4.3f + i * 0.9f);
+			frameLights[i].color *= flicker;
 		}
+		lighting.Assign(frameLights, view, projection);
+		lighting.Upload();
+		const ClusteredLighting::Stats& lightingStats = lighting.GetStats();
+		lightingTimings.frames++;
+		lightingTimings.visibleLights += lightingStats.visibleLights;
+		lightingTimings.assignUs += lightingStats.assignUs;
+		lightingTimings.maxAssignUs = std::max(lightingTimings.maxAssignUs, lightingStats.assignUs);
+		lightingTimings.maxPerCluster = std::max(lightingTimings.maxPerCluster, lightingStats.maxPerCluster);
+		lightingTimings.overflowingClusters += lightingStats.overflowingClusters;
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glm::vec2 viewportSize = glm::vec2((float)viewport[2], (float)viewport[3]);
 
-		//ourShader.use();
-
-		//auto enemyTransforms = enemyAnimator.GetFinalBoneMatrices();
-		//for (int i = 0; i < enemyTransforms.size(); ++i)
-		//	ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", enemyTransforms[i]);
-
-		//model = glm::mat4(1.0f);
-		//model = glm::translate(model, enemyPosition); // translate it down so it's at the center of the scene
-		//model = glm::scale(model, glm::vec3(.5f, .5f, .5f));	// it's a bit too big for our scene, so scale it down
-		//model = glm::rotate(model, glm::radians(0.0f + enemyYaw), glm::vec3(0.0f, 1.0f, 0.0f));
-		//ourShader.setMat4("model", model);
-		//enemyModel.Draw(ourShader);
+		ourShader.setMat4("projection", projection);
+		ourShader.setMat4("view", view);
+		lighting.Bind(ourShader, viewportSize, AMBIENT_LIGHT);
+		shadows.Bind(ourShader, true);
 
+		// Draw the characters
+		for (size_t i = 0; i < packet.characters.size(); i++)
+		{
+			const CharacterDraw& character = packet.characters[i];
+			if (!kindModelPtrs[character.kind])
+				continue;
 
-		// Draw the enemy
-		ourShader.use();
+			for (unsigned int j = 0; j < character.boneCount; ++j)
+				ourShader.setMat4("finalBonesMatrices[" + std::to_string(j) + "]", packet.palette[character.firstBone + j]);
 
-		if (isEnemyAlive) {
-			auto enemyTransforms = enemyAnimator.GetFinalBoneMatrices();
-			for (int i = 0; i < enemyTransforms.size(); ++i)
-				ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", enemyTransforms[i]);
-
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, enemyPosition);
-			model = glm::scale(model, glm::vec3(.5f, .5f, .5f));
-			model = glm::rotate(model, glm::radians(0.0f + enemyYaw), glm::vec3(0.0f, 1.0f, 0.0f));
-			ourShader.setMat4("model", model);
-			enemyModel.Draw(ourShader);
+			ourShader.setMat4("model", character.model);
+			kindModelPtrs[character.kind]->Draw(ourShader);
 		}
 
+		// merchant close-up while talking
+		if (packet.merchantTalking && kindModelPtrs[MERCHANT]) {
+			const CharacterDraw& merchantTalk = packet.merchantCloseUp;
+			for (unsigned int i = 0; i < merchantTalk.boneCount; ++i)
+				ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", packet.palette[merchantTalk.firstBone + i]);
 
-		// Draw the merchant
-		ourShader.use();
-
-		auto merchantTransforms = merchantAnimator.GetFinalBoneMatrices();
-		for (int i = 0; i < merchantTransforms.size(); ++i)
-			ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", merchantTransforms[i]);
-
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, merchantPosition);
-		model = glm::scale(model, glm::vec3(.5f, .5f, .5f));
-		model = glm::rotate(model, glm::radians(90.0f + merchantYaw), glm::vec3(0.0f, 1.0f, 0.0f));
-		ourShader.setMat4("model", model);
-		merchantModel.Draw(ourShader);
-
-
-		ourShader.use();
-
-		if (isTalkingToMerchant) {
-			auto merchantTalkTransforms = merchantAnimator.GetFinalBoneMatrices();
-			for (int i = 0; i < merchantTalkTransforms.size(); ++i)
-				ourShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", merchantTalkTransforms[i]);
-
+			// the froxels belong to the game camera, so the close-up is drawn unlit
 			glm::mat4 straightFrontView = camera.GetViewMatrix();
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, glm::vec3(-2.5, -1.75, -0.55));
-			model = glm::scale(model, glm::vec3(4.5f, 4.5f, 4.5f));
-			model = glm::rotate(model, glm::radians(25.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 			ourShader.setMat4("view", straightFrontView);
-			ourShader.setMat4("model", model);
-			merchantModel.Draw(ourShader);
+			ourShader.setInt("clusterLighting", 0);
+			shadows.Bind(ourShader, false);
+			ourShader.setMat4("model", merchantTalk.model);
+			kindModelPtrs[MERCHANT]->Draw(ourShader);
 		}
 
 		// Draw the map
 		mapShader.use();
 		mapShader.setMat4("projection", projection);
 		mapShader.setMat4("view", view);
+		lighting.Bind(mapShader, viewportSize, AMBIENT_LIGHT);
+		shadows.Bind(mapShader, true);
 
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-		model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-		model = glm::rotate(model, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		mapShader.setMat4("model", model);
+		mapShader.setMat4("model", mapTransform);
 		mapModel.Draw(mapShader);
 
 
-		if (showHitbox) {
-			hitboxShader.use();
-			hitboxShader.setMat4("projection", projection);
-			hitboxShader.setMat4("view", view);
-
-			// Apply the attack box offset and player transform
-			glm::mat4 hitboxModel = playerAttackModel;
-			hitboxModel = glm::translate(hitboxModel, HITBOX_OFFSET);
-
-			hitboxShader.setMat4("model", hitboxModel);
-
-			//glDisable(GL_DEPTH_TEST); // Draw on top for visibility
-			glLineWidth(5.0f); // Make the wireframe thick
-			glBindVertexArray(hitboxVAO);
+		// attack hitboxes inside their hit window, and placeholder boxes for characters
+		// that are in range but still streaming in
+		hitboxShader.use();
+		hitboxShader.setMat4("projection", projection);
+		hitboxShader.setMat4("view", view);
+		glBindVertexArray(hitboxVAO);
+		for (size_t i = 0; i < packet.boxes.size(); i++)
+		{
+			const BoxDraw& box = packet.boxes[i];
+			hitboxShader.setMat4("model", box.model);
+			if (box.hitbox)
+				glLineWidth(5.0f); // Make the wireframe thick
 			// Render as GL_LINES (each index pair is a line segment)
 			glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
-			glBindVertexArray(0);
 			glLineWidth(1.0f);
-			//glEnable(GL_DEPTH_TEST);
 		}
-		
-
-		if (showEnemyHitbox) {
-			hitboxShader.use();
-			hitboxShader.setMat4("projection", projection);
-			hitboxShader.setMat4("view", view);
+		glBindVertexArray(0);
 
-			glm::mat4 enemyHitboxModel = enemyAttackModel;
-			enemyHitboxModel = glm::translate(enemyHitboxModel, ENEMY_HITBOX_OFFSET);
+		// upscale to the output
+		if (dynamicResolution)
+		{
+			if (offscreen)
+				renderTarget.Bind();
+			else
+			{
+				glBindFramebuffer(GL_FRAMEBUFFER, 0);
+				glViewport(0, 0, outputSize.x, outputSize.y);
+			}
+			resolution.Resolve(upscaleShader);
+		}
 
-			//// Calculate the enemy's attack model matrix (same as used for collision)
-			//glm::mat4 enemyHitboxModel = glm::mat4(1.0f);
-			//enemyHitboxModel = glm::translate(enemyHitboxModel, enemyPosition);
-			//enemyHitboxModel = glm::scale(enemyHitboxModel, glm::vec3(.5f, .5f, .5f)); // Enemy model scale
-			//enemyHitboxModel = glm::rotate(enemyHitboxModel, glm::radians(0.0f + enemyYaw), glm::vec3(0.0f, 1.0f, 0.0f));
+		// HUD and health bars, batched into one draw
+		ui.Begin(projection * view, glm::vec2(outputSize));
+		drawHud(ui, packet);
+		ui.End(uiShader);
+		const UiBatch::Stats& uiStats = ui.GetStats();
+		uiTimings.frames++;
+		uiTimings.quads += uiStats.quads;
+		uiTimings.draws += uiStats.draws;
+		uiTimings.maxQuads = std::max(uiTimings.maxQuads, uiStats.quads);
+		uiTimings.dropped += uiStats.dropped;
+		if (dynamicResolution)
+			resolution.EndFrame();
 
-			//// Apply the enemy attack box offset
-			//enemyHitboxModel = glm::translate(enemyHitboxModel, ENEMY_HITBOX_OFFSET);
+		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+		// -------------------------------------------------------------------------------
+		if (window)
+		{
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+		else
+		{
+			// nothing presents offscreen, so wait for the frame to be drawn for the timings
+			glFinish();
+		}
 
-			hitboxShader.setMat4("model", enemyHitboxModel);
+		// frame cost and how long the shown tick's input took to reach the screen
+		auto frameEnd = std::chrono::high_resolution_clock::now();
+		renderTiming.Add(std::chrono::duration<float, std::milli>(frameEnd - frameStart).count());
+		bool newTick = packet.tick != shownTick || packetsShown == 0;
+		if (newTick)
+		{
+			packetLatency.Add(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - packet.sampled).count());
+			packetsShown++;
+			shownTick = packet.tick;
+		}
 
-			glLineWidth(5.0f); // Make the wireframe thick
-			glBindVertexArray(hitboxVAO);
-			glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
-			glBindVertexArray(0);
-			glLineWidth(1.0f);
+		// captures are taken outside the frame timing
+		if (offscreen && (captureDir || goldenDir) && newTick && packet.tick % captureEvery == 0)
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "frame_%06llu.png", (unsigned long long)packet.tick);
+			captureFrame(renderTarget, name);
 		}
+	}
 
-		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-		// -------------------------------------------------------------------------------
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+	if (simulation.joinable())
+	{
+		simulationRunning = false;
+		simulation.join();
 	}
+	auto runEnd = std::chrono::high_resolution_clock::now();
+	float runSeconds = std::chrono::duration<float>(runEnd - runStart).count();
+	if (deterministic)
+	{
+		printTickTimings(tickMs, runSeconds);
+		std::cout << "World checksum: " << std::hex << worldChecksum(world) << std::dec << std::endl;
+	}
+	printThreadTimings(runSeconds);
+	if (offscreen)
+	{
+		std::cout << "Offscreen: " << renderTiming.count << " frames at " << renderWidth << "x" << renderHeight
+			<< ", " << renderTiming.count / runSeconds << " fps";
+		if (goldenDir)
+			std::cout << ", " << captures - goldenMismatches << " of " << captures << " frames match the goldens";
+		else if (captureDir)
+			std::cout << ", " << captures << " frames captured";
+		std::cout << std::endl;
+	}
+	printSnapshotStats();
+	printLightingStats();
+	printShadowStats();
+	printUiStats();
+	if (dynamicResolution)
+		printResolutionStats();
+	if (serverAddress)
+	{
+		const ArenaClient::Stats& stats = client.GetStats();
+		std::cout << "Arena connection: " << stats.snapshots << " snapshots, " << stats.dropped << " dropped, "
+			<< stats.bytesIn / 1024 << " KB in, " << stats.bytesOut / 1024 << " KB out" << std::endl;
+	}
+	client.Disconnect();
+	input.Stop();
+
+	// models own GL objects, release them while the context is still alive
+	streamer.ReleaseAll();
+	lighting.Release();
+	shadows.Release();
+	ui.Release();
+	resolution.Release();
+	renderTarget.Destroy();
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
-	glfwTerminate();
-	return 0;
+	if (window)
+		glfwTerminate();
+	return goldenMismatches > 0 ? 1 : 0;
 }
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow* window)
+// process all input: query this tick's key state whether relevant keys are pressed/released and react accordingly
+// -----------------------------------------------------------------------------------------------------------------
+void processInput(GLFWwindow* window, const InputQueue& input)
 {
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+	if (window && input.Down(GLFW_KEY_ESCAPE))
 		glfwSetWindowShouldClose(window, true);
 
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		updatePlayerPosition(1);
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		updatePlayerPosition(-1);
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		playerYaw += yawSpeed * deltaTime;
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		playerYaw -= yawSpeed * deltaTime;
-	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
-		playerYaw = 0.0f;
-	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
-		playerYaw += 90.0f * deltaTime;
-	/*if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
+	TransformComponent& t = world.transform[world.Slot(player)];
+	if (input.Down(GLFW_KEY_R))
+		t.yaw = 0.0f;
+	if (input.Down(GLFW_KEY_T))
+		t.yaw += 90.0f * deltaTime;
+
+	// debug: play a knight clip directly
+	const int debugKeys[] = { GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3, GLFW_KEY_4, GLFW_KEY_5 };
+	const ClipId debugClips[] = { CLIP_IDLE, CLIP_WALK, CLIP_ATTACK, CLIP_KICK, CLIP_TURN };
+	AnimStateComponent& a = world.anim[world.Slot(player)];
+	for (int i = 0; i < 5; i++) {
+		if (input.Down(debugKeys[i]) && characterDefs[KNIGHT].HasClip(debugClips[i])) {
+			a.clip0 = debugClips[i];
+			a.clip1 = CLIP_NONE;
+			a.time0 = 0.0f;
+			a.time1 = 0.0f;
+			a.blend = 0.0f;
+		}
+	}
+	/*if (input.Down(GLFW_KEY_UP))
 		playerPosition += glm::vec3(0.0f, 1.0f, 0.0f) * 2.0f * deltaTime;
-	if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
+	if (input.Down(GLFW_KEY_DOWN))
 		playerPosition += glm::vec3(0.0f, -1.0f, 0.0f) * 2.0f * deltaTime;*/
 }
 
@@ -828,6 +863,14 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	glViewport(0, 0, width, height);
 }
 
+// glfw: key presses and releases are queued and applied at the start of the next tick
+// ------------------------------------------------------------------------------------
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if (action != GLFW_REPEAT)
+		input.Push(key, action == GLFW_PRESS, glfwGetTime());
+}
+
 // glfw: whenever the mouse moves, this callback is called
 // -------------------------------------------------------
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
@@ -839,13 +882,9 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 		firstMouse = false;
 	}
 
-	float xoffset = xpos - lastX;
-	float yoffset = lastY - ypos; // reversed since y-coordinates go from bottom to top
-
+	// the camera follows the player, so the mouse doesn't turn it; only its position is kept
 	lastX = xpos;
 	lastY = ypos;
-
-	//camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
@@ -886,19 +925,6 @@ unsigned int loadCubemap(vector<std::string> faces)
 }
 
 
-void updatePlayerPosition(int direction)
-{
-	if (direction == 1) {
-		playerPosition += playerForward * float(direction) * moveSpeed * deltaTime;
-
-	}
-	else if (direction == -1) {
-		playerPosition += playerForward * float(direction) * moveSpeed * deltaTime;
-
-	}
-}
-
-
 void setupHitbox()
 {
 	float vertices[] = {
@@ -944,107 +970,689 @@ void setupHitbox()
 }
 
 
-bool checkAABBCollision(const glm::mat4& playerAttackModel, const glm::vec3& enemyPos, float enemyScale)
+
+
+// W/A/S/D/SPACE/K/F/G drive the knight, SHIFT runs, locally or on the arena server
+uint32_t knightIntent(const InputQueue& input)
 {
-	float enemyMinX = enemyPos.x - enemyScale;
-	float enemyMaxX = enemyPos.x + enemyScale;
-	float enemyMinY = enemyPos.y - enemyScale;
-	float enemyMaxY = enemyPos.y + enemyScale * 2.0f;
-	float enemyMinZ = enemyPos.z - enemyScale;
-	float enemyMaxZ = enemyPos.z + enemyScale;
-
-	glm::vec3 corners[8] = {
-		glm::vec3(-HITBOX_WIDTH / 2, -HITBOX_HEIGHT / 2, -HITBOX_DEPTH / 2) + HITBOX_OFFSET,
-		glm::vec3(HITBOX_WIDTH / 2, -HITBOX_HEIGHT / 2, -HITBOX_DEPTH / 2) + HITBOX_OFFSET,
-		glm::vec3(HITBOX_WIDTH / 2,  HITBOX_HEIGHT / 2, -HITBOX_DEPTH / 2) + HITBOX_OFFSET,
-		glm::vec3(-HITBOX_WIDTH / 2,  HITBOX_HEIGHT / 2, -HITBOX_DEPTH / 2) + HITBOX_OFFSET,
-
-		glm::vec3(-HITBOX_WIDTH / 2, -HITBOX_HEIGHT / 2,  HITBOX_DEPTH / 2) + HITBOX_OFFSET,
-		glm::vec3(HITBOX_WIDTH / 2, -HITBOX_HEIGHT / 2,  HITBOX_DEPTH / 2) + HITBOX_OFFSET,
-		glm::vec3(HITBOX_WIDTH / 2,  HITBOX_HEIGHT / 2,  HITBOX_DEPTH / 2) + HITBOX_OFFSET,
-		glm::vec3(-HITBOX_WIDTH / 2,  HITBOX_HEIGHT / 2,  HITBOX_DEPTH / 2) + HITBOX_OFFSET
-	};
+	uint32_t intent = 0;
+	if (input.Down(GLFW_KEY_W)) intent |= INTENT_FORWARD;
+	if (input.Down(GLFW_KEY_LEFT_SHIFT)) intent |= INTENT_RUN;
+	if (input.Down(GLFW_KEY_S)) intent |= INTENT_BACK;
+	if (input.Down(GLFW_KEY_A)) intent |= INTENT_TURN_LEFT;
+	if (input.Down(GLFW_KEY_D)) intent |= INTENT_TURN_RIGHT;
+	if (input.Down(GLFW_KEY_SPACE)) intent |= INTENT_ATTACK;
+	if (input.Down(GLFW_KEY_K)) intent |= INTENT_KICK;
+	if (input.Down(GLFW_KEY_F)) intent |= INTENT_TURN_AROUND;
+	if (input.Down(GLFW_KEY_G)) intent |= INTENT_DIE;
+	return intent;
+}
 
-	for (int i = 0; i < 8; ++i)
+// keyboard controllers: the knight as above, M the merchant; monsters are driven by updateMonsterAI
+void updateControllers(World& world, const InputQueue& input)
+{
+	uint32_t knight = knightIntent(input);
+	uint32_t merchantIntent = 0;
+	if (input.Down(GLFW_KEY_M)) merchantIntent |= INTENT_TALK;
+
+	for (unsigned int i = 0; i < world.Count(); i++)
 	{
-		glm::vec4 worldCorner = playerAttackModel * glm::vec4(corners[i], 1.0f);
+		if (world.kind[i] == KNIGHT)
+			world.anim[i].intent = knight;
+		else if (world.kind[i] == MERCHANT)
+			world.anim[i].intent = merchantIntent;
+	}
+}
+
+// the dungeon mesh in world space, three corners per triangle
+void collectMapTriangles(CachedModel& map, const glm::mat4& transform, std::vector<glm::vec3>& triangles)
+{
+	triangles.clear();
+	for (unsigned int m = 0; m < map.meshes.size(); m++)
+	{
+		const std::vector<Vertex>& vertices = map.meshes[m].geometry->vertices;
+		const std::vector<unsigned int>& indices = map.meshes[m].geometry->indices;
+		for (unsigned int i = 0; i + 2 < indices.size(); i += 3)
+			for (unsigned int j = 0; j < 3; j++)
+				triangles.push_back(glm::vec3(transform * glm::vec4(vertices[indices[i + j]].Position, 1.0f)));
+	}
+}
 
-		// Check if any world-space corner is inside the enemy's AABB
-		if (worldCorner.x >= enemyMinX && worldCorner.x <= enemyMaxX &&
-			worldCorner.y >= enemyMinY && worldCorner.y <= enemyMaxY &&
-			worldCorner.z >= enemyMinZ && worldCorner.z <= enemyMaxZ)
+// hash of the simulated state, to tell whether two runs of the same log ended up identical
+uint64_t worldChecksum(const World& world)
+{
+	unsigned int count = world.Count();
+	uint64_t hash = ResourceCache::HashBytes(&count, sizeof(count));
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const TransformComponent& t = world.transform[i];
+		const HealthComponent& h = world.health[i];
+		const AnimStateComponent& a = world.anim[i];
+		hash = ResourceCache::HashBytes(&t.position, sizeof(t.position), hash);
+		hash = ResourceCache::HashBytes(&t.yaw, sizeof(t.yaw), hash);
+		hash = ResourceCache::HashBytes(&h.health, sizeof(h.health), hash);
+		hash = ResourceCache::HashBytes(&h.alive, sizeof(h.alive), hash);
+		hash = ResourceCache::HashBytes(&a.state, sizeof(a.state), hash);
+		hash = ResourceCache::HashBytes(&a.clip0, sizeof(a.clip0), hash);
+		hash = ResourceCache::HashBytes(&a.time0, sizeof(a.time0), hash);
+		hash = ResourceCache::HashBytes(&a.blend, sizeof(a.blend), hash);
+	}
+	return hash;
+}
+
+// the simulation state is the world, the AI's round-robin position, the flow field with its
+// search in progress, the simulated time and the HUD's feed, which is timed by it
+void captureState(const FlowField& flowField, std::vector<uint8_t>& state)
+{
+	SnapshotWriter writer(state);
+	writer.Write(aiCursor);
+	writer.Write(simulationTime);
+	writer.Write((uint32_t)combatFeed.size());
+	for (size_t i = 0; i < combatFeed.size(); i++)
+	{
+		// field by field, so the struct's padding doesn't end up in the snapshot
+		const HudMessage& message = combatFeed[i];
+		writer.Write(message.kind);
+		writer.Write((uint8_t)message.defeated);
+		writer.Write(message.health);
+		writer.Write(message.time);
+	}
+	WorldSnapshot::Write(writer, world);
+	FlowFieldSnapshot::Write(writer, flowField);
+}
+
+bool restoreState(FlowField& flowField, const std::vector<uint8_t>& state)
+{
+	SnapshotReader reader(state.data(), state.size());
+	unsigned int cursor = 0;
+	float time = 0.0f;
+	uint32_t messages = 0;
+	std::deque<HudMessage> feed;
+	bool ok = reader.Read(cursor) && reader.Read(time) && reader.Read(messages) && messages <= HUD_MESSAGE_LINES;
+	for (uint32_t i = 0; ok && i < messages; i++)
+	{
+		HudMessage message;
+		uint8_t defeated = 0;
+		ok = reader.Read(message.kind) && reader.Read(defeated) && reader.Read(message.health) && reader.Read(message.time);
+		message.defeated = defeated != 0;
+		feed.push_back(message);
+	}
+	// read aside, so a snapshot that fails halfway leaves the running game as it was
+	static World restoredWorld;
+	static FlowField restoredField;
+	restoredField = flowField;
+	if (!ok || !WorldSnapshot::Read(reader, restoredWorld) || !FlowFieldSnapshot::Read(reader, restoredField))
+	{
+		std::cout << "Failed to restore snapshot" << std::endl;
+		return false;
+	}
+	std::swap(world, restoredWorld);
+	std::swap(flowField, restoredField);
+	aiCursor = cursor;
+	simulationTime = time;
+	combatFeed.swap(feed);
+	return true;
+}
+
+void saveTickSnapshot(const FlowField& flowField, uint32_t tick)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	captureState(flowField, snapshotScratch);
+	snapshotHistory.Save(tick, snapshotScratch);
+	int next = crashDumpReady.load() == 0 ? 1 : 0;
+	EncodeSnapshotFile(tick, snapshotScratch, crashDumps[next]);
+	crashDumpReady.store(next);
+	auto end = std::chrono::high_resolution_clock::now();
+
+	float us = std::chrono::duration<float, std::micro>(end - start).count();
+	snapshotTimings.saves++;
+	snapshotTimings.saveUs += us;
+	snapshotTimings.maxSaveUs = std::max(snapshotTimings.maxSaveUs, us);
+	snapshotTimings.rawBytes += snapshotHistory.LastRawBytes();
+	snapshotTimings.encodedBytes += snapshotHistory.LastEncodedBytes();
+}
+
+bool rewindTo(FlowField& flowField, uint32_t tick)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	bool restored = snapshotHistory.Restore(tick, snapshotScratch) && restoreState(flowField, snapshotScratch);
+	auto end = std::chrono::high_resolution_clock::now();
+	if (!restored)
+		return false;
+
+	float us = std::chrono::duration<float, std::micro>(end - start).count();
+	snapshotTimings.restores++;
+	snapshotTimings.restoreUs += us;
+	snapshotTimings.maxRestoreUs = std::max(snapshotTimings.maxRestoreUs, us);
+	std::cout << "Snapshot restore: " << us << " us" << std::endl;
+	return true;
+}
+
+void printSnapshotStats()
+{
+	const SnapshotTimings& s = snapshotTimings;
+	if (s.saves == 0)
+		return;
+	std::cout << "Snapshots: " << s.saves << " saved, avg " << s.saveUs / s.saves << " us (max " << s.maxSaveUs << ")"
+		<< ", avg size " << s.rawBytes / s.saves << " bytes raw, " << s.encodedBytes / s.saves << " encoded" << std::endl;
+	if (s.restores > 0)
+		std::cout << "Snapshots: " << s.restores << " restored, avg " << s.restoreUs / s.restores << " us (max " << s.maxRestoreUs << ")" << std::endl;
+}
+
+// best effort: dump the last complete tick's state for post-mortem loading with F9. only
+// async-signal-safe calls in here, on the file image the simulation thread prepared
+void crashHandler(int signal)
+{
+	int ready = crashDumpReady.load();
+	if (ready >= 0)
+	{
+		const std::vector<uint8_t>& image = crashDumps[ready];
+#ifdef _WIN32
+		int fd = _open(CRASH_DUMP_PATH, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+		int fd = open(CRASH_DUMP_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+		size_t written = 0;
+		while (fd >= 0 && written < image.size())
 		{
-			return true;
+#ifdef _WIN32
+			int n = _write(fd, image.data() + written, (unsigned int)(image.size() - written));
+#else
+			ssize_t n = write(fd, image.data() + written, image.size() - written);
+#endif
+			if (n <= 0)
+				break;
+			written += (size_t)n;
 		}
+#ifdef _WIN32
+		if (fd >= 0)
+			_close(fd);
+#else
+		if (fd >= 0)
+			close(fd);
+#endif
 	}
+	std::signal(signal, SIG_DFL);
+	std::raise(signal);
+}
 
-	return false;
+void printTickTimings(std::vector<float>& tickMs, float totalSeconds)
+{
+	if (tickMs.empty())
+		return;
+	float sum = 0.0f;
+	for (size_t i = 0; i < tickMs.size(); i++)
+		sum += tickMs[i];
+	std::sort(tickMs.begin(), tickMs.end());
+	std::cout << "Ticks: " << tickMs.size() << " in " << totalSeconds << "s"
+		<< ", sim ms mean " << sum / tickMs.size()
+		<< " p50 " << tickMs[tickMs.size() / 2]
+		<< " p99 " << tickMs[(tickMs.size() * 99) / 100]
+		<< " max " << tickMs.back() << std::endl;
 }
 
-bool checkEnemyAttackCollision(const glm::mat4& enemyAttackModel, const glm::vec3& playerPos, float playerScale)
+// poses are kept by entity index, so they follow their entity through despawns and snapshot restores
+std::vector<glm::mat4>& entityPose(const World& world, unsigned int slot)
 {
-	// Player's AABB (Similar to how enemy AABB was defined in checkAABBCollision)
-	float playerMinX = playerPos.x - playerScale;
-	float playerMaxX = playerPos.x + playerScale;
-	float playerMinY = playerPos.y - playerScale;
-	float playerMaxY = playerPos.y + playerScale * 2.0f;
-	float playerMinZ = playerPos.z - playerScale;
-	float playerMaxZ = playerPos.z + playerScale;
-
-	// Enemy Attack Hitbox corners (Local space)
-	glm::vec3 corners[8] = {
-		glm::vec3(-ENEMY_HITBOX_WIDTH / 2, -ENEMY_HITBOX_HEIGHT / 2, -ENEMY_HITBOX_DEPTH / 2) + ENEMY_HITBOX_OFFSET,
-		glm::vec3(ENEMY_HITBOX_WIDTH / 2, -ENEMY_HITBOX_HEIGHT / 2, -ENEMY_HITBOX_DEPTH / 2) + ENEMY_HITBOX_OFFSET,
-		glm::vec3(ENEMY_HITBOX_WIDTH / 2,  ENEMY_HITBOX_HEIGHT / 2, -ENEMY_HITBOX_DEPTH / 2) + ENEMY_HITBOX_OFFSET,
-		glm::vec3(-ENEMY_HITBOX_WIDTH / 2,  ENEMY_HITBOX_HEIGHT / 2, -ENEMY_HITBOX_DEPTH / 2) + ENEMY_HITBOX_OFFSET,
-
-		glm::vec3(-ENEMY_HITBOX_WIDTH / 2, -ENEMY_HITBOX_HEIGHT / 2,  ENEMY_HITBOX_DEPTH / 2) + ENEMY_HITBOX_OFFSET,
-		glm::vec3(ENEMY_HITBOX_WIDTH / 2, -ENEMY_HITBOX_HEIGHT / 2,  ENEMY_HITBOX_DEPTH / 2) + ENEMY_HITBOX_OFFSET,
-		glm::vec3(ENEMY_HITBOX_WIDTH / 2,  ENEMY_HITBOX_HEIGHT / 2,  ENEMY_HITBOX_DEPTH / 2) + ENEMY_HITBOX_OFFSET,
-		glm::vec3(-ENEMY_HITBOX_WIDTH / 2,  ENEMY_HITBOX_HEIGHT / 2,  ENEMY_HITBOX_DEPTH / 2) + ENEMY_HITBOX_OFFSET
-	};
+	uint32_t index = world.EntityAt(slot).index;
+	if (index >= poses.size())
+		poses.resize(index + 1);
+	return poses[index];
+}
 
-	for (int i = 0; i < 8; ++i)
+// streaming: each kind is anchored at its living instance closest to the player, and clips are
+// prefetched as soon as they become reachable (a monster swing kills outright)
+void requestAssets(AssetStreamer& streamer, const InputQueue& input)
+{
+	glm::vec3 playerPosition = world.transform[world.Slot(player)].position;
+	bool playerDeathReachable = input.Down(GLFW_KEY_G);
+	bool monsterDeathReachable = false;
+	float nearest[CHARACTER_KIND_COUNT];
+	for (int k = 0; k < CHARACTER_KIND_COUNT; k++)
+		nearest[k] = -1.0f;
+	for (unsigned int i = 0; i < world.Count(); i++)
 	{
-		// Transform local corner to world space using the enemy attack model
-		glm::vec4 worldCorner = enemyAttackModel * glm::vec4(corners[i], 1.0f);
+		if (!world.health[i].alive)
+			continue;
+		int k = world.kind[i];
+		float distance = glm::length(world.transform[i].position - playerPosition);
+		if (nearest[k] < 0.0f || distance < nearest[k])
+		{
+			nearest[k] = distance;
+			streamer.SetAnchor(kindModels[k], world.transform[i].position);
+		}
+		const HealthComponent& h = world.health[i];
+		AnimState state = world.anim[i].state;
+		if (k == KNIGHT && (h.health <= 50.0f || h.dying))
+			playerDeathReachable = true;
+		if (k == MONSTER && (state == IDLE_ATTACK || state == ATTACK_IDLE))
+			playerDeathReachable = true;
+		if (k == MONSTER && (h.health <= 60.0f || h.dying))
+			monsterDeathReachable = true;
+	}
+	if (playerDeathReachable)
+		streamer.Request(kindClips[KNIGHT][CLIP_DYING]);
+	if (monsterDeathReachable)
+		streamer.Request(kindClips[MONSTER][CLIP_DYING]);
+}
 
-		// Check if any world-space corner is inside the player's AABB
-		if (worldCorner.x >= playerMinX && worldCorner.x <= playerMaxX &&
-			worldCorner.y >= playerMinY && worldCorner.y <= playerMaxY &&
-			worldCorner.z >= playerMinZ && worldCorner.z <= playerMaxZ)
+// pending clips are NULL and states that need one don't transition until it arrives.
+// a kind only runs while in range with model and idle clip resident; its clips may have
+// been evicted meanwhile, so (re)activation restarts every instance from idle
+void refreshCharacterDefs(AssetStreamer& streamer)
+{
+	for (int k = 0; k < CHARACTER_KIND_COUNT; k++)
+	{
+		CharacterDef& def = characterDefs[k];
+		for (int c = 0; c < CLIP_COUNT; c++)
 		{
-			return true;
+			ClipInfo& clip = def.clips[c];
+			bool wasLoaded = clip.loaded;
+			clip.animation = kindClips[k][c] != AssetStreamer::InvalidHandle ? streamer.GetAnimation(kindClips[k][c]) : NULL;
+			clip.loaded = clip.animation != NULL;
+			if (clip.animation) {
+				clip.duration = clip.animation->GetDuration();
+				clip.ticksPerSecond = clip.animation->GetTicksPerSecond();
+			}
+			if (clip.loaded && !wasLoaded)
+				loadClipEvents((CharacterKind)k, (ClipId)c, clip);
+		}
+
+		bindPoseClips(streamer, k);
+
+		bool ready = streamer.IsWanted(kindModels[k]) && streamer.GetModel(kindModels[k]) && def.HasClip(CLIP_IDLE);
+		if (ready && !def.active)
+			for (unsigned int i = 0; i < world.Count(); i++)
+				if (world.kind[i] == k)
+					resetCharacter(world, i);
+		def.active = ready;
+		if (def.active) {
+			streamer.Touch(kindModels[k]);
+			for (int c = 0; c < CLIP_COUNT; c++)
+				if (kindClips[k][c] != AssetStreamer::InvalidHandle)
+					streamer.Touch(kindClips[k][c]);
 		}
 	}
+}
 
-	return false;
+// the blend tree's view of a kind's clips, rebuilt for whatever was (re)loaded since the last tick.
+// the skeleton is the idle clip's hierarchy with the palette slots of the model's bones; the model
+// stays resident while any of its clips is
+void bindPoseClips(AssetStreamer& streamer, int kind)
+{
+	const CharacterDef& def = characterDefs[kind];
+	CachedModel* model = streamer.GetModel(kindModels[kind]);
+	AnimationData* idle = model ? def.clips[CLIP_IDLE].animation : NULL;
+	unsigned int idleLoads = idle ? streamer.GetLoadCount(kindClips[kind][CLIP_IDLE]) : 0;
+	if (idleLoads != skeletonLoads[kind])
+	{
+		skeletonLoads[kind] = idleLoads;
+		rigs[kind].skeleton = Skeleton();
+		if (idle)
+			buildSkeleton(*idle, model->boneInfo, rigs[kind].skeleton);
+		rigs[kind].Bind(def);
+		for (int c = 0; c < CLIP_COUNT; c++)
+			poseClips[kind][c].reset();
+	}
+
+	for (int c = 0; c < CLIP_COUNT; c++)
+	{
+		AnimationData* animation = def.clips[c].animation;
+		unsigned int loads = animation ? streamer.GetLoadCount(kindClips[kind][c]) : 0;
+		if (!animation || !idle)
+			poseClips[kind][c].reset();
+		else if (!poseClips[kind][c] || poseClipLoads[kind][c] != loads)
+			poseClips[kind][c].reset(new AnimationClip(animation, rigs[kind].skeleton));
+		poseClipLoads[kind][c] = loads;
+		rigs[kind].clips[c] = poseClips[kind][c].get();
+	}
+}
+
+// everything of a tick but drawing: controllers, the simulation (or the server's state when
+// online), snapshots and poses, ending with the frame packet for the GL thread.
+// the asset lock is only held to bind the clips and to ask the streamer what it has, never for
+// the poses, so streaming on the GL thread doesn't wait on them; evictions are held from binding
+// the clips until the poses are done with them, which keeps the clips alive without the lock
+void simulationTick(AssetStreamer& streamer, FlowField& flowField, GLFWwindow* window, FramePacket& packet)
+{
+	auto sampled = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(assetMutex);
+		refreshCharacterDefs(streamer);
+		streamer.HoldEvictions(true);
+	}
+
+	// controllers
+	// -----------
+	processInput(window, input);
+	if (client.Connected())
+	{
+		client.SendInput(knightIntent(input));
+		client.Receive();
+		client.Interpolate(deltaTime, world, player);
+	}
+	else
+	{
+		updateControllers(world, input);
+
+		// simulation
+		// ----------
+		combatEvents.clear();
+		stepSimulation(world, flowField, aiCursor, player, deltaTime, combatEvents);
+	}
+
+	// snapshots: one per tick for rewinding, F5/F9 save and load a checkpoint file,
+	// BACKSPACE rewinds SNAPSHOT_REWIND_TICKS. online there is nothing of ours to rewind
+	simulationTime += deltaTime;
+
+	// the HUD's feed, kept here so a frame packet the GL thread skips loses no messages
+	for (size_t i = 0; i < combatEvents.size(); i++)
+	{
+		HudMessage message;
+		message.kind = combatEvents[i].kind;
+		message.defeated = combatEvents[i].defeated != 0;
+		message.health = combatEvents[i].health;
+		message.time = simulationTime;
+		combatFeed.push_back(message);
+	}
+	combatEvents.clear();
+	while (!combatFeed.empty() && (combatFeed.size() > HUD_MESSAGE_LINES || simulationTime - combatFeed.front().time > HUD_MESSAGE_SECONDS))
+		combatFeed.pop_front();
+	uint32_t tick = (uint32_t)input.GetTick();
+	if (!serverAddress)
+		saveTickSnapshot(flowField, tick);
+	if (!serverAddress && input.Pressed(GLFW_KEY_F5))
+	{
+		captureState(flowField, snapshotScratch);
+		if (WriteSnapshotFile(CHECKPOINT_PATH, tick, snapshotScratch))
+			std::cout << "Checkpoint saved (" << snapshotScratch.size() << " bytes)" << std::endl;
+	}
+	if (!serverAddress && input.Pressed(GLFW_KEY_F9))
+	{
+		uint32_t checkpointTick = 0;
+		if (ReadSnapshotFile(CHECKPOINT_PATH, checkpointTick, snapshotScratch) && restoreState(flowField, snapshotScratch))
+			std::cout << "Checkpoint from tick " << checkpointTick << " loaded" << std::endl;
+	}
+	if (!serverAddress && input.Pressed(GLFW_KEY_BACKSPACE) && !snapshotHistory.Empty())
+	{
+		uint32_t rewindTick = std::max(snapshotHistory.OldestTick(), tick > SNAPSHOT_REWIND_TICKS ? tick - SNAPSHOT_REWIND_TICKS : 0u);
+		if (rewindTo(flowField, rewindTick))
+			std::cout << "Rewound to tick " << rewindTick << std::endl;
+	}
+
+	// poses
+	// -----
+	updatePoses(world, rigs, blendTree, poseCache, poses);
+	buildFramePacket(streamer, input.GetTick(), sampled, packet);
+	std::lock_guard<std::mutex> lock(assetMutex);
+	streamer.HoldEvictions(false);
+}
+
+// copies out what the GL thread draws; takes the asset lock only to ask which models are wanted
+void buildFramePacket(AssetStreamer& streamer, uint64_t tick, std::chrono::steady_clock::time_point sampled, FramePacket& packet)
+{
+	bool kindWanted[CHARACTER_KIND_COUNT];
+	{
+		std::lock_guard<std::mutex> lock(assetMutex);
+		for (int k = 0; k < CHARACTER_KIND_COUNT; k++)
+			kindWanted[k] = streamer.IsWanted(kindModels[k]);
+	}
+
+	packet.Clear();
+	packet.tick = tick;
+	packet.sampled = sampled;
+	packet.time = simulationTime;
+	packet.playerPosition = world.transform[world.Slot(player)].position;
+	packet.playerHealth = world.health[world.Slot(player)].health;
+	packet.messages.assign(combatFeed.begin(), combatFeed.end());
+
+	for (unsigned int i = 0; i < world.Count(); i++)
+	{
+		const CharacterDef& def = characterDefs[world.kind[i]];
+		if (!world.health[i].alive)
+			continue;
+
+		if (world.Has(i, COMPONENT_HEALTH)) {
+			HealthBarDraw bar;
+			bar.position = world.transform[i].position + glm::vec3(0.0f, HEALTH_BAR_HEIGHT, 0.0f);
+			bar.fraction = glm::clamp(world.health[i].health / CHARACTER_MAX_HEALTH, 0.0f, 1.0f);
+			bar.player = world.kind[i] == KNIGHT;
+			packet.healthBars.push_back(bar);
+		}
+
+		if (def.active && world.Has(i, COMPONENT_ANIMATOR) && !entityPose(world, i).empty()) {
+			const std::vector<glm::mat4>& transforms = entityPose(world, i);
+			CharacterDraw character;
+			character.kind = world.kind[i];
+			character.model = entityModelMatrix(world, i);
+			character.firstBone = (unsigned int)packet.palette.size();
+			character.boneCount = (unsigned int)transforms.size();
+			packet.palette.insert(packet.palette.end(), transforms.begin(), transforms.end());
+			packet.characters.push_back(character);
+
+			// merchant close-up while talking
+			AnimState state = world.anim[i].state;
+			if (world.kind[i] == MERCHANT && (state == IDLE_TALK || state == TALK)) {
+				packet.merchantTalking = true;
+				packet.merchantCloseUp = character;
+				glm::mat4 model = glm::mat4(1.0f);
+				model = glm::translate(model, glm::vec3(-2.5, -1.75, -0.55));
+				model = glm::scale(model, glm::vec3(4.5f, 4.5f, 4.5f));
+				model = glm::rotate(model, glm::radians(25.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+				packet.merchantCloseUp.model = model;
+			}
+		}
+
+		BoxDraw box;
+		if (!def.active && kindWanted[world.kind[i]]) {
+			box.model = glm::translate(glm::mat4(1.0f), world.transform[i].position + glm::vec3(0.0f, HITBOX_HEIGHT / 2, 0.0f));
+			packet.boxes.push_back(box);
+		}
+		else if (def.active && world.Has(i, COMPONENT_HITBOX) && world.hitbox[i].active) {
+			// Apply the attack box offset and the attacker's transform
+			const HitboxComponent& b = world.hitbox[i];
+			box.model = entityModelMatrix(world, i);
+			box.model = glm::translate(box.model, hitboxCenter(b));
+			box.model = glm::scale(box.model, b.size / glm::vec3(HITBOX_WIDTH, HITBOX_HEIGHT, HITBOX_DEPTH));
+			box.hitbox = true;
+			packet.boxes.push_back(box);
+		}
+	}
 }
 
-void damageEnemy(float damage)
+// live play: ticks at up to SIMULATION_RATE with the measured tick length, independent of the frame rate
+void simulationLoop(AssetStreamer* streamer, FlowField* flowField, GLFWwindow* window)
 {
-	if (!isEnemyAlive) return;
+	const auto tickLength = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(1.0f / SIMULATION_RATE));
+	auto lastTick = std::chrono::steady_clock::now();
+	while (simulationRunning)
+	{
+		auto tickStart = std::chrono::steady_clock::now();
+		deltaTime = std::chrono::duration<float>(tickStart - lastTick).count();
+		lastTick = tickStart;
+		input.BeginTick(deltaTime);
 
-	enemyHealth -= damage;
-	std::cout << "Hit an enemy! Enemy HP: " << enemyHealth << std::endl;
+		{
+			std::lock_guard<std::mutex> lock(assetMutex);
+			requestAssets(*streamer, input);
+		}
+		simulationTick(*streamer, *flowField, window, frames.Back());
+		frames.Publish();
+
+		auto tickEnd = std::chrono::steady_clock::now();
+		simulationTiming.Add(std::chrono::duration<float, std::milli>(tickEnd - tickStart).count());
+		std::this_thread::sleep_until(tickStart + tickLength);
+	}
+}
+
+void printThreadTimings(float totalSeconds)
+{
+	if (simulationTiming.count > 0)
+		std::cout << "Simulation thread: " << simulationTiming.count / totalSeconds << " ticks/s"
+			<< ", tick ms mean " << simulationTiming.totalMs / simulationTiming.count
+			<< " max " << simulationTiming.maxMs << std::endl;
+	if (renderTiming.count > 0)
+		std::cout << "Render thread: " << renderTiming.count / totalSeconds << " frames/s"
+			<< ", frame ms mean " << renderTiming.totalMs / renderTiming.count
+			<< " max " << renderTiming.maxMs << std::endl;
+	if (packetLatency.count > 0)
+	{
+		unsigned long published = simulationTiming.count > 0 ? simulationTiming.count : packetsShown;
+		std::cout << "Frame packets: " << packetsShown << " of " << published << " shown"
+			<< ", input to present ms mean " << packetLatency.totalMs / packetLatency.count
+			<< " max " << packetLatency.maxMs << std::endl;
+	}
+}
+
+// writes the frame to the capture directory and/or compares it with the golden of the same name.
+// a missing golden counts as a mismatch, so a run against an incomplete set fails loudly
+bool captureFrame(RenderTarget& target, const std::string& name)
+{
+	unsigned int width = target.GetWidth();
+	unsigned int height = target.GetHeight();
+	target.ReadPixels(capturePixels);
+	captures++;
+	if (captureDir && !WritePng(std::string(captureDir) + "/" + name, width, height, capturePixels))
+		return false;
+	if (!goldenDir)
+		return true;
+
+	std::string goldenPath = std::string(goldenDir) + "/" + name;
+	int goldenWidth = 0, goldenHeight = 0, channels = 0;
+	unsigned char* golden = stbi_load(goldenPath.c_str(), &goldenWidth, &goldenHeight, &channels, 4);
+	if (!golden || goldenWidth != (int)width || goldenHeight != (int)height)
+	{
+		std::cout << "Golden " << goldenPath << (golden ? " has a different size" : " is missing") << std::endl;
+		stbi_image_free(golden);
+		goldenMismatches++;
+		return false;
+	}
+
+	// stb_image flips on load for the streaming thread's textures and the setting is global, so the
+	// golden arrives bottom-up; turn it back rather than change the setting under that thread
+	size_t rowBytes = (size_t)width * 4;
+	std::vector<unsigned char> row(rowBytes);
+	for (unsigned int y = 0; y < height / 2; y++)
+	{
+		unsigned char* top = golden + y * rowBytes;
+		unsigned char* bottom = golden + (height - 1 - y) * rowBytes;
+		memcpy(row.data(), top, rowBytes);
+		memcpy(top, bottom, rowBytes);
+		memcpy(bottom, row.data(), rowBytes);
+	}
+	ImageDiff diff = CompareImages(capturePixels.data(), golden, (size_t)width * height, goldenTolerance);
+	stbi_image_free(golden);
+	if (diff.differingPixels > GOLDEN_MAX_DIFFERING * width * height)
+	{
+		std::cout << "Golden mismatch " << name << ": " << diff.differingPixels << " pixels differ, by up to " << diff.maxDelta << std::endl;
+		goldenMismatches++;
+		return false;
+	}
+	return true;
+}
 
-	if (enemyHealth <= 0.0f) {
-		enemyHealth = 0.0f;
-		std::cout << "Enemy Defeated!" << std::endl;
-		playEnemyDyingAnim = true;
+// torches on the walkable cells along the walls, spread evenly over all such cells.
+// the map carries no light data, so the nav grid's wall edges stand in for it
+void placeTorches(const NavGrid& grid, unsigned int count, std::vector<PointLight>& torches)
+{
+	std::vector<glm::vec2> wallCells;
+	for (int z = 0; z < grid.Height(); z++)
+		for (int x = 0; x < grid.Width(); x++)
+			if (grid.Walkable(x, z) && (!grid.Walkable(x - 1, z) || !grid.Walkable(x + 1, z) || !grid.Walkable(x, z - 1) || !grid.Walkable(x, z + 1)))
+				wallCells.push_back(grid.CellCenter(x, z));
+
+	torches.clear();
+	count = std::min(count, (unsigned int)wallCells.size());
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const glm::vec2& cell = wallCells[(size_t)i * wallCells.size() / count];
+		PointLight torch;
+		torch.position = glm::vec3(cell.x, ENEMY_START.y + TORCH_HEIGHT, cell.y);
+		torch.radius = TORCH_RADIUS;
+		torch.color = TORCH_COLOR;
+		torches.push_back(torch);
 	}
+	std::cout << "Lighting: " << torches.size() << " torches along " << wallCells.size() << " wall cells" << std::endl;
 }
 
-void damagePlayer(float damage)
+void printLightingStats()
 {
-	if (!isPlayerAlive) return;
+	const LightingTimings& l = lightingTimings;
+	if (l.frames == 0)
+		return;
+	std::cout << "Lighting: " << torches.size() << " torches, avg " << l.visibleLights / l.frames << " in view"
+		<< ", assignment avg " << l.assignUs / l.frames << " us (max " << l.maxAssignUs << ")"
+		<< ", at most " << l.maxPerCluster << " per cluster, " << l.overflowingClusters << " overflowing clusters" << std::endl;
+}
 
-	playerHealth -= damage;
-	std::cout << "Player hit! Player HP: " << playerHealth << std::endl;
+void printShadowStats()
+{
+	const ShadowTimings& s = shadowTimings;
+	if (s.frames == 0 || s.timed == 0)
+		return;
+	std::cout << "Shadows (" << (shadows.IsFull() ? "full re-render" : "cached") << "): GPU avg "
+		<< (s.staticMs + s.overlayMs) / s.timed << " ms per frame (max " << s.maxMs << ", " << s.timed << " frames timed), "
+		<< s.staticMs / s.timed << " ms static, " << s.overlayMs / s.timed << " ms overlay; "
+		<< s.staticRenders << " static maps rendered in " << s.frames << " frames, "
+		<< s.overlayRenders << " overlays with characters" << std::endl;
+}
 
-	if (playerHealth <= 0.0f) {
-		playerHealth = 0.0f;
-		std::cout << "Player Defeated!" << std::endl;
-		playDyingAnim = true;
+// health bars over the characters, then the player's health and the feed of recent hits
+void drawHud(UiBatch& ui, const FramePacket& packet)
+{
+	const uint32_t barBack = UiBatch::Color(0.0f, 0.0f, 0.0f, 0.6f);
+	for (size_t i = 0; i < packet.healthBars.size(); i++)
+	{
+		const HealthBarDraw& bar = packet.healthBars[i];
+		glm::vec2 offset = glm::vec2(-HEALTH_BAR_SIZE.x / 2.0f, -HEALTH_BAR_SIZE.y);
+		ui.WorldQuad(ui.White(), bar.position, offset - glm::vec2(1.0f), HEALTH_BAR_SIZE + glm::vec2(2.0f), barBack);
+		uint32_t fill = bar.player ? UiBatch::Color(0.2f, 0.8f, 0.3f) : UiBatch::Color(0.85f, 0.15f, 0.1f);
+		ui.WorldQuad(ui.White(), bar.position, offset, glm::vec2(HEALTH_BAR_SIZE.x * bar.fraction, HEALTH_BAR_SIZE.y), fill);
 	}
-}
\ No newline at end of file
+
+	char text[64];
+	float fraction = glm::clamp(packet.playerHealth / CHARACTER_MAX_HEALTH, 0.0f, 1.0f);
+	glm::vec2 pen = glm::vec2(HUD_MARGIN);
+	pen.x += ui.Text("HP ", pen, HUD_TEXT_SCALE, UiBatch::Color(1.0f, 1.0f, 1.0f));
+	ui.Quad(ui.White(), pen - glm::vec2(2.0f), HUD_BAR_SIZE + glm::vec2(4.0f), barBack);
+	ui.Quad(ui.White(), pen, glm::vec2(HUD_BAR_SIZE.x * fraction, HUD_BAR_SIZE.y), UiBatch::Color(1.0f - fraction, fraction, 0.2f));
+	snprintf(text, sizeof(text), "%d", (int)std::ceil(packet.playerHealth));
+	ui.Text(text, pen + glm::vec2(HUD_BAR_SIZE.x + HUD_MARGIN / 2.0f, 0.0f), HUD_TEXT_SCALE, UiBatch::Color(1.0f, 1.0f, 1.0f));
+
+	// newest at the top, fading out over the last second
+	pen = glm::vec2(HUD_MARGIN, HUD_MARGIN * 2.0f + HUD_BAR_SIZE.y);
+	for (size_t i = packet.messages.size(); i-- > 0;)
+	{
+		const HudMessage& message = packet.messages[i];
+		bool player = message.kind == KNIGHT;
+		if (message.defeated)
+			snprintf(text, sizeof(text), "%s", player ? "Player Defeated!" : "Enemy Defeated!");
+		else
+			snprintf(text, sizeof(text), player ? "Player hit! HP %d" : "Hit an enemy! HP %d", (int)std::ceil(message.health));
+		float alpha = glm::clamp(HUD_MESSAGE_SECONDS - (packet.time - message.time), 0.0f, 1.0f);
+		uint32_t color = player ? UiBatch::Color(1.0f, 0.45f, 0.35f, alpha) : UiBatch::Color(1.0f, 0.9f, 0.5f, alpha);
+		ui.Text(text, pen, HUD_TEXT_SCALE, color);
+		pen.y += UiBatch::GLYPH_HEIGHT * HUD_TEXT_SCALE + 4.0f;
+	}
+}
+
+void printUiStats()
+{
+	const UiTimings& u = uiTimings;
+	if (u.frames == 0)
+		return;
+	std::cout << "UI: avg " << u.quads / u.frames << " quads in " << u.draws / u.frames << " draws per frame (max "
+		<< u.maxQuads << " quads), " << u.dropped << " dropped" << std::endl;
+}
+
+void printResolutionStats()
+{
+	const DynamicResolution::Stats& r = resolution.GetStats();
+	const DynamicResolution::Settings& settings = resolution.GetSettings();
+	if (r.frames == 0)
+		return;
+	std::cout << "Dynamic resolution: budget " << settings.budgetMs << " ms, GPU avg "
+		<< (r.measured > 0 ? r.gpuMsSum / r.measured : 0.0) << " ms, scale avg " << r.scaleSum / r.frames
+		<< " (lowest " << r.lowestScale << ", range " << settings.minScale << "-" << settings.maxScale << "), "
+		<< r.changes << " changes" << std::endl;
+}
@@ -0,0 +1,376 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+void WorldSnapshot::Write(SnapshotWriter& writer, const World& world)
+{
+	writer.Write(world.Count());
+	writer.WriteArray(world.kind);
+	writer.WriteArray(world.mask);
+
+	writer.WriteColumn(world.transform, &TransformComponent::position);
+	writer.WriteColumn(world.transform, &TransformComponent::forward);
+	writer.WriteColumn(world.transform, &TransformComponent::yaw);
+	writer.WriteColumn(world.transform, &TransformComponent::scale);
+	writer.WriteColumn(world.transform, &TransformComponent::moveSpeed);
+	writer.WriteColumn(world.transform, &TransformComponent::yawSpeed);
+	writer.WriteColumn(world.transform, &TransformComponent::speed);
+
+	writer.WriteColumn(world.health, &HealthComponent::health);
+	writer.WriteColumn(world.health, &HealthComponent::alive);
+	writer.WriteColumn(world.health, &HealthComponent::dying);
+
+	writer.WriteColumn(world.anim, &AnimStateComponent::state);
+	writer.WriteColumn(world.anim, &AnimStateComponent::intent);
+	writer.WriteColumn(world.anim, &AnimStateComponent::clip0);
+	writer.WriteColumn(world.anim, &AnimStateComponent::clip1);
+	writer.WriteColumn(world.anim, &AnimStateComponent::time0);
+	writer.WriteColumn(world.anim, &AnimStateComponent::time1);
+	writer.WriteColumn(world.anim, &AnimStateComponent::blend);
+	writer.WriteColumn(world.anim, &AnimStateComponent::layerClip);
+	writer.WriteColumn(world.anim, &AnimStateComponent::layerFading);
+	writer.WriteColumn(world.anim, &AnimStateComponent::layerTime);
+	writer.WriteColumn(world.anim, &AnimStateComponent::layerWeight);
+
+	writer.WriteColumn(world.hitbox, &HitboxComponent::offset);
+	writer.WriteColumn(world.hitbox, &HitboxComponent::size);
+	writer.WriteColumn(world.hitbox, &HitboxComponent::bone);
+	writer.WriteColumn(world.hitbox, &HitboxComponent::attached);
+	writer.WriteColumn(world.hitbox, &HitboxComponent::window);
+	writer.WriteColumn(world.hitbox, &HitboxComponent::active);
+	writer.WriteColumn(world.hitbox, &HitboxComponent::hitPerformed);
+
+	writer.WriteArray(world.m_SlotToIndex);
+	writer.WriteArray(world.m_Sparse);
+	writer.WriteArray(world.m_Generation);
+	writer.WriteArray(world.m_FreeIndices);
+}
+
+// what Write stores per entity; a count is checked against the bytes left with it before
+// anything is sized by it
+static const size_t ENTITY_BYTES =
+	sizeof(uint8_t) + sizeof(uint32_t) +   // kind, mask
+	sizeof(TransformComponent::position) + sizeof(TransformComponent::forward) + sizeof(TransformComponent::yaw) +
+	sizeof(TransformComponent::scale) + sizeof(TransformComponent::moveSpeed) + sizeof(TransformComponent::yawSpeed) +
+	sizeof(TransformComponent::speed) +
+	sizeof(HealthComponent::health) + sizeof(HealthComponent::alive) + sizeof(HealthComponent::dying) +
+	sizeof(AnimStateComponent::state) + sizeof(AnimStateComponent::intent) +
+	sizeof(AnimStateComponent::clip0) + sizeof(AnimStateComponent::clip1) +
+	sizeof(AnimStateComponent::time0) + sizeof(AnimStateComponent::time1) + sizeof(AnimStateComponent::blend) +
+	sizeof(AnimStateComponent::layerClip) + sizeof(AnimStateComponent::layerFading) +
+	sizeof(AnimStateComponent::layerTime) + sizeof(AnimStateComponent::layerWeight) +
+	sizeof(HitboxComponent::offset) + sizeof(HitboxComponent::size) + sizeof(HitboxComponent::bone) +
+	sizeof(HitboxComponent::attached) + sizeof(HitboxComponent::window) + sizeof(HitboxComponent::active) +
+	sizeof(HitboxComponent::hitPerformed) +
+	sizeof(uint32_t);                      // slot to index
+
+bool WorldSnapshot::Read(SnapshotReader& reader, World& world)
+{
+	unsigned int count = 0;
+	size_t remaining = 0;
+	if (!reader.Read(count))
+		return false;
+	reader.Remaining(remaining);
+	if (count > remaining / ENTITY_BYTES)
+		return false;
+	world.transform.resize(count);
+	world.health.resize(count);
+	world.anim.resize(count);
+	world.hitbox.resize(count);
+
+	bool ok = reader.ReadArray(world.kind) && reader.ReadArray(world.mask) &&
+		reader.ReadColumn(world.transform, &TransformComponent::position) &&
+		reader.ReadColumn(world.transform, &TransformComponent::forward) &&
+		reader.ReadColumn(world.transform, &TransformComponent::yaw) &&
+		reader.ReadColumn(world.transform, &TransformComponent::scale) &&
+		reader.ReadColumn(world.transform, &TransformComponent::moveSpeed) &&
+		reader.ReadColumn(world.transform, &TransformComponent::yawSpeed) &&
+		reader.ReadColumn(world.transform, &TransformComponent::speed) &&
+		reader.ReadColumn(world.health, &HealthComponent::health) &&
+		reader.ReadColumn(world.health, &HealthComponent::alive) &&
+		reader.ReadColumn(world.health, &HealthComponent::dying) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::state) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::intent) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::clip0) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::clip1) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::time0) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::time1) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::blend) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::layerClip) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::layerFading) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::layerTime) &&
+		reader.ReadColumn(world.anim, &AnimStateComponent::layerWeight) &&
+		reader.ReadColumn(world.hitbox, &HitboxComponent::offset) &&
+		reader.ReadColumn(world.hitbox, &HitboxComponent::size) &&
+		reader.ReadColumn(world.hitbox, &HitboxComponent::bone) &&
+		reader.ReadColumn(world.hitbox, &HitboxComponent::attached) &&
+		reader.ReadColumn(world.hitbox, &HitboxComponent::window) &&
+		reader.ReadColumn(world.hitbox, &HitboxComponent::active) &&
+		reader.ReadColumn(world.hitbox, &HitboxComponent::hitPerformed) &&
+		reader.ReadArray(world.m_SlotToIndex) &&
+		reader.ReadArray(world.m_Sparse) &&
+		reader.ReadArray(world.m_Generation) &&
+		reader.ReadArray(world.m_FreeIndices);
+	return ok && world.kind.size() == count && world.mask.size() == count && world.m_SlotToIndex.size() == count && Valid(world);
+}
+
+// every index is either live, with its slot pointing back at it, or free, and only once
+bool WorldSnapshot::Valid(const World& world)
+{
+	size_t indices = world.m_Sparse.size();
+	if (world.m_Generation.size() != indices || world.Count() + world.m_FreeIndices.size() != indices)
+		return false;
+	for (unsigned int i = 0; i < world.Count(); i++)
+	{
+		const AnimStateComponent& a = world.anim[i];
+		if (world.kind[i] >= CHARACTER_KIND_COUNT || a.clip0 >= CLIP_COUNT ||
+			(a.clip1 >= CLIP_COUNT && a.clip1 != CLIP_NONE) || (a.layerClip >= CLIP_COUNT && a.layerClip != CLIP_NONE))
+			return false;
+		uint32_t index = world.m_SlotToIndex[i];
+		if (index >= indices || world.m_Sparse[index] != i)
+			return false;
+	}
+	// a free index keeps its stale slot, which must not point back at it
+	std::vector<uint8_t> isFree(indices, 0);
+	for (size_t f = 0; f < world.m_FreeIndices.size(); f++)
+	{
+		uint32_t index = world.m_FreeIndices[f];
+		if (index >= indices || isFree[index])
+			return false;
+		uint32_t slot = world.m_Sparse[index];
+		if (slot < world.Count() && world.m_SlotToIndex[slot] == index)
+			return false;
+		isFree[index] = 1;
+	}
+	return true;
+}
+
+void FlowFieldSnapshot::Write(SnapshotWriter& writer, const FlowField& field)
+{
+	writer.Write(field.m_Goal);
+	writer.Write(field.m_NextGoal);
+	writer.Write((uint8_t)field.m_Pending);
+	writer.WriteArray(field.m_Directions);
+	writer.WriteArray(field.m_Building);
+	writer.WriteArray(field.m_Visited);
+	writer.Write((uint32_t)field.m_Frontier.size());
+	for (size_t i = 0; i < field.m_Frontier.size(); i++)
+		writer.Write(field.m_Frontier[i]);
+}
+
+bool FlowFieldSnapshot::Read(SnapshotReader& reader, FlowField& field)
+{
+	uint8_t pending = 0;
+	uint32_t frontier = 0;
+	if (!reader.Read(field.m_Goal) || !reader.Read(field.m_NextGoal) || !reader.Read(pending))
+		return false;
+	size_t cells = field.m_Directions.size();
+	if (!reader.ReadArray(field.m_Directions) || !reader.ReadArray(field.m_Building) || !reader.ReadArray(field.m_Visited) || !reader.Read(frontier))
+		return false;
+	if (field.m_Directions.size() != cells || field.m_Building.size() != cells || field.m_Visited.size() != cells)
+		return false;
+	field.m_Pending = pending != 0;
+	field.m_Frontier.clear();
+	for (uint32_t i = 0; i < frontier; i++)
+	{
+		int cell = 0;
+		if (!reader.Read(cell) || cell < 0 || (size_t)cell >= cells)
+			return false;
+		field.m_Frontier.push_back(cell);
+	}
+	return true;
+}
+
+void SnapshotDelta::Encode(const std::vector<uint8_t>& base, const std::vector<uint8_t>& target, std::vector<uint8_t>& out)
+{
+	out.clear();
+	WriteCount(out, target.size());
+	size_t common = std::min(base.size(), target.size());
+	size_t i = 0;
+	while (i < target.size())
+	{
+		// unchanged stretches are skipped a word at a time
+		size_t zeros = 0;
+		while (i + zeros + 8 <= common && memcmp(&base[i + zeros], &target[i + zeros], 8) == 0)
+			zeros += 8;
+		while (i + zeros < target.size() && Xor(base, target, i + zeros) == 0)
+			zeros++;
+		i += zeros;
+
+		// a literal run ends at the first stretch of zeros worth a new run header
+		size_t literals = 0;
+		while (i + literals < target.size())
+		{
+			size_t stretch = 0;
+			while (stretch < MIN_ZERO_RUN && i + literals + stretch < target.size() && Xor(base, target, i + literals + stretch) == 0)
+				stretch++;
+			if (stretch == MIN_ZERO_RUN || i + literals + stretch == target.size())
+				break;
+			literals += stretch + 1;
+		}
+
+		WriteCount(out, zeros);
+		WriteCount(out, literals);
+		for (size_t j = 0; j < literals; j++)
+			out.push_back(Xor(base, target, i + j));
+		i += literals;
+	}
+}
+
+bool SnapshotDelta::Apply(std::vector<uint8_t>& state, const uint8_t* data, size_t size)
+{
+	size_t offset = 0;
+	size_t targetSize = 0;
+	if (!ReadCount(data, size, offset, targetSize) || targetSize > MAX_STATE_BYTES)
+		return false;
+	// bytes past the end of the base count as zero
+	state.resize(targetSize, 0);
+
+	size_t i = 0;
+	while (i < targetSize)
+	{
+		size_t zeros = 0, literals = 0;
+		if (!ReadCount(data, size, offset, zeros) || !ReadCount(data, size, offset, literals))
+			return false;
+		i += zeros;
+		if (i + literals > targetSize || offset + literals > size)
+			return false;
+		for (size_t j = 0; j < literals; j++)
+			state[i + j] ^= data[offset + j];
+		offset += literals;
+		i += literals;
+	}
+	return offset == size;
+}
+
+void SnapshotDelta::WriteCount(std::vector<uint8_t>& out, size_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+bool SnapshotDelta::ReadCount(const uint8_t* data, size_t size, size_t& offset, size_t& value)
+{
+	value = 0;
+	for (int shift = 0; offset < size && shift < 64; shift += 7)
+	{
+		uint8_t byte = data[offset++];
+		value |= (size_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+void SnapshotHistory::Save(uint32_t tick, const std::vector<uint8_t>& state)
+{
+	Entry entry;
+	if (m_Entries.size() == m_Capacity)
+	{
+		entry = std::move(m_Entries.front());
+		m_Entries.pop_front();
+		// the oldest entry is kept whole, or the deltas after the dropped keyframe couldn't be
+		// restored any more
+		if (!m_Entries.empty() && !m_Entries.front().keyframe)
+		{
+			Entry& oldest = m_Entries.front();
+			SnapshotDelta::Apply(entry.data, oldest.data.data(), oldest.data.size());
+			oldest.data.swap(entry.data);
+			oldest.keyframe = true;
+		}
+	}
+	entry.tick = tick;
+	entry.keyframe = m_SinceKeyframe == 0 || m_Previous.empty();
+	if (entry.keyframe)
+		entry.data = state;
+	else
+		SnapshotDelta::Encode(m_Previous, state, entry.data);
+	m_SinceKeyframe = (m_SinceKeyframe + 1) % KEYFRAME_INTERVAL;
+	m_Previous = state;
+	m_LastRawBytes = state.size();
+	m_LastEncodedBytes = entry.data.size();
+	m_Entries.push_back(std::move(entry));
+}
+
+bool SnapshotHistory::Restore(uint32_t tick, std::vector<uint8_t>& state)
+{
+	int target = -1;
+	for (int i = (int)m_Entries.size() - 1; i >= 0 && target < 0; i--)
+		if (m_Entries[i].tick == tick)
+			target = i;
+	int key = target;
+	while (key >= 0 && !m_Entries[key].keyframe)
+		key--;
+	if (target < 0 || key < 0)
+		return false;
+
+	state = m_Entries[key].data;
+	for (int i = key + 1; i <= target; i++)
+		if (!SnapshotDelta::Apply(state, m_Entries[i].data.data(), m_Entries[i].data.size()))
+			return false;
+
+	// the entries after the restored one belong to a future that won't happen now
+	while ((int)m_Entries.size() > target + 1)
+		m_Entries.pop_back();
+	m_Previous = state;
+	m_SinceKeyframe = (unsigned int)(target - key + 1) % KEYFRAME_INTERVAL;
+	return true;
+}
+
+void EncodeSnapshotFile(uint32_t tick, const std::vector<uint8_t>& state, std::vector<uint8_t>& out)
+{
+	SnapshotWriter writer(out);
+	writer.WriteBytes(SNAPSHOT_MAGIC, 4);
+	writer.Write(SNAPSHOT_VERSION);
+	writer.Write(tick);
+	writer.Write((uint32_t)state.size());
+	writer.WriteBytes(state.data(), state.size());
+}
+
+bool WriteSnapshotFile(const std::string& path, uint32_t tick, const std::vector<uint8_t>& state)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "Failed to write snapshot: " << path << std::endl;
+		return false;
+	}
+	std::vector<uint8_t> image;
+	EncodeSnapshotFile(tick, state, image);
+	file.write(reinterpret_cast<const char*>(image.data()), image.size());
+	return (bool)file;
+}
+
+bool ReadSnapshotFile(const std::string& path, uint32_t& tick, std::vector<uint8_t>& state)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	std::streamoff length = file ? (std::streamoff)file.tellg() : 0;
+	file.seekg(0);
+	char magic[4];
+	uint32_t version = 0, size = 0;
+	file.read(magic, 4);
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&tick), sizeof(tick));
+	file.read(reinterpret_cast<char*>(&size), sizeof(size));
+	if (!file || memcmp(magic, SNAPSHOT_MAGIC, 4) != 0 || version != SNAPSHOT_VERSION)
+	{
+		std::cout << "Not a snapshot file: " << path << std::endl;
+		return false;
+	}
+	// a truncated or corrupt header mustn't make us allocate whatever size it claims
+	if ((std::streamoff)size != length - (std::streamoff)file.tellg())
+	{
+		std::cout << "Snapshot file has the wrong length: " << path << std::endl;
+		return false;
+	}
+	state.resize(size);
+	file.read(reinterpret_cast<char*>(state.data()), size);
+	return (bool)file;
+}
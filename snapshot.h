@@ -0,0 +1,217 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "ecs.h"
+#include "flow_field.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// appends plain values to a byte buffer
+class SnapshotWriter
+{
+public:
+	SnapshotWriter(std::vector<uint8_t>& out) : m_Out(out)
+	{
+		m_Out.clear();
+	}
+
+	template <typename T>
+	void Write(const T& value)
+	{
+		size_t offset = m_Out.size();
+		m_Out.resize(offset + sizeof(T));
+		memcpy(&m_Out[offset], &value, sizeof(T));
+	}
+
+	// one field of every element, back to back; keeps unchanged fields together so deltas stay sparse
+	template <typename C, typename F>
+	void WriteColumn(const std::vector<C>& items, F C::* field)
+	{
+		size_t offset = m_Out.size();
+		m_Out.resize(offset + items.size() * sizeof(F));
+		for (size_t i = 0; i < items.size(); i++, offset += sizeof(F))
+			memcpy(&m_Out[offset], &(items[i].*field), sizeof(F));
+	}
+
+	void WriteBytes(const void* data, size_t size)
+	{
+		size_t offset = m_Out.size();
+		m_Out.resize(offset + size);
+		if (size)
+			memcpy(&m_Out[offset], data, size);
+	}
+
+	template <typename T>
+	void WriteArray(const std::vector<T>& items)
+	{
+		Write((uint32_t)items.size());
+		size_t offset = m_Out.size();
+		m_Out.resize(offset + items.size() * sizeof(T));
+		if (!items.empty())
+			memcpy(&m_Out[offset], items.data(), items.size() * sizeof(T));
+	}
+
+private:
+	std::vector<uint8_t>& m_Out;
+};
+
+class SnapshotReader
+{
+public:
+	SnapshotReader(const uint8_t* data, size_t size) : m_Data(data), m_Size(size) {}
+
+	template <typename T>
+	bool Read(T& value)
+	{
+		if (m_Offset + sizeof(T) > m_Size)
+			return false;
+		memcpy(&value, m_Data + m_Offset, sizeof(T));
+		m_Offset += sizeof(T);
+		return true;
+	}
+
+	template <typename C, typename F>
+	bool ReadColumn(std::vector<C>& items, F C::* field)
+	{
+		if (m_Offset + items.size() * sizeof(F) > m_Size)
+			return false;
+		for (size_t i = 0; i < items.size(); i++, m_Offset += sizeof(F))
+			memcpy(&(items[i].*field), m_Data + m_Offset, sizeof(F));
+		return true;
+	}
+
+	// what has not been read yet
+	const uint8_t* Remaining(size_t& size) const
+	{
+		size = m_Size - m_Offset;
+		return m_Data + m_Offset;
+	}
+
+	template <typename T>
+	bool ReadArray(std::vector<T>& items)
+	{
+		uint32_t count = 0;
+		if (!Read(count) || m_Offset + (size_t)count * sizeof(T) > m_Size)
+			return false;
+		items.resize(count);
+		if (count)
+			memcpy(items.data(), m_Data + m_Offset, count * sizeof(T));
+		m_Offset += count * sizeof(T);
+		return true;
+	}
+
+private:
+	const uint8_t* m_Data;
+	size_t m_Size;
+	size_t m_Offset = 0;
+};
+
+// everything the simulation owns in a World, column by column
+class WorldSnapshot
+{
+public:
+	static void Write(SnapshotWriter& writer, const World& world);
+
+	// entity handles taken before the snapshot stay valid after reading it back. fails on
+	// anything the game would index out of range with: kinds, clips and the entity tables
+	static bool Read(SnapshotReader& reader, World& world);
+
+private:
+	static bool Valid(const World& world);
+};
+
+// the flow field's published field and the search in progress, so a restored tick steers and
+// goes on searching exactly as it did. the field must have been initialized on the same grid
+class FlowFieldSnapshot
+{
+public:
+	static void Write(SnapshotWriter& writer, const FlowField& field);
+
+	static bool Read(SnapshotReader& reader, FlowField& field);
+};
+
+// delta against a base snapshot: the two are XORed, so unchanged bytes become zero, and the
+// result is stored as runs of (zero count, literal count, literals) with LEB128 counts.
+// the base and the target may differ in length when entities were spawned or despawned
+class SnapshotDelta
+{
+public:
+	// the largest state a delta may describe; sizes come off the network, so a bad one must not
+	// allocate whatever it claims. a local world with its flow field is well below this
+	static const size_t MAX_STATE_BYTES = 64u * 1024u * 1024u;
+
+	static void Encode(const std::vector<uint8_t>& base, const std::vector<uint8_t>& target, std::vector<uint8_t>& out);
+
+	// turns the base into the target in place; fails on a target larger than MAX_STATE_BYTES
+	static bool Apply(std::vector<uint8_t>& state, const uint8_t* data, size_t size);
+
+private:
+	static const size_t MIN_ZERO_RUN = 4;
+
+	static uint8_t Xor(const std::vector<uint8_t>& base, const std::vector<uint8_t>& target, size_t i)
+	{
+		return i < base.size() ? base[i] ^ target[i] : target[i];
+	}
+
+	static void WriteCount(std::vector<uint8_t>& out, size_t value);
+
+	static bool ReadCount(const uint8_t* data, size_t size, size_t& offset, size_t& value);
+};
+
+// the last few seconds of snapshots, for rewinding and resimulating. every
+// KEYFRAME_INTERVAL-th entry is stored whole, the ones in between as deltas against
+// their predecessor, and the oldest is always whole, so restoring any tick it holds decodes at
+// most one keyframe's worth of deltas
+class SnapshotHistory
+{
+public:
+	static const unsigned int KEYFRAME_INTERVAL = 16;
+
+	SnapshotHistory(unsigned int capacity) : m_Capacity(capacity) {}
+
+	void Save(uint32_t tick, const std::vector<uint8_t>& state);
+
+	// rebuilds the state saved at the given tick; fails once it has dropped out of the history
+	bool Restore(uint32_t tick, std::vector<uint8_t>& state);
+
+	bool Empty() const { return m_Entries.empty(); }
+	uint32_t OldestTick() const { return m_Entries.front().tick; }
+	uint32_t NewestTick() const { return m_Entries.back().tick; }
+	size_t LastRawBytes() const { return m_LastRawBytes; }
+	size_t LastEncodedBytes() const { return m_LastEncodedBytes; }
+
+private:
+	struct Entry
+	{
+		uint32_t tick = 0;
+		bool keyframe = false;
+		std::vector<uint8_t> data;
+	};
+
+	unsigned int m_Capacity;
+	std::deque<Entry> m_Entries;
+	std::vector<uint8_t> m_Previous;
+	unsigned int m_SinceKeyframe = 0;
+	size_t m_LastRawBytes = 0;
+	size_t m_LastEncodedBytes = 0;
+};
+
+// snapshot files (checkpoints, crash dumps) hold one full state behind a small header
+const char SNAPSHOT_MAGIC[4] = { 'K', 'N', 'S', 'S' };
+const uint32_t SNAPSHOT_VERSION = 4;
+
+// the whole file in memory, header first; what WriteSnapshotFile writes
+void EncodeSnapshotFile(uint32_t tick, const std::vector<uint8_t>& state, std::vector<uint8_t>& out);
+
+bool WriteSnapshotFile(const std::string& path, uint32_t tick, const std::vector<uint8_t>& state);
+
+bool ReadSnapshotFile(const std::string& path, uint32_t& tick, std::vector<uint8_t>& state);
+
+#endif
@@ -1,15 +1,16 @@
-#version 330 core
-out vec4 FragColor;
-
-in vec2 TexCoords;
-
-uniform sampler2D screenTexture;
-
-void main()
-{
-    // Sample the texture
-    FragColor = texture(screenTexture, TexCoords);
-    // Discard fragments that are fully transparent
-    if(FragColor.a < 0.1)
-        discard;
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec4 Color;
+
+uniform sampler2D atlasPage;
+
+void main()
+{
+    // Sample the atlas, tinted by the quad's color
+    FragColor = texture(atlasPage, TexCoords) * Color;
+    // Discard fragments that are fully transparent
+    if(FragColor.a < 0.1)
+        discard;
 }
\ No newline at end of file
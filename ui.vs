@@ -1,14 +1,27 @@
-#version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoords;
-
-out vec2 TexCoords;
-
-uniform mat4 model;
-uniform mat4 projection;
-
-void main()
-{
-    TexCoords = aTexCoords;
-    gl_Position = projection * model * vec4(aPos.x, aPos.y, 0.0, 1.0);
+#version 330 core
+// one quad per instance, see UiBatch (ui_batch.h); the corner comes from the vertex id
+layout (location = 0) in vec4 aAnchor;     // world position with w = 1, or w = 0 for screen space
+layout (location = 1) in vec4 aRect;       // pixels from the anchor: x, y, width, height
+layout (location = 2) in vec4 aTexRect;    // atlas region: min u, min v, max u, max v
+layout (location = 3) in vec4 aColor;
+
+out vec2 TexCoords;
+out vec4 Color;
+
+uniform mat4 viewProjection;
+uniform vec2 screenSize;                   // pixels, y down
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec2 origin = vec2(0.0);
+    if (aAnchor.w > 0.0)
+    {
+        vec4 clip = viewProjection * vec4(aAnchor.xyz, 1.0);
+        origin = (clip.xy / clip.w * vec2(0.5, -0.5) + 0.5) * screenSize;
+    }
+    vec2 pixel = origin + aRect.xy + corner * aRect.zw;
+    TexCoords = mix(aTexRect.xy, aTexRect.zw, corner);
+    Color = aColor;
+    gl_Position = vec4(pixel / screenSize * vec2(2.0, -2.0) + vec2(-1.0, 1.0), 0.0, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,348 @@
+#ifndef UI_BATCH_H
+#define UI_BATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// a region of an atlas page
+struct UiSprite
+{
+	int page = 0;
+	glm::vec4 uv = glm::vec4(0.0f);   // min u, min v, max u, max v
+};
+
+// 2D batch renderer for the HUD and for world-space markers like health bars. every quad
+// is one instance of a 4 vertex strip: where it goes, which atlas region and what color.
+// quads are collected per atlas page over a frame and End() streams them into a ring
+// buffer and draws each page with a single instanced call, so thousands of health bars
+// cost one draw.
+//
+// the ring holds SEGMENTS frames; a fence per segment keeps the CPU from writing into one
+// the GPU may still be reading, so mapping can be unsynchronized. see ui.vs for the instance
+// layout. page 0 is built at Init: a white block for solid quads and a 5x7 pixel font
+class UiBatch
+{
+public:
+	static const unsigned int MAX_QUADS = 16384;   // per frame, further quads are dropped
+	static const unsigned int SEGMENTS = 3;
+	static const int GLYPH_WIDTH = 6;               // font cell in pixels at scale 1, with spacing
+	static const int GLYPH_HEIGHT = 8;
+
+	struct Stats
+	{
+		unsigned int quads = 0;
+		unsigned int draws = 0;
+		unsigned int dropped = 0;
+	};
+
+	~UiBatch()
+	{
+		Release();
+	}
+
+	void Init()
+	{
+		glGenVertexArrays(1, &m_VAO);
+		glGenBuffers(1, &m_VBO);
+		glBindVertexArray(m_VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)SEGMENTS * MAX_QUADS * sizeof(Instance), NULL, GL_STREAM_DRAW);
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			glEnableVertexAttribArray(i);
+			glVertexAttribDivisor(i, 1);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		BuildFontPage();
+	}
+
+	void Release()
+	{
+		if (!m_VAO)
+			return;
+		for (unsigned int i = 0; i < SEGMENTS; i++)
+			if (m_Fences[i])
+				glDeleteSync(m_Fences[i]);
+		for (size_t i = 0; i < m_Pages.size(); i++)
+			glDeleteTextures(1, &m_Pages[i].texture);
+		glDeleteBuffers(1, &m_VBO);
+		glDeleteVertexArrays(1, &m_VAO);
+		m_Pages.clear();
+		m_VAO = m_VBO = 0;
+		for (unsigned int i = 0; i < SEGMENTS; i++)
+			m_Fences[i] = 0;
+	}
+
+	// adds an RGBA8 atlas page, rows top to bottom; returns its index for UiSprite::page
+	int AddPage(unsigned int width, unsigned int height, const uint8_t* rgba)
+	{
+		Page page;
+		page.width = width;
+		page.height = height;
+		glGenTextures(1, &page.texture);
+		glBindTexture(GL_TEXTURE_2D, page.texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		m_Pages.push_back(page);
+		m_Quads.resize(m_Pages.size());
+		return (int)m_Pages.size() - 1;
+	}
+
+	// a region of a page in pixels
+	UiSprite Sprite(int page, int x, int y, int width, int height) const
+	{
+		UiSprite sprite;
+		sprite.page = page;
+		float w = (float)m_Pages[page].width, h = (float)m_Pages[page].height;
+		sprite.uv = glm::vec4(x / w, y / h, (x + width) / w, (y + height) / h);
+		return sprite;
+	}
+
+	// viewProjection places world-space quads, screenSize is in pixels with y down
+	void Begin(const glm::mat4& viewProjection, const glm::vec2& screenSize)
+	{
+		m_ViewProjection = viewProjection;
+		m_ScreenSize = screenSize;
+		m_Stats = Stats();
+		m_Count = 0;
+		for (size_t i = 0; i < m_Quads.size(); i++)
+			m_Quads[i].clear();
+	}
+
+	// screen space: position is the top left corner in pixels
+	void Quad(const UiSprite& sprite, const glm::vec2& position, const glm::vec2& size, uint32_t color)
+	{
+		Add(sprite, glm::vec4(0.0f, 0.0f, 0.0f, 0.0f), glm::vec4(position, size), color);
+	}
+
+	// world space: offset is in pixels from where the anchor lands on screen
+	void WorldQuad(const UiSprite& sprite, const glm::vec3& anchor, const glm::vec2& offset, const glm::vec2& size, uint32_t color)
+	{
+		Add(sprite, glm::vec4(anchor, 1.0f), glm::vec4(offset, size), color);
+	}
+
+	// one line of the built-in font, upper case; returns its width in pixels
+	float Text(const std::string& text, const glm::vec2& position, float scale, uint32_t color)
+	{
+		glm::vec2 pen = position;
+		glm::vec2 size = glm::vec2(GLYPH_WIDTH, GLYPH_HEIGHT) * scale;
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			int c = toupper((unsigned char)text[i]);
+			if (c > ' ' && c < FIRST_GLYPH + GLYPH_COUNT)
+				Quad(m_Glyphs[c - FIRST_GLYPH], pen, size, color);
+			pen.x += size.x;
+		}
+		return pen.x - position.x;
+	}
+
+	const UiSprite& White() const
+	{
+		return m_White;
+	}
+
+	// streams this frame's quads and draws them, one call per page that has any.
+	// blending on, depth test off; the caller's state is put back
+	void End(Shader& shader)
+	{
+		m_Stats.quads = m_Count;
+		if (m_Count == 0)
+			return;
+
+		// the segment written three frames ago must be done on the GPU before reuse
+		unsigned int segment = m_Segment;
+		m_Segment = (m_Segment + 1) % SEGMENTS;
+		if (m_Fences[segment])
+		{
+			glClientWaitSync(m_Fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+			glDeleteSync(m_Fences[segment]);
+			m_Fences[segment] = 0;
+		}
+
+		GLintptr base = (GLintptr)segment * MAX_QUADS * sizeof(Instance);
+		glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+		uint8_t* mapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, base, m_Count * sizeof(Instance),
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!mapped)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			return;
+		}
+		size_t offset = 0;
+		for (size_t p = 0; p < m_Quads.size(); p++)
+		{
+			memcpy(mapped + offset, m_Quads[p].data(), m_Quads[p].size() * sizeof(Instance));
+			offset += m_Quads[p].size() * sizeof(Instance);
+		}
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+
+		GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+		GLboolean blend = glIsEnabled(GL_BLEND);
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		shader.use();
+		shader.setMat4("viewProjection", m_ViewProjection);
+		shader.setVec2("screenSize", m_ScreenSize);
+		shader.setInt("atlasPage", 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindVertexArray(m_VAO);
+		offset = base;
+		for (size_t p = 0; p < m_Quads.size(); p++)
+		{
+			if (m_Quads[p].empty())
+				continue;
+			glBindTexture(GL_TEXTURE_2D, m_Pages[p].texture);
+			glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, anchor)));
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offset + offsetof(Instance, rect)));
+			glVertexAttribPointer(2, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Instance), (void*)(offset + offsetof(Instance, uv)));
+			glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void*)(offset + offsetof(Instance, color)));
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)m_Quads[p].size());
+			offset += m_Quads[p].size() * sizeof(Instance);
+			m_Stats.draws++;
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		m_Fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		if (depthTest)
+			glEnable(GL_DEPTH_TEST);
+		if (!blend)
+			glDisable(GL_BLEND);
+	}
+
+	const Stats& GetStats() const
+	{
+		return m_Stats;
+	}
+
+	// 0xAABBGGRR, the byte order the shader reads
+	static uint32_t Color(float r, float g, float b, float a = 1.0f)
+	{
+		auto byte = [](float v) { return (uint32_t)(glm::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f); };
+		return byte(r) | byte(g) << 8 | byte(b) << 16 | byte(a) << 24;
+	}
+
+private:
+	static const int FIRST_GLYPH = ' ';
+	static const int GLYPH_COUNT = 64;              // ' ' to '_'
+	static const int GLYPHS_PER_ROW = 16;
+	static const GLuint64 FENCE_TIMEOUT_NS = 100000000;
+
+	// 44 bytes per quad
+	struct Instance
+	{
+		float anchor[4];      // world position and w = 1, or w = 0 for screen space
+		float rect[4];        // pixels: x, y from the anchor, width, height
+		uint16_t uv[4];
+		uint32_t color;
+	};
+
+	struct Page
+	{
+		unsigned int texture = 0;
+		unsigned int width = 0;
+		unsigned int height = 0;
+	};
+
+	void Add(const UiSprite& sprite, const glm::vec4& anchor, const glm::vec4& rect, uint32_t color)
+	{
+		if (m_Count >= MAX_QUADS || sprite.page < 0 || sprite.page >= (int)m_Quads.size())
+		{
+			m_Stats.dropped++;
+			return;
+		}
+		Instance q;
+		memcpy(q.anchor, &anchor[0], sizeof(q.anchor));
+		memcpy(q.rect, &rect[0], sizeof(q.rect));
+		for (int i = 0; i < 4; i++)
+			q.uv[i] = (uint16_t)(glm::clamp(sprite.uv[i], 0.0f, 1.0f) * 65535.0f + 0.5f);
+		q.color = color;
+		m_Quads[sprite.page].push_back(q);
+		m_Count++;
+	}
+
+	// page 0: the font in 6x8 cells, 16 to a row, and a white block after the last row
+	void BuildFontPage()
+	{
+		// 5x7 glyphs, one byte per column, bit 0 at the top; ' ' to '_', blanks where unused
+		static const uint8_t font[GLYPH_COUNT][5] = {
+			{ 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x5F, 0x00, 0x00 }, { 0x00, 0x07, 0x00, 0x07, 0x00 }, { 0x14, 0x7F, 0x14, 0x7F, 0x14 },
+			{ 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, { 0x23, 0x13, 0x08, 0x64, 0x62 }, { 0x36, 0x49, 0x55, 0x22, 0x50 }, { 0x00, 0x05, 0x03, 0x00, 0x00 },
+			{ 0x00, 0x1C, 0x22, 0x41, 0x00 }, { 0x00, 0x41, 0x22, 0x1C, 0x00 }, { 0x14, 0x08, 0x3E, 0x08, 0x14 }, { 0x08, 0x08, 0x3E, 0x08, 0x08 },
+			{ 0x00, 0x50, 0x30, 0x00, 0x00 }, { 0x08, 0x08, 0x08, 0x08, 0x08 }, { 0x00, 0x60, 0x60, 0x00, 0x00 }, { 0x20, 0x10, 0x08, 0x04, 0x02 },
+			{ 0x3E, 0x51, 0x49, 0x45, 0x3E }, { 0x00, 0x42, 0x7F, 0x40, 0x00 }, { 0x42, 0x61, 0x51, 0x49, 0x46 }, { 0x21, 0x41, 0x45, 0x4B, 0x31 },
+			{ 0x18, 0x14, 0x12, 0x7F, 0x10 }, { 0x27, 0x45, 0x45, 0x45, 0x39 }, { 0x3C, 0x4A, 0x49, 0x49, 0x30 }, { 0x01, 0x71, 0x09, 0x05, 0x03 },
+			{ 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x06, 0x49, 0x49, 0x29, 0x1E }, { 0x00, 0x36, 0x36, 0x00, 0x00 }, { 0x00, 0x56, 0x36, 0x00, 0x00 },
+			{ 0x08, 0x14, 0x22, 0x41, 0x00 }, { 0x14, 0x14, 0x14, 0x14, 0x14 }, { 0x00, 0x41, 0x22, 0x14, 0x08 }, { 0x02, 0x01, 0x51, 0x09, 0x06 },
+			{ 0x32, 0x49, 0x79, 0x41, 0x3E }, { 0x7E, 0x11, 0x11, 0x11, 0x7E }, { 0x7F, 0x49, 0x49, 0x49, 0x36 }, { 0x3E, 0x41, 0x41, 0x41, 0x22 },
+			{ 0x7F, 0x41, 0x41, 0x22, 0x1C }, { 0x7F, 0x49, 0x49, 0x49, 0x41 }, { 0x7F, 0x09, 0x09, 0x09, 0x01 }, { 0x3E, 0x41, 0x49, 0x49, 0x7A },
+			{ 0x7F, 0x08, 0x08, 0x08, 0x7F }, { 0x00, 0x41, 0x7F, 0x41, 0x00 }, { 0x20, 0x40, 0x41, 0x3F, 0x01 }, { 0x7F, 0x08, 0x14, 0x22, 0x41 },
+			{ 0x7F, 0x40, 0x40, 0x40, 0x40 }, { 0x7F, 0x02, 0x0C, 0x02, 0x7F }, { 0x7F, 0x04, 0x08, 0x10, 0x7F }, { 0x3E, 0x41, 0x41, 0x41, 0x3E },
+			{ 0x7F, 0x09, 0x09, 0x09, 0x06 }, { 0x3E, 0x41, 0x51, 0x21, 0x5E }, { 0x7F, 0x09, 0x19, 0x29, 0x46 }, { 0x46, 0x49, 0x49, 0x49, 0x31 },
+			{ 0x01, 0x01, 0x7F, 0x01, 0x01 }, { 0x3F, 0x40, 0x40, 0x40, 0x3F }, { 0x1F, 0x20, 0x40, 0x20, 0x1F }, { 0x3F, 0x40, 0x38, 0x40, 0x3F },
+			{ 0x63, 0x14, 0x08, 0x14, 0x63 }, { 0x07, 0x08, 0x70, 0x08, 0x07 }, { 0x61, 0x51, 0x49, 0x45, 0x43 }, { 0x00, 0x7F, 0x41, 0x41, 0x00 },
+			{ 0x02, 0x04, 0x08, 0x10, 0x20 }, { 0x00, 0x41, 0x41, 0x7F, 0x00 }, { 0x04, 0x02, 0x01, 0x02, 0x04 }, { 0x40, 0x40, 0x40, 0x40, 0x40 }
+		};
+		const int width = GLYPHS_PER_ROW * GLYPH_WIDTH;
+		const int rows = GLYPH_COUNT / GLYPHS_PER_ROW;
+		const int height = rows * GLYPH_HEIGHT + WHITE_SIZE;
+		std::vector<uint8_t> rgba((size_t)width * height * 4, 0);
+		auto set = [&](int x, int y) {
+			uint8_t* texel = &rgba[((size_t)y * width + x) * 4];
+			texel[0] = texel[1] = texel[2] = texel[3] = 255;
+		};
+		for (int g = 0; g < GLYPH_COUNT; g++)
+		{
+			int cellX = (g % GLYPHS_PER_ROW) * GLYPH_WIDTH;
+			int cellY = (g / GLYPHS_PER_ROW) * GLYPH_HEIGHT;
+			for (int column = 0; column < 5; column++)
+				for (int row = 0; row < 7; row++)
+					if (font[g][column] & (1 << row))
+						set(cellX + column, cellY + row);
+		}
+		for (int y = 0; y < WHITE_SIZE; y++)
+			for (int x = 0; x < WHITE_SIZE; x++)
+				set(x, rows * GLYPH_HEIGHT + y);
+
+		int page = AddPage(width, height, rgba.data());
+		for (int g = 0; g < GLYPH_COUNT; g++)
+			m_Glyphs[g] = Sprite(page, (g % GLYPHS_PER_ROW) * GLYPH_WIDTH, (g / GLYPHS_PER_ROW) * GLYPH_HEIGHT, GLYPH_WIDTH, GLYPH_HEIGHT);
+		// sampled well inside the block, so nearest filtering never reaches its edge
+		m_White = Sprite(page, 1, rows * GLYPH_HEIGHT + 1, WHITE_SIZE - 2, WHITE_SIZE - 2);
+	}
+
+	static const int WHITE_SIZE = 4;
+
+	unsigned int m_VAO = 0;
+	unsigned int m_VBO = 0;
+	GLsync m_Fences[SEGMENTS] = {};
+	unsigned int m_Segment = 0;
+	std::vector<Page> m_Pages;
+	std::vector<std::vector<Instance> > m_Quads;   // this frame's, per page
+	unsigned int m_Count = 0;
+	UiSprite m_Glyphs[GLYPH_COUNT];
+	UiSprite m_White;
+	glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+	glm::vec2 m_ScreenSize = glm::vec2(1.0f);
+	Stats m_Stats;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D sceneTexture;
+uniform vec2 sceneScale;
+uniform vec2 texelSize;
+uniform float sharpness;
+
+void main()
+{
+    // bilinear, then an unsharp mask over the four neighbours to win back some of the
+    // detail lost to the lower resolution. samples stay inside the part in use
+    vec2 low = texelSize * 0.5;
+    vec2 high = sceneScale - texelSize * 0.5;
+    vec3 center = texture(sceneTexture, clamp(TexCoords, low, high)).rgb;
+    vec3 neighbours = texture(sceneTexture, clamp(TexCoords + vec2(texelSize.x, 0.0), low, high)).rgb
+                    + texture(sceneTexture, clamp(TexCoords - vec2(texelSize.x, 0.0), low, high)).rgb
+                    + texture(sceneTexture, clamp(TexCoords + vec2(0.0, texelSize.y), low, high)).rgb
+                    + texture(sceneTexture, clamp(TexCoords - vec2(0.0, texelSize.y), low, high)).rgb;
+    vec3 color = center + (center * 4.0 - neighbours) * sharpness;
+    FragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
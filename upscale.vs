@@ -0,0 +1,12 @@
+#version 330 core
+out vec2 TexCoords;
+
+uniform vec2 sceneScale;    // the part of the scene texture in use
+
+void main()
+{
+    // one triangle covering the screen, from the vertex id alone
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoords = corner * sceneScale;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}